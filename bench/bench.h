@@ -0,0 +1,26 @@
+//
+// Common layout of the workload kernels (see README, "Workload suite")
+//
+// Each kernel is a flat binary loaded at CODE. The stub at its start
+// calls bench_main and then stops the simulation with int 0x80; the
+// result (a checksum of what the kernel computed) is left in rax and
+// sometimes rdx. Kernels only use caller-saved registers and work on
+// the DATA area, which the job maps read/write and fills with zeros.
+//
+
+#define CODE       0x100000
+#define DATA       0x10000000
+#define DATA_SIZE  (8 << 20)
+#define STACK      0x7ffffffe0000
+
+// Multiplier and increment of the 64-bit LCG used for random numbers
+#define LCG_MUL    6364136223846793005
+#define LCG_ADD    1442695040888963407
+
+#define BENCH_START \
+  .text; \
+  .globl _start; \
+_start: \
+  call bench_main; \
+  int $0x80; \
+bench_main:
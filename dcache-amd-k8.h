@@ -311,7 +311,7 @@ namespace CacheSubsystem {
 #ifdef TRACK_LINE_USAGE
       foreach (set, L1_SET_COUNT) {
         foreach (way, waycount) {
-          base_t::sets[set][way].clearstats();
+          base_t::data[set][way].clearstats();
         }
       }
 #endif
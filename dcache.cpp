@@ -475,6 +475,37 @@ void MissBuffer<SIZE>::clock() {
   }
 }
 
+//
+// Number of clock() calls until the next entry changes state,
+// or zero if the miss buffer is idle.
+//
+template <int SIZE>
+W32 MissBuffer<SIZE>::cycles_to_next_event() const {
+  W32 cycles = 0;
+  if likely (freemap.allset()) return 0;
+
+  foreach (i, SIZE) {
+    const Entry& mb = missbufs[i];
+    if likely (freemap[i] | (mb.state == STATE_IDLE)) continue;
+    cycles = (cycles) ? min(cycles, mb.cycles) : mb.cycles;
+  }
+  return cycles;
+}
+
+//
+// Advance all pending fills by <cycles> without delivering
+// anything: the caller guarantees no entry reaches zero.
+//
+template <int SIZE>
+void MissBuffer<SIZE>::skip(W32 cycles) {
+  foreach (i, SIZE) {
+    Entry& mb = missbufs[i];
+    if likely (freemap[i] | (mb.state == STATE_IDLE)) continue;
+    assert(mb.cycles > cycles);
+    mb.cycles -= cycles;
+  }
+}
+
 template <int SIZE>
 void MissBuffer<SIZE>::annul_lfrq(int slot) {
   foreach (i, SIZE) {
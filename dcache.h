@@ -313,7 +313,7 @@ namespace CacheSubsystem {
 #ifdef TRACK_LINE_USAGE
       foreach (set, L1_SET_COUNT) {
         foreach (way, waycount) {
-          base_t::sets[set][way].clearstats();
+          base_t::data[set][way].clearstats();
         }
       }
 #endif
@@ -594,6 +594,8 @@ namespace CacheSubsystem {
     void annul_lfrq(int slot);
     void annul_lfrq(int slot, int threadid);
     void clock();
+    W32 cycles_to_next_event() const;
+    void skip(W32 cycles);
 
     ostream& print(ostream& os) const;
   };
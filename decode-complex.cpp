@@ -1140,6 +1140,7 @@ bool TraceDecoder::decode_complex() {
   case 0x9f: { // lahf: %ah = %flags[7:0]
     EndOfDecode();
     this << TransOp(OP_collcc, REG_temp0, REG_zf, REG_cf, REG_of, 3, 0, 0, FLAGS_DEFAULT_ALU);
+    this << TransOp(OP_or, REG_temp0, REG_temp0, REG_imm, REG_zero, 3, 0x2); // bit 1 always reads as 1
     this << TransOp(OP_maskb, REG_rax, REG_rax, REG_temp0, REG_imm, 3, 0, MaskControlInfo(56, 8, 56));
     break;
   }
@@ -1149,7 +1150,9 @@ bool TraceDecoder::decode_complex() {
     //++MTY TODO: this is very rare: move to slowpath decoder
     // TransOp(int opcode, int rd, int ra, int rb, int rc, int size, W64s rbimm = 0, W64s rcimm = 0, W32 setflags = 0)
     EndOfDecode();
-    this << TransOp(OP_xorcc, REG_temp0, REG_cf, REG_imm, REG_zero, 3, FLAG_CF, 0, SETFLAG_CF);
+    // xorcc works on the flags attached to its operands, and an immediate has none: put FLAG_CF in temp1's flags first
+    this << TransOp(OP_movrcc, REG_temp1, REG_zero, REG_imm, REG_zero, 3, FLAG_CF);
+    this << TransOp(OP_xorcc, REG_temp0, REG_cf, REG_temp1, REG_zero, 3, 0, 0, SETFLAG_CF);
     if unlikely (no_partial_flag_updates_per_insn) this << TransOp(OP_collcc, REG_temp10, REG_zf, REG_cf, REG_of, 3, 0, 0, FLAGS_DEFAULT_ALU);
     break;
   }
@@ -10,6 +10,7 @@
 #include <datastore.h>
 #include <decode.h>
 #include <stats.h>
+#include <elf.h>
 
 
 BasicBlockCache bbcache;
@@ -133,10 +134,9 @@ const char* assist_name(assist_func_t assist) {
   return "unknown";
 }
 
-void update_assist_stats(assist_func_t assist) {
-  int idx = assist_index(assist);
-  assert(inrange(idx, 0, ASSIST_COUNT-1));
-  stats.external.assists[idx]++;
+void update_assist_stats(int assistid) {
+  assert(inrange(assistid, 0, ASSIST_COUNT-1));
+  stats.external.assists[assistid]++;
 }
 
 void split_unaligned(const TransOp& transop, TransOpBuffer& buf) {
@@ -448,6 +448,7 @@ void TraceDecoder::reset() {
   split_invalid_basic_blocks = 0;
   no_partial_flag_updates_per_insn = 0;
   fast_length_decode_only = 0;
+  vec128_uops = config.sse128_uops;
   join_with_prev_insn = 0;
   outcome = DECODE_OUTCOME_OK;
   stop_at_rip = limits<W64>::max;
@@ -507,11 +508,51 @@ void TraceDecoder::put(const TransOp& transop) {
     last_flags_update_was_atomic = (transop.setflags == 0x7);
 }
 
+//
+// Merge each pair of identical uops on the low and high halves of
+// an SSE register (or temp register pair) into one vec128 uop. Only
+// plain ALU and FP uops are merged: loads, stores and anything that
+// reads or writes flags stay split.
+//
+static inline bool vec128_mergeable_operands(int lo, int hi) {
+  return ((lo == hi) & ((lo == REG_zero) | (lo == REG_imm))) | (is_vec128_pair(lo) & (hi == (lo + 1)));
+}
+
+void TraceDecoder::fuse_vec128_pairs() {
+  static const W32 unmergeable = OPCLASS_MEM|OPCLASS_BRANCH|OPCLASS_CHECK|OPCLASS_FLAGS|OPCLASS_SELECT|OPCLASS_ADDSUBC;
+
+  int n = 0;
+  int i = 0;
+  while (i < transbufcount) {
+    TransOp& lo = transbuf[i];
+    bool merge = 0;
+
+    if ((i + 1) < transbufcount) {
+      const TransOp& hi = transbuf[i+1];
+      merge = (lo.opcode == hi.opcode) & (!isclass(lo.opcode, unmergeable)) &
+        (lo.size == hi.size) & (lo.extshift == hi.extshift) & (lo.cond == hi.cond) & (lo.datatype == hi.datatype) &
+        (lo.setflags == 0) & (hi.setflags == 0) & (lo.nouserflags == hi.nouserflags) & (lo.internal == hi.internal) &
+        (lo.rbimm == hi.rbimm) & (lo.rcimm == hi.rcimm) & (lo.rc == REG_zero) & (hi.rc == REG_zero) &
+        is_vec128_pair(lo.rd) & (hi.rd == (lo.rd + 1)) &
+        vec128_mergeable_operands(lo.ra, hi.ra) & vec128_mergeable_operands(lo.rb, hi.rb);
+    }
+
+    if (merge) lo.vec128 = 1;
+    transbuf[n++] = lo;
+    i += (merge) ? 2 : 1;
+  }
+
+  stats.decoder.throughput.vec128_uops += (transbufcount - n);
+  transbufcount = n;
+}
+
 bool TraceDecoder::flush() {
   if unlikely (!transbufcount) {
     return true;
   }
 
+  if unlikely (vec128_uops & is_sse) fuse_vec128_pairs();
+
   //
   // Can we fit all the uops in this x86 insn?
   //
@@ -571,6 +612,7 @@ bool TraceDecoder::flush() {
   foreach (i, transbufcount) {
     TransOp& transop = transbuf[i];
     if likely (transop.rd < ARCHREG_COUNT) { final_archreg_writer[transop.rd] = i; }
+    if unlikely (transop.vec128 && (transop.rd < ARCHREG_COUNT)) { final_archreg_writer[transop.rd + 1] = i; }
     bool sets_all_flags = ((transop.setflags == 7) && (!transop.nouserflags));
     if unlikely (sets_all_flags) final_flags_writer = i;
     if likely (!transop.nouserflags) flag_sets_set |= transop.setflags;
@@ -630,6 +672,11 @@ bool TraceDecoder::flush() {
     if (transop.ra < ARCHREG_COUNT) setbit(bb.usedregs, transop.ra);
     if (transop.rb < ARCHREG_COUNT) setbit(bb.usedregs, transop.rb);
     if (transop.rc < ARCHREG_COUNT) setbit(bb.usedregs, transop.rc);
+    if unlikely (transop.vec128) {
+      if (transop.rd < ARCHREG_COUNT) setbit(bb.usedregs, transop.rd + 1);
+      if (transop.ra < ARCHREG_COUNT) setbit(bb.usedregs, vec128_hi(transop.ra));
+      if (transop.rb < ARCHREG_COUNT) setbit(bb.usedregs, vec128_hi(transop.rb));
+    }
   }
 
   stats.decoder.throughput.uops += transbufcount;
@@ -1388,6 +1435,147 @@ void assist_invalid_opcode(Context& ctx) {
 
 static const bool log_code_page_ops = 0;
 
+TranslationArena bbarena;
+
+//
+// Each allocation is preceded by its size and its offset from
+// the start of the chunk it was carved out of:
+//
+struct TranslationArenaHeader {
+  W32 bytes;
+  W32 offset;
+};
+
+void* TranslationArena::alloc(size_t bytes) {
+  size_t need = ceil(sizeof(TranslationArenaHeader) + bytes, 8);
+  assert(need <= (CHUNK_SIZE - sizeof(Chunk)));
+
+  if unlikely ((!current) || ((current->top + need) > current->end)) {
+    // Getting the pages may reclaim blocks, and thereby chunks, first:
+    Chunk* chunk = (Chunk*)ptl_mm_alloc_private_pages(CHUNK_SIZE);
+    chunk->top = (byte*)(chunk + 1);
+    chunk->end = (byte*)chunk + CHUNK_SIZE;
+    chunk->live = 0;
+    chunk->prev = null;
+    chunk->next = chunks;
+    if (chunks) chunks->prev = chunk;
+    chunks = chunk;
+    bytes_reserved += CHUNK_SIZE;
+
+    // The old chunk was only kept while it was being filled:
+    Chunk* old = current;
+    current = chunk;
+    if (old && (!old->live)) release(old);
+  }
+
+  TranslationArenaHeader* h = (TranslationArenaHeader*)current->top;
+  h->bytes = need;
+  h->offset = (byte*)h - (byte*)current;
+  current->top += need;
+  current->live++;
+  bytes_in_use += need;
+  return h + 1;
+}
+
+size_t TranslationArena::getsize(const void* p) {
+  return ((const TranslationArenaHeader*)p - 1)->bytes;
+}
+
+void TranslationArena::free(void* p) {
+  TranslationArenaHeader* h = (TranslationArenaHeader*)p - 1;
+  Chunk* chunk = (Chunk*)((byte*)h - h->offset);
+  assert(chunk->live > 0);
+  bytes_in_use -= h->bytes;
+  chunk->live--;
+
+  if likely (chunk->live) return;
+
+  if (chunk == current) {
+    // Start filling it again from the bottom:
+    chunk->top = (byte*)(chunk + 1);
+  } else {
+    release(chunk);
+  }
+}
+
+void TranslationArena::release(Chunk* chunk) {
+  if (chunk->prev) chunk->prev->next = chunk->next; else chunks = chunk->next;
+  if (chunk->next) chunk->next->prev = chunk->prev;
+  if (chunk == current) current = null;
+  bytes_reserved -= CHUNK_SIZE;
+  ptl_mm_free_private_pages(chunk, CHUNK_SIZE);
+}
+
+void TranslationArena::flush() {
+  Chunk* chunk = chunks;
+  while (chunk) {
+    Chunk* next = chunk->next;
+    if (!chunk->live) release(chunk);
+    chunk = next;
+  }
+}
+
+//
+// This is explicitly defined instead of just using a
+// destructor since we do some fancy dynamic resizing
+// in the clone() method that c++ will croak on.
+//
+// Once you call this, the basic block is *gone* and
+// cannot be accessed ever again, even if it is still
+// in scope. Don't call this with non-cloned() blocks.
+//
+void BasicBlock::free() {
+  synthops = null;
+  if (seqops) delete[] seqops;
+  seqops = null;
+  bbarena.free(this);
+}
+
+W64 BasicBlock::getsize() const {
+  return TranslationArena::getsize(this);
+}
+
+BasicBlock* BasicBlockBuffer::clone() const {
+  int immcount = 0;
+  foreach (i, count) {
+    const TransOp& uop = transops[i];
+    immcount += (uop.rbimm != 0) + (uop.rcimm != 0) + (uop.riptaken != 0) + (uop.ripseq != 0);
+  }
+
+  BasicBlock* bb = (BasicBlock*)bbarena.alloc(sizeof(BasicBlockBase) + (count * (sizeof(PackedTransOp) + sizeof(uopimpl_func_t))) + (immcount * sizeof(W64)));
+
+  memcpy(bb, this, sizeof(BasicBlockBase));
+
+  bb->synthops = null;
+  bb->seqops = null;
+  bb->jitcode = null;
+  // hashlink, mfnlo_loc, mfnhi_loc are always updated after cloning
+  bb->hashlink.reset();
+  bb->use(0);
+  bb->taken_link = null;
+  bb->not_taken_link = null;
+  bb->link_generation = 0;
+
+  W64* imm = (W64*)bb->immediates();
+  int n = 0;
+
+  foreach (i, count) {
+    const TransOp& uop = transops[i];
+    PackedTransOp& packed = bb->uops[i];
+    static_cast<TransOpHeader&>(packed) = uop;
+    packed.immindex = n;
+    packed.immmask = 0;
+    packed.pad = 0;
+    if (uop.rbimm) { packed.immmask |= PACKED_RBIMM; imm[n++] = uop.rbimm; }
+    if (uop.rcimm) { packed.immmask |= PACKED_RCIMM; imm[n++] = uop.rcimm; }
+    if (uop.riptaken) { packed.immmask |= PACKED_RIPTAKEN; imm[n++] = uop.riptaken; }
+    if (uop.ripseq) { packed.immmask |= PACKED_RIPSEQ; imm[n++] = uop.ripseq; }
+  }
+
+  return bb;
+}
+
+
 bool BasicBlockCache::invalidate(BasicBlock* bb, int reason) {
   BasicBlockChunkList* pagelist;
   if unlikely (bb->refcount) {
@@ -1397,7 +1585,11 @@ bool BasicBlockCache::invalidate(BasicBlock* bb, int reason) {
 
   if unlikely (bbcache_dump_file) {
     bbcache_dump_file.write((BasicBlockBase*)bb, sizeof(BasicBlockBase));
-    bbcache_dump_file.write(bb->transops, bb->count * sizeof(TransOp));
+    foreach (i, bb->count) {
+      TransOp uop;
+      bb->getuop(i, uop);
+      bbcache_dump_file.write(&uop, sizeof(TransOp));
+    }
   }
 
   pagelist = bbpages.get(bb->rip.mfnlo);
@@ -1417,7 +1609,20 @@ bool BasicBlockCache::invalidate(BasicBlock* bb, int reason) {
   stats.decoder.bbcache.count = bbcache.count;
   stats.decoder.bbcache.invalidates[reason]++;
 
+  if (bb->clock_next == bb) {
+    clock_hand = null;
+  } else {
+    bb->clock_prev->clock_next = bb->clock_next;
+    bb->clock_next->clock_prev = bb->clock_prev;
+    if (clock_hand == bb) clock_hand = bb->clock_next;
+  }
+
+  // Other blocks may still link to this one:
+  invalidate_links();
+
   bb->free();
+  stats.decoder.bbcache.bytes = bbarena.bytes_in_use;
+  stats.decoder.bbcache.arena_bytes = bbarena.bytes_reserved;
   return true;
 }
 
@@ -1485,93 +1690,70 @@ bool BasicBlockCache::invalidate_page(Waddr mfn, int reason) {
 }
 
 //
-// Scan through the BB cache and try to free up
-// <bytesreq> bytes, starting with the least
-// recently used BBs.
+// Rips of recently evicted blocks, to count how many of them
+// are translated again (see stats.decoder.bbcache.retranslations)
 //
-int BasicBlockCache::reclaim(size_t bytesreq, int urgency) {
-  bool DEBUG = 1; // logable(1);
-
-  if (!count) return 0;
+static const int EVICTED_RIP_SLOTS = 4096;
+static W64 evicted_rips[EVICTED_RIP_SLOTS];
 
-  if (DEBUG) logfile << "Reclaiming cached basic blocks at ", sim_cycle, " cycles, ", total_user_insns_committed, " commits:", endl;
+static inline W64& evicted_rip_slot(Waddr rip) {
+  return evicted_rips[lowbits(rip ^ (rip >> 12), log2(EVICTED_RIP_SLOTS))];
+}
 
-  stats.decoder.reclaim_rounds++;
+//
+// Evict blocks in CLOCK order until at least <bytes> bytes have
+// been freed, or every block not in use if <all> is set. Blocks
+// used since the hand last passed them get a second chance, so
+// each block is visited at most twice per call.
+//
+W64 BasicBlockCache::evict(W64 bytes, bool all) {
+  W64 freed = 0;
+  int visits = 2 * count;
 
-  W64 oldest = limits<W64>::max;
-  W64 newest = 0;
-  W64 average = 0;
-  W64 total_bytes = 0;
+  while (clock_hand && (all || (freed < bytes)) && (visits-- > 0)) {
+    BasicBlock* bb = clock_hand;
+    clock_hand = bb->clock_next;
 
-  int n = 0;
+    //
+    // We cannot invalidate anything that's still in the pipeline.
+    // If this is required, the pipeline must be flushed before
+    // the forced invalidation can occur.
+    //
+    if unlikely (bb->refcount) continue;
 
-  Iterator iter(this);
-  BasicBlock* bb;
+    if ((!all) && (bb->lastused >= bb->clockstamp)) {
+      bb->clockstamp = bb->lastused + 1;
+      continue;
+    }
 
-  while (bb = iter.next()) {
-    oldest = min(oldest, bb->lastused);
-    newest = max(newest, bb->lastused);
-    average += bb->lastused;
-    total_bytes += ptl_mm_getsize(bb);
-    n++;
+    freed += bb->getsize();
+    evicted_rip_slot(bb->rip.rip) = bb->rip.rip;
+    invalidate(bb, INVALIDATE_REASON_RECLAIM);
+    stats.decoder.bbcache.evictions++;
   }
 
-  assert(count == n);
-  assert(n > 0);
-  average /= n;
+  return freed;
+}
 
-  if unlikely (urgency >= MAX_URGENCY) {
-    //
-    // The allocator is so strapped for memory, we need to free
-    // everything possible at all costs:
-    //
-    average = infinity;
-  }
+//
+// Free up at least <bytesreq> bytes (and no less than half of
+// the cache) when the allocator runs low on memory, starting
+// with the least recently used BBs.
+//
+int BasicBlockCache::reclaim(size_t bytesreq, int urgency) {
+  if (!count) return 0;
 
-  if (DEBUG) {
-    logfile << "Before:", endl;
-    logfile << "  Basic blocks:   ", intstring(count, 12), endl;
-    logfile << "  Bytes occupied: ", intstring(total_bytes, 12), endl;
-    logfile << "  Oldest cycle:   ", intstring(oldest, 12), endl;
-    logfile << "  Average cycle:  ", intstring(average, 12), endl;
-    logfile << "  Newest cycle:   ", intstring(newest, 12), endl;
-  }
+  stats.decoder.reclaim_rounds++;
+
+  int oldcount = count;
 
   //
-  // Reclaim all objects older than the average
+  // If the allocator is so strapped for memory, we need to
+  // free everything possible at all costs:
   //
-  n = 0;
-  W64 reclaimed_bytes = 0;
-  int reclaimed_objs = 0;
+  W64 freed = evict(max((W64)bytesreq, bbarena.bytes_in_use / 2), (urgency >= MAX_URGENCY));
 
-  iter.reset(this);
-  while (bb = iter.next()) {
-    if unlikely (bb->refcount) {
-      //
-      // We cannot invalidate anything that's still in the pipeline.
-      // If this is required, the pipeline must be flushed before
-      // the forced invalidation can occur.
-      //
-      logfile << "Warning: eligible bb ", bb, " ", bb->rip, " (lastused ", bb->lastused, ") still has refcount ", bb->refcount, endl;
-      continue;
-    }
-
-    // We use '<=' to guarantee even a uniform distribution will eventually be reclaimed:
-    if likely (bb->lastused <= average) {
-      reclaimed_bytes += ptl_mm_getsize(bb);
-      reclaimed_objs++;
-      invalidate(bb, INVALIDATE_REASON_RECLAIM);
-    }
-    n++;
-  }
-
-  if (DEBUG) {
-    logfile << "After:", endl;
-    logfile << "  Basic blocks:   ", intstring(reclaimed_objs, 12), " BBs reclaimed", endl;
-    logfile << "  Bytes occupied: ", intstring(reclaimed_bytes, 12), " bytes reclaimed", endl;
-    logfile << "  New pool size:  ", intstring(count, 12), " BBs", endl;
-    logfile.flush();
-  }
+  if (logable(1)) logfile << "Reclaimed ", (oldcount - count), " basic blocks (", freed, " bytes) at ", sim_cycle, " cycles, ", total_user_insns_committed, " commits; ", count, " left", endl;
 
   //
   // Reclaim per-page chunklist heads
@@ -1580,26 +1762,16 @@ int BasicBlockCache::reclaim(size_t bytesreq, int urgency) {
   {
     BasicBlockPageCache::Iterator iter(&bbpages);
     BasicBlockChunkList* page;
-    int pages_freed = 0;
 
-    if (DEBUG) logfile << "Scanning ", bbpages.count, " code pages:", endl;
     while (page = iter.next()) {
-      if (page->empty()) {
-        if (!page->refcount) {
-          if (DEBUG) logfile << "  mfn ", page->mfn, " has no entries; freeing", endl;
-          bbpages.remove(page);
-          delete page;
-          pages_freed++;
-        } else {
-          if (DEBUG) logfile << "  mfn ", page->mfn, " still has refs to it: cannot free it yet", endl;
-        }
+      if (page->empty() && (!page->refcount)) {
+        bbpages.remove(page);
+        delete page;
       }
     }
-
-    if (DEBUG) logfile << "Freed ", pages_freed, " empty pages", endl;
   }
 
-  return n;
+  return oldcount - count;
 }
 
 //
@@ -1608,9 +1780,7 @@ int BasicBlockCache::reclaim(size_t bytesreq, int urgency) {
 // references are allowed.
 //
 void BasicBlockCache::flush() {
-  bool DEBUG = 1;
-
-  if (DEBUG) logfile << "Flushing basic block cache at ", sim_cycle, " cycles, ", total_user_insns_committed, " commits:", endl;
+  if (logable(1)) logfile << "Flushing basic block cache at ", sim_cycle, " cycles, ", total_user_insns_committed, " commits:", endl;
 
   stats.decoder.reclaim_rounds++;
 
@@ -1622,6 +1792,10 @@ void BasicBlockCache::flush() {
     }
   }
 
+  // With every block gone, all translation arena chunks go back at once
+  bbarena.flush();
+  stats.decoder.bbcache.arena_bytes = bbarena.bytes_reserved;
+
   //
   // Reclaim per-page chunklist heads
   //
@@ -1834,6 +2008,23 @@ int TraceDecoder::fillbuf(Context& ctx, byte* insnbytes, int insnbytes_bufsize)
   return valid_byte_count;
 }
 
+//
+// Same for code in a host buffer of <bytes> bytes, for
+// decode_code_buffer(): the end of the buffer is treated
+// like the end of the last valid page.
+//
+int TraceDecoder::fillbuf_copy(const byte* code, W64 bytes, byte* insnbytes, int insnbytes_bufsize) {
+  this->insnbytes = insnbytes;
+  this->insnbytes_bufsize = insnbytes_bufsize;
+  byteoffset = 0;
+  pfec = 0;
+  invalid = 0;
+  valid_byte_count = min(bytes, (W64)insnbytes_bufsize);
+  memcpy(insnbytes, code, valid_byte_count);
+  faultaddr = bb.rip.rip + valid_byte_count;
+  return valid_byte_count;
+}
+
 #ifdef PTLSIM_HYPERVISOR
 int TraceDecoder::fillbuf_phys_prechecked(byte* insnbytes, int insnbytes_bufsize, Level1PTE ptelo, Level1PTE ptehi) {
   this->insnbytes = insnbytes;
@@ -1998,6 +2189,247 @@ ostream& printflags(ostream& os, W64 flags) {
   return os;
 }
 
+//
+// Persistent translation cache file: the records already in the file
+// are mapped read-only (so all processes using the same file share
+// those pages), and blocks not found there are appended after being
+// translated. Each record goes out in a single write to a file opened
+// with O_APPEND, so concurrent processes never interleave records.
+//
+static const int DECODER_STAT_WORDS = sizeof(stats.decoder) / sizeof(W64);
+
+//
+// The GNU build id of this binary, i.e. a hash of the linked image
+// that changes with any change to the decoder (or anything else).
+// It is found through the program headers after the ELF header,
+// which the linker maps at __ehdr_start.
+//
+extern const Elf64_Ehdr __ehdr_start __attribute__((weak));
+
+static bool get_build_id(byte* buildid) {
+  const Elf64_Ehdr* ehdr = &__ehdr_start;
+  if unlikely (!ehdr) return false;
+
+  const Elf64_Phdr* phdr = (const Elf64_Phdr*)((const byte*)ehdr + ehdr->e_phoff);
+  Waddr bias = 0;
+  foreach (i, ehdr->e_phnum) {
+    if ((phdr[i].p_type == PT_LOAD) && (phdr[i].p_offset == 0)) bias = (Waddr)ehdr - phdr[i].p_vaddr;
+  }
+
+  foreach (i, ehdr->e_phnum) {
+    if (phdr[i].p_type != PT_NOTE) continue;
+    const byte* p = (const byte*)(phdr[i].p_vaddr + bias);
+    const byte* end = p + phdr[i].p_memsz;
+    while ((p + sizeof(Elf64_Nhdr)) <= end) {
+      const Elf64_Nhdr* note = (const Elf64_Nhdr*)p;
+      const byte* name = p + sizeof(Elf64_Nhdr);
+      const byte* desc = name + ceil(note->n_namesz, 4);
+      if ((note->n_type == NT_GNU_BUILD_ID) && (note->n_namesz == 4) && (!memcmp(name, "GNU", 4))) {
+        memset(buildid, 0, BUILD_ID_SIZE);
+        memcpy(buildid, desc, min((int)note->n_descsz, BUILD_ID_SIZE));
+        return true;
+      }
+      p = desc + ceil(note->n_descsz, 4);
+    }
+  }
+
+  return false;
+}
+
+struct BasicBlockFileEntry {
+  W64 rip;
+  W64 offset;
+};
+
+// By rip, and the most recently appended record first:
+struct BasicBlockFileEntryComparator {
+  int operator ()(const BasicBlockFileEntry& a, const BasicBlockFileEntry& b) const {
+    if (a.rip != b.rip) return (a.rip < b.rip) ? -1 : +1;
+    if (a.offset != b.offset) return (a.offset > b.offset) ? -1 : +1;
+    return 0;
+  }
+};
+
+struct BasicBlockFile {
+  const byte* map;
+  W64 mapsize;
+  odstream out;
+  // All usable records in the mapped part of the file, sorted by rip:
+  dynarray<BasicBlockFileEntry> index;
+
+  BasicBlockFile() { map = null; mapsize = 0; }
+
+  bool check(const BasicBlockFileRecord* rec, W64 avail) const {
+    if unlikely ((rec->magic != BasicBlockFileRecord::MAGIC) | (rec->size > avail) | (rec->size % 8)) return false;
+    W64 fixed = sizeof(BasicBlockFileRecord) + sizeof(BasicBlockBase);
+    if unlikely (rec->size < fixed) return false;
+    const BasicBlockBuffer* bb = rec->bb();
+    if unlikely (bb->count > (MAX_BB_UOPS*2)) return false;
+    if unlikely ((fixed + (bb->count * sizeof(TransOp)) + (rec->statcount * sizeof(BasicBlockFileStat)) + rec->codebytes) > rec->size) return false;
+    foreach (i, rec->statcount) {
+      if unlikely (rec->stats()[i].index >= DECODER_STAT_WORDS) return false;
+    }
+    return (rec->codebytes <= MAX_BB_BYTES);
+  }
+
+  bool open(const char* filename) {
+    close();
+
+    byte buildid[BUILD_ID_SIZE];
+    if (!get_build_id(buildid)) {
+      cerr << "Error: this binary has no build id to tag translation cache file '", filename, "' with", endl;
+      return false;
+    }
+
+    if (!out.open(filename, true, 0)) {
+      cerr << "Error: cannot open translation cache file '", filename, "'", endl;
+      return false;
+    }
+
+    idstream is(filename);
+    W64 size = (is) ? is.size() : 0;
+
+    if (!size) {
+      BasicBlockFileHeader header;
+      setzero(header);
+      header.magic = BasicBlockFileHeader::MAGIC;
+      header.version = BasicBlockFileHeader::VERSION;
+      memcpy(header.buildid, buildid, sizeof(buildid));
+      header.sse128 = config.sse128_uops;
+      out.write(&header, sizeof(header));
+      return true;
+    }
+
+    const BasicBlockFileHeader* header = (size >= sizeof(BasicBlockFileHeader)) ? (const BasicBlockFileHeader*)is.mmap(size) : null;
+
+    if unlikely ((!header) || (header->magic != BasicBlockFileHeader::MAGIC) | (header->version != BasicBlockFileHeader::VERSION) |
+                 (memcmp(header->buildid, buildid, sizeof(buildid)) != 0) | (header->sse128 != (W32)config.sse128_uops)) {
+      cerr << "Error: '", filename, "' is not a compatible translation cache file", endl;
+      if (header) sys_munmap((void*)header, size);
+      out.close();
+      return false;
+    }
+
+    map = (const byte*)header;
+    mapsize = size;
+
+    int count = 0;
+    W64 offset = sizeof(BasicBlockFileHeader);
+    while ((offset + sizeof(BasicBlockFileRecord)) <= size) {
+      const BasicBlockFileRecord* rec = (const BasicBlockFileRecord*)(map + offset);
+      if unlikely (!check(rec, size - offset)) {
+        // The last record may still be being written by another process;
+        // anything else means records appended from now on would be lost
+        bool partial = ((rec->magic == BasicBlockFileRecord::MAGIC) & (rec->size > (size - offset)));
+        if (!partial) {
+          cerr << "Warning: translation cache file '", filename, "' is damaged after ", count, " records; not adding new ones", endl;
+          out.close();
+        }
+        break;
+      }
+      offset += rec->size;
+      count++;
+    }
+
+    index.resize(count);
+    offset = sizeof(BasicBlockFileHeader);
+    foreach (i, count) {
+      const BasicBlockFileRecord* rec = (const BasicBlockFileRecord*)(map + offset);
+      index[i].rip = rec->rip;
+      index[i].offset = offset;
+      offset += rec->size;
+    }
+    sort(index.data, index.length, BasicBlockFileEntryComparator());
+
+    stats.decoder.bbfile.records = count;
+    return true;
+  }
+
+  void close() {
+    if (map) sys_munmap((void*)map, mapsize);
+    map = null;
+    mapsize = 0;
+    index.clear();
+    if (out) out.close();
+  }
+
+  const BasicBlockFileRecord* find(const RIPVirtPhys& rvp, const byte* insnbuf, int valid_byte_count) const {
+    // First entry for this rip, if any:
+    int lo = 0;
+    int hi = index.length;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (index[mid].rip < rvp.rip) lo = mid + 1; else hi = mid;
+    }
+
+    for (int i = lo; (i < index.length) && (index[i].rip == rvp.rip); i++) {
+      const BasicBlockFileRecord* rec = (const BasicBlockFileRecord*)(map + index[i].offset);
+      if ((rec->use64 != rvp.use64) | (rec->kernel != rvp.kernel) | (rec->df != rvp.df)) continue;
+      if (min(valid_byte_count, rec->codebytes + 1) != rec->validbytes) continue;
+      if (memcmp(rec->code(), insnbuf, rec->codebytes)) continue;
+      return rec;
+    }
+
+    return null;
+  }
+
+  void apply_stats(const BasicBlockFileRecord* rec) {
+    W64* words = (W64*)&stats.decoder;
+    foreach (i, rec->statcount) words[rec->stats()[i].index] += (W64s)rec->stats()[i].delta;
+  }
+
+  void append(const TraceDecoder& trans, const W64* statsbefore) {
+    const BasicBlockBuffer* bb = &trans.bb;
+    BasicBlockFileStat deltas[DECODER_STAT_WORDS];
+    int statcount = 0;
+    const W64* words = (const W64*)&stats.decoder;
+    foreach (i, DECODER_STAT_WORDS) {
+      if (words[i] == statsbefore[i]) continue;
+      deltas[statcount].index = i;
+      deltas[statcount].delta = (W64s)(words[i] - statsbefore[i]);
+      statcount++;
+    }
+
+    // The decoder only ever advances byteoffset, so it never looked past it:
+    int codebytes = min(trans.byteoffset, trans.valid_byte_count);
+    int bbbytes = sizeof(BasicBlockBase) + (bb->count * sizeof(TransOp));
+    int size = ceil(sizeof(BasicBlockFileRecord) + bbbytes + (statcount * sizeof(BasicBlockFileStat)) + codebytes, 8);
+
+    byte* buf = new byte[size];
+    memset(buf, 0, size);
+    BasicBlockFileRecord* rec = (BasicBlockFileRecord*)buf;
+    rec->magic = BasicBlockFileRecord::MAGIC;
+    rec->size = size;
+    rec->rip = bb->rip.rip;
+    rec->codebytes = codebytes;
+    rec->validbytes = min(trans.valid_byte_count, codebytes + 1);
+    rec->statcount = statcount;
+    rec->use64 = bb->rip.use64;
+    rec->kernel = bb->rip.kernel;
+    rec->df = bb->rip.df;
+
+    BasicBlockBuffer* recbb = (BasicBlockBuffer*)(rec + 1);
+    memcpy(recbb, bb, bbbytes);
+    setzero(recbb->rip);
+    recbb->rip.rip = bb->rip.rip;
+    recbb->hashlink.reset();
+    recbb->refcount = 0;
+
+    memcpy((void*)rec->stats(), deltas, statcount * sizeof(BasicBlockFileStat));
+    memcpy((void*)rec->code(), trans.insnbytes, codebytes);
+
+    out.write(buf, size);
+    delete[] buf;
+    stats.decoder.bbfile.appends++;
+  }
+};
+
+static BasicBlockFile bbfile;
+
+bool open_bbcache_file(const char* filename) {
+  return bbfile.open(filename);
+}
+
 //
 // Translate one basic block. This function always returns
 // a BasicBlock, except in the very rare case where one or
@@ -2041,14 +2473,37 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
     assert(trans.valid_byte_count == 0);
   }
 
-  for (;;) {
-    // if (DEBUG) logfile << "rip ", (void*)trans.rip, ", relrip = ", (void*)(trans.rip - trans.bb.rip), endl;
-    if (!trans.translate()) break;
-  }
+  const BasicBlockFileRecord* rec = (bbfile.map) ? bbfile.find(rvp, insnbuf, trans.valid_byte_count) : null;
 
-  trans.bb.hitcount = 0;
-  trans.bb.predcount = 0;
-  bb = trans.bb.clone();
+  if (rec) {
+    bb = rec->bb()->clone();
+    bb->rip = rvp;
+    bbfile.apply_stats(rec);
+    stats.decoder.bbfile.hits++;
+    if (logable(5)) logfile << "Found ", rvp, " in translation cache file", endl;
+  } else {
+    W64& evicted = evicted_rip_slot(rvp.rip);
+    if unlikely (evicted == rvp.rip) {
+      stats.decoder.bbcache.retranslations++;
+      evicted = 0;
+    }
+
+    W64 statsbefore[DECODER_STAT_WORDS];
+    if (bbfile.out) memcpy(statsbefore, &stats.decoder, sizeof(statsbefore));
+
+    for (;;) {
+      // if (DEBUG) logfile << "rip ", (void*)trans.rip, ", relrip = ", (void*)(trans.rip - trans.bb.rip), endl;
+      if (!trans.translate()) break;
+    }
+
+    trans.bb.hitcount = 0;
+    trans.bb.predcount = 0;
+
+    // Blocks ending in a fault depend on more than the instruction bytes
+    if (bbfile.out && (!trans.bb.invalidblock)) bbfile.append(trans, statsbefore);
+
+    bb = trans.bb.clone();
+  }
   //
   // Acquire a reference to the new basic block right away,
   // since we make allocations below that might reclaim it
@@ -2057,8 +2512,24 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
   bb->acquire();
 
   add(bb);
+
+  // New blocks go in just behind the clock hand:
+  if (clock_hand) {
+    bb->clock_next = clock_hand;
+    bb->clock_prev = clock_hand->clock_prev;
+    bb->clock_prev->clock_next = bb;
+    clock_hand->clock_prev = bb;
+  } else {
+    bb->clock_next = bb;
+    bb->clock_prev = bb;
+    clock_hand = bb;
+  }
+  bb->clockstamp = 0;
+
   stats.decoder.bbcache.count = this->count;
   stats.decoder.bbcache.inserts++;
+  stats.decoder.bbcache.bytes = bbarena.bytes_in_use;
+  stats.decoder.bbcache.arena_bytes = bbarena.bytes_reserved;
 
   stats.decoder.throughput.basic_blocks++;
 
@@ -2112,6 +2583,17 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
     logfile << "End of basic block: rip ", trans.bb.rip, " -> taken rip 0x", (void*)(Waddr)trans.bb.rip_taken, ", not taken rip 0x", (void*)(Waddr)trans.bb.rip_not_taken, endl;
   }
 
+  //
+  // Once over budget, evict down to 7/8 of it in one go, so the
+  // links between the remaining blocks are not broken by every
+  // new translation:
+  //
+  if unlikely (config.bbcache_budget && (bbarena.bytes_in_use > config.bbcache_budget)) {
+    evict(bbarena.bytes_in_use - (config.bbcache_budget - (config.bbcache_budget / 8)));
+    stats.decoder.bbcache.bytes = bbarena.bytes_in_use;
+    stats.decoder.bbcache.arena_bytes = bbarena.bytes_reserved;
+  }
+
   translate_timer.stop();
 
   bb->release();
@@ -2133,7 +2615,7 @@ BasicBlock* BasicBlockCache::translate(Context& ctx, const RIPVirtPhys& rvp) {
 //
 // This function does not allocate any memory.
 //
-void BasicBlockCache::translate_in_place(BasicBlock& targetbb, Context& ctx, Waddr rip) {
+void BasicBlockCache::translate_in_place(BasicBlockBuffer& targetbb, Context& ctx, Waddr rip) {
   if unlikely ((rip == config.start_log_at_rip) && (rip != MAX_RIP)) {
     config.start_log_at_iteration = 0;
     logenable = 1;
@@ -2197,6 +2679,191 @@ BasicBlock* BasicBlockCache::translate_and_clone(Context& ctx, Waddr rip) {
 
 #undef MAX_RIP
 
+//
+// Decoder benchmark: find the basic blocks laid out back to back
+// from <rip> (up to DECODE_BENCH_MAX_BYTES, or until the code is
+// no longer mapped), then translate all of them <iterations> times
+// without going through the basic block cache.
+//
+static const int DECODE_BENCH_MAX_BLOCKS = 65536;
+static const int DECODE_BENCH_MAX_BYTES = 1024*1024;
+
+void decode_benchmark(Context& ctx, Waddr rip, W64 iterations) {
+  dynarray<Waddr> blocks;
+  W64 bytes = 0;
+  W64 insns = 0;
+
+  while ((blocks.length < DECODE_BENCH_MAX_BLOCKS) && (bytes < DECODE_BENCH_MAX_BYTES)) {
+    RIPVirtPhys rvp = rip;
+    rvp.update(ctx);
+
+    byte insnbuf[MAX_BB_BYTES];
+    TraceDecoder trans(rvp);
+    if (!trans.fillbuf(ctx, insnbuf, sizeof(insnbuf))) break;
+    for (;;) { if (!trans.translate()) break; }
+
+    // Stop where the code is no longer mapped, and skip over invalid or privileged opcodes:
+    if unlikely (trans.bb.invalidblock) {
+      if ((trans.outcome == DECODE_OUTCOME_ENTRY_PAGE_FAULT) | (trans.outcome == DECODE_OUTCOME_OVERLAP_PAGE_FAULT)) break;
+      rip = max(trans.rip, rip + 1);
+      continue;
+    }
+
+    blocks.push(rip);
+    bytes += (trans.rip - rip);
+    insns += trans.bb.user_insn_count;
+    rip = trans.rip;
+  }
+
+  cerr << "Decoder benchmark: ", blocks.length, " basic blocks, ", insns, " instructions, ", bytes, " bytes", endl, flush;
+
+  if (!blocks.length) return;
+
+  CycleTimer timer;
+  timer.start();
+
+  foreach (i, iterations) {
+    foreach (j, blocks.length) {
+      RIPVirtPhys rvp = blocks[j];
+      rvp.update(ctx);
+
+      byte insnbuf[MAX_BB_BYTES];
+      TraceDecoder trans(rvp);
+      trans.fillbuf(ctx, insnbuf, sizeof(insnbuf));
+      for (;;) { if (!trans.translate()) break; }
+    }
+  }
+
+  timer.stop();
+  double seconds = timer.seconds();
+
+  stringbuf sb;
+  sb << "Decoded ", (bytes * iterations), " bytes (", (insns * iterations), " instructions) in ",
+    floatstring(seconds, 0, 3), " seconds: ", floatstring((double)(bytes * iterations) / seconds / 1e6, 0, 2), " MB/sec, ",
+    floatstring((double)(insns * iterations) / seconds / 1e6, 0, 3), " M instructions/sec, ",
+    floatstring((double)(blocks.length * iterations) / seconds / 1e3, 0, 1), " K basic blocks/sec";
+  cerr << sb, endl, flush;
+  logfile << sb, endl, flush;
+
+  //
+  // Then the same code through decode_code_buffer(), copied out of
+  // the address space, into arrays of the size a tool might use:
+  //
+  Waddr start = blocks[0];
+  W64 span = rip - start;
+  byte* code = new byte[span];
+  W64 copied = 0;
+  while (copied < span) {
+    int n = ctx.copy_from_user(code + copied, start + copied, min(span - copied, W64(4096 - lowbits(start + copied, 12))));
+    if (!n) break;
+    copied += n;
+  }
+
+  DecodedCode out(new DecodedUop[65536], 65536, new DecodedInsn[16384], 16384, new DecodedBasicBlock[4096], 4096);
+  W64 batchinsns = 0;
+  W64 batchuops = 0;
+
+  timer.reset();
+  timer.start();
+
+  foreach (i, iterations) {
+    W64 offset = 0;
+    while (offset < copied) {
+      W64 n = decode_code_buffer(out, code + offset, copied - offset, start + offset, ctx.use64);
+      if (!n) break;
+      offset += n;
+      batchinsns += out.insncount;
+      batchuops += out.uopcount;
+    }
+  }
+
+  timer.stop();
+  seconds = timer.seconds();
+
+  sb.reset();
+  sb << "Batch decoded ", (copied * iterations), " bytes (", batchinsns, " instructions, ", batchuops, " uops) in ",
+    floatstring(seconds, 0, 3), " seconds: ", floatstring((double)(copied * iterations) / seconds / 1e6, 0, 2), " MB/sec, ",
+    floatstring((double)batchinsns / seconds / 1e6, 0, 3), " M instructions/sec, ",
+    floatstring((double)batchuops / seconds / 1e6, 0, 3), " M uops/sec";
+  cerr << sb, endl, flush;
+  logfile << sb, endl, flush;
+
+  delete[] out.uops;
+  delete[] out.insns;
+  delete[] out.bbs;
+  delete[] code;
+}
+
+//
+// Decode the code in <code> as if it were at <rip>, one basic block
+// after another, until the end of the buffer or until one of the
+// output arrays is full. An invalid (or privileged) opcode becomes a
+// basic block of its own, with the outcome set, and decoding goes on
+// after it; an instruction cut off by the end of the buffer is left
+// out. Returns the number of bytes decoded, i.e. where to continue.
+//
+W64 decode_code_buffer(DecodedCode& out, const byte* code, W64 bytes, Waddr rip, bool use64, bool kernel, bool df) {
+  out.uopcount = 0;
+  out.insncount = 0;
+  out.bbcount = 0;
+
+  W64 offset = 0;
+
+  while ((offset < bytes) && (out.bbcount < out.maxbbs)) {
+    byte insnbuf[MAX_BB_BYTES];
+    TraceDecoder trans(rip + offset, use64, kernel, df);
+    trans.split_invalid_basic_blocks = 1;
+    trans.fillbuf_copy(code + offset, bytes - offset, insnbuf, sizeof(insnbuf));
+    for (;;) { if (!trans.translate()) break; }
+
+    if unlikely ((trans.outcome == DECODE_OUTCOME_ENTRY_PAGE_FAULT) | (trans.outcome == DECODE_OUTCOME_OVERLAP_PAGE_FAULT)) break;
+
+    const BasicBlockBuffer& bb = trans.bb;
+    int insncount = 0;
+    foreach (i, bb.count) insncount += bb.transops[i].som;
+
+    if unlikely (((out.uopcount + bb.count) > out.maxuops) | ((out.insncount + insncount) > out.maxinsns)) break;
+
+    int bbbytes = max(W64(trans.rip - (rip + offset)), W64(1));
+
+    DecodedBasicBlock& dbb = out.bbs[out.bbcount++];
+    dbb.rip = rip + offset;
+    dbb.rip_taken = bb.rip_taken;
+    dbb.rip_not_taken = bb.rip_not_taken;
+    dbb.insn = out.insncount;
+    dbb.uop = out.uopcount;
+    dbb.insncount = insncount;
+    dbb.uopcount = bb.count;
+    dbb.bytes = bbbytes;
+    dbb.type = bb.type;
+    dbb.outcome = trans.outcome;
+
+    Waddr insnrip = dbb.rip;
+    DecodedInsn* insn = null;
+
+    foreach (i, bb.count) {
+      const TransOp& transop = bb.transops[i];
+      if (transop.som) {
+        insn = &out.insns[out.insncount++];
+        insn->rip = insnrip;
+        insn->uop = out.uopcount;
+        insn->uopcount = 0;
+        insn->bytes = transop.bytes;
+        insnrip += transop.bytes;
+      }
+
+      DecodedUop& uop = out.uops[out.uopcount++];
+      uop.uop = transop;
+      uop_fu_info(transop.opcode, uop.fu, uop.latency);
+      insn->uopcount++;
+    }
+
+    offset += bbbytes;
+  }
+
+  return offset;
+}
+
 ostream& BasicBlockCache::print(ostream& os) {
   dynarray<BasicBlock*> bblist;
   getentries(bblist);
@@ -2234,4 +2901,5 @@ void init_decode() {
 void shutdown_decode() {
   bbcache.flush();
   if (bbcache_dump_file) bbcache_dump_file.close();
+  bbfile.close();
 }
@@ -71,7 +71,13 @@ bool TraceDecoder::decode_fast() {
       this << TransOp(OP_sub, REG_rsp, REG_rsp, REG_imm, REG_zero, (use64 ? 3 : 2), size);
     } else {
       // pop
-      this << TransOp(OP_ld, r, REG_rsp, REG_imm, REG_zero, sizeshift, 0);
+      if (sizeshift < 2) {
+        // 16-bit pops only replace the low word of the register
+        this << TransOp(OP_ld, REG_temp0, REG_rsp, REG_imm, REG_zero, sizeshift, 0);
+        this << TransOp(OP_mov, r, r, REG_temp0, REG_zero, sizeshift);
+      } else {
+        this << TransOp(OP_ld, r, REG_rsp, REG_imm, REG_zero, sizeshift, 0);
+      }
       if (r != REG_rsp) {
         // Only update %rsp if the target register is not itself %rsp
         this << TransOp(OP_add, REG_rsp, REG_rsp, REG_imm, REG_zero, (use64 ? 3 : 2), size);
@@ -742,13 +748,15 @@ bool TraceDecoder::decode_fast() {
 
   case 0x190 ... 0x19f: {
     // conditional sets
-    DECODE(eform, rd, v_mode);
+    DECODE(eform, rd, b_mode);
     EndOfDecode();
 
     int r;
+    bool rdhigh = false;
 
     if (rd.type == OPTYPE_REG) {
       r = arch_pseudo_reg_to_arch_reg[rd.reg.reg];
+      rdhigh = reginfo[rd.reg.reg].hibyte;
     } else {
       assert(rd.type == OPTYPE_MEM);
       r = REG_temp7;
@@ -757,10 +765,13 @@ bool TraceDecoder::decode_fast() {
     int condcode = bits(op, 0, 4);
     const CondCodeToFlagRegs& cctfr = cond_code_to_flag_regs[condcode];
 
-    TransOp transop(OP_set, r, cctfr.ra, cctfr.rb, (rd.type == OPTYPE_MEM) ? REG_zero : r, 0);
+    // %ah/%ch/%dh/%bh (no REX): set into a temp and merge into bits 8-15
+    TransOp transop(OP_set, (rdhigh) ? REG_temp7 : r, cctfr.ra, cctfr.rb, ((rd.type == OPTYPE_MEM) | rdhigh) ? REG_zero : r, 0);
     transop.cond = condcode;
     this << transop, endl;
 
+    if (rdhigh) this << TransOp(OP_maskb, r, r, REG_temp7, REG_imm, 3, 0, MaskControlInfo(56, 8, 56));
+
     if (rd.type == OPTYPE_MEM) {
       rd.mem.size = 0;
       prefixes &= ~PFX_LOCK;
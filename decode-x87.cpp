@@ -118,6 +118,7 @@ double x87_fpatan(double st1, double st0) {
   asm("fldl %[st1]; fldl %[st0]; fpatan; fstpl %[stout];" : [stout] "=m" (stout) : [st0] "m" (st0), [st1] "m" (st1));
   return stout;
 }
+
  
 // st(1) = st(1) * log2(st(0)) and pop st(0)
 make_two_input_x87_func_with_pop(fyl2x, st1u.d = x87_fyl2x(st1u.d, st0u.d));
@@ -154,10 +155,21 @@ void assist_x87_##name(Context& ctx) { \
   ctx.commitarf[REG_rip] = ctx.commitarf[REG_nextrip]; \
 }
 
+//
+// NOTE: fsin, fcos, fptan and fsincos deliberately use the soft math::
+// functions rather than the host FPU instructions. The host can only
+// be trusted to round like the soft path without range reduction and
+// away from double rounding boundaries, and even there fsin and
+// friends are slower than the correctly rounded soft versions; see
+// tests/x87/hostmath.cpp. f2xm1 uses the host when the guest fpcw
+// lets it round like the guest expects (math::f2xm1): exp2(x) - 1
+// loses most of its digits for small x.
+//
+
 make_unary_x87_func(fsqrt, math::sqrt(ra.d));
 make_unary_x87_func(fsin, math::sin(ra.d));
 make_unary_x87_func(fcos, math::cos(ra.d));
-make_unary_x87_func(f2xm1, math::exp2(ra.d) - 1);
+make_unary_x87_func(f2xm1, math::f2xm1(ra.d, ctx.fpcw));
 
 void assist_x87_frndint(Context& ctx) {
   W64& r = ctx.fpstack[ctx.commitarf[REG_fptos] >> 3];
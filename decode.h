@@ -150,7 +150,7 @@ enum {
 };
 
 struct TraceDecoder {
-  BasicBlock bb;
+  BasicBlockBuffer bb;
   TransOp transbuf[MAX_TRANSOPS_PER_USER_INSN];
   int transbufcount;
   byte use64;
@@ -190,6 +190,7 @@ struct TraceDecoder {
   bool split_invalid_basic_blocks;
   bool no_partial_flag_updates_per_insn;
   bool fast_length_decode_only;
+  bool vec128_uops;
   W64 stop_at_rip;
 
   TraceDecoder(const RIPVirtPhys& rvp);
@@ -213,6 +214,7 @@ struct TraceDecoder {
   bool memory_fence_if_locked(bool end_of_x86_insn = 0, int type = MF_TYPE_LFENCE|MF_TYPE_SFENCE);
 
   int fillbuf(Context& ctx, byte* insnbytes_, int insnbytes_bufsize_);
+  int fillbuf_copy(const byte* code, W64 bytes, byte* insnbytes_, int insnbytes_bufsize_);
 #ifdef PTLSIM_HYPERVISOR
   int fillbuf_phys_prechecked(byte* insnbytes_, int insnbytes_bufsize_, Level1PTE ptelo, Level1PTE ptehi);
 #endif
@@ -233,6 +235,7 @@ struct TraceDecoder {
   bool translate();
   void put(const TransOp& transop);
   bool flush();
+  void fuse_vec128_pairs();
   void split(bool after);
   void split_before() { split(0); }
   void split_after() { split(1); }
@@ -422,7 +425,7 @@ int propagate_exception_during_assist(Context& ctx, byte exception, W32 errorcod
 //
 const char* assist_name(assist_func_t func);
 int assist_index(assist_func_t func);
-void update_assist_stats(assist_func_t assist);
+void update_assist_stats(int assistid);
 
 // Forced assists based on decode context
 void assist_invalid_opcode(Context& ctx);
@@ -491,6 +494,66 @@ void assist_ioport_out(Context& ctx);
 //
 void init_decode();
 void shutdown_decode();
+void decode_benchmark(Context& ctx, Waddr rip, W64 iterations);
+
+//
+// Decoding a code buffer without a context, address space or core
+// (see decode_code_buffer()). The uops, instructions and basic blocks
+// go into flat arrays supplied by the caller; each basic block refers
+// to its first instruction and uop, and each instruction to its first
+// uop, by index into those arrays.
+//
+struct DecodedUop {
+  TransOp uop;
+  W16 fu;        // functional units it can issue on (1 << FU_xxx)
+  byte latency;  // in cycles, assuming ideal bypass
+};
+
+struct DecodedInsn {
+  W64 rip;
+  W32 uop;
+  W16 uopcount;
+  byte bytes;
+};
+
+struct DecodedBasicBlock {
+  W64 rip;
+  W64 rip_taken;
+  W64 rip_not_taken;
+  W32 insn;
+  W32 uop;
+  W16 insncount;
+  W16 uopcount;
+  byte bytes;
+  byte type;     // BB_TYPE_xxx
+  byte outcome;  // DECODE_OUTCOME_xxx
+};
+
+struct DecodedCode {
+  DecodedUop* uops;
+  DecodedInsn* insns;
+  DecodedBasicBlock* bbs;
+  int maxuops;
+  int maxinsns;
+  int maxbbs;
+
+  // Filled in by decode_code_buffer():
+  int uopcount;
+  int insncount;
+  int bbcount;
+
+  DecodedCode() { setzero(*this); }
+
+  DecodedCode(DecodedUop* uops, int maxuops, DecodedInsn* insns, int maxinsns, DecodedBasicBlock* bbs, int maxbbs) {
+    this->uops = uops; this->maxuops = maxuops;
+    this->insns = insns; this->maxinsns = maxinsns;
+    this->bbs = bbs; this->maxbbs = maxbbs;
+    uopcount = 0; insncount = 0; bbcount = 0;
+  }
+};
+
+W64 decode_code_buffer(DecodedCode& out, const byte* code, W64 bytes, Waddr rip, bool use64 = 1, bool kernel = 0, bool df = 0);
+void uop_fu_info(int opcode, W16& fu, byte& latency);
 
 static const int BB_CACHE_SIZE = 16384;
 
@@ -537,16 +600,47 @@ enum {
 };
 
 struct BasicBlockCache: public SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager> {
-  BasicBlockCache(): SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager>() { }
+  // Bumped whenever a block is freed or the code mapping may have changed:
+  // this invalidates all direct links between blocks at once.
+  W64 generation;
+  // Next block to consider for eviction:
+  BasicBlock* clock_hand;
+
+  BasicBlockCache(): SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_SIZE, BasicBlockHashtableLinkManager>() { generation = 1; clock_hand = null; }
+
+  //
+  // Direct links between basic blocks: if <bb> exits to <rip> and
+  // was linked to the block there, return that block without
+  // going through the hashtable; otherwise return null.
+  //
+  BasicBlock* successor(const BasicBlock* bb, Waddr rip) const {
+    if unlikely (bb->link_generation != generation) return null;
+    if (rip == bb->rip_taken) return bb->taken_link;
+    if (rip == bb->rip_not_taken) return bb->not_taken_link;
+    return null;
+  }
+
+  void link(BasicBlock* bb, BasicBlock* target) {
+    if unlikely (bb->link_generation != generation) {
+      bb->taken_link = null;
+      bb->not_taken_link = null;
+      bb->link_generation = generation;
+    }
+    if (target->rip.rip == bb->rip_taken) bb->taken_link = target;
+    if (target->rip.rip == bb->rip_not_taken) bb->not_taken_link = target;
+  }
+
+  void invalidate_links() { generation++; }
 
   BasicBlock* translate(Context& ctx, const RIPVirtPhys& rvp);
-  void translate_in_place(BasicBlock& targetbb, Context& ctx, Waddr rip);
+  void translate_in_place(BasicBlockBuffer& targetbb, Context& ctx, Waddr rip);
   BasicBlock* translate_and_clone(Context& ctx, Waddr rip);
   bool invalidate(const RIPVirtPhys& rvp, int reason);
   bool invalidate(BasicBlock* bb, int reason);
   bool invalidate_page(Waddr mfn, int reason);
   int get_page_bb_count(Waddr mfn);
   int reclaim(size_t reqbytes = 0, int urgency = 0);
+  W64 evict(W64 bytes, bool all = false);
   void flush();
 
   ostream& print(ostream& os);
@@ -554,8 +648,98 @@ struct BasicBlockCache: public SelfHashtable<RIPVirtPhys, BasicBlock, BB_CACHE_S
 
 extern BasicBlockCache bbcache;
 
+// Host time spent translating basic blocks
+extern CycleTimer translate_timer;
+
+//
+// Cached basic blocks are carved out of larger chunks with a bump
+// pointer. A chunk goes back to the page allocator as soon as every
+// block in it has been freed, and flush() releases all of them once
+// the whole cache is empty.
+//
+struct TranslationArena {
+  struct Chunk {
+    Chunk* prev;
+    Chunk* next;
+    byte* top;
+    byte* end;
+    int live;
+  };
+
+  static const int CHUNK_SIZE = 65536;
+
+  Chunk* chunks;
+  Chunk* current;
+  W64 bytes_in_use;
+  W64 bytes_reserved;
+
+  TranslationArena() { chunks = null; current = null; bytes_in_use = 0; bytes_reserved = 0; }
+
+  void* alloc(size_t bytes);
+  void free(void* p);
+  static size_t getsize(const void* p);
+  void flush();
+  void release(Chunk* chunk);
+};
+
+extern TranslationArena bbarena;
+
 extern odstream bbcache_dump_file;
 
+//
+// Persistent translation cache (-bbcache-file)
+//
+// The file starts with a BasicBlockFileHeader, followed by records
+// appended by any number of processes. Each record holds the rip and
+// mode bits the block was decoded with, the BasicBlockBase (with all
+// pointers cleared) immediately followed by its transops, so it can
+// be cloned in place like any other BasicBlock, then the changes the
+// decoder made to stats.decoder, and finally the instruction bytes
+// the decoder looked at. A block is only taken from the file if all
+// of these bytes still match.
+//
+static const int BUILD_ID_SIZE = 20;
+
+struct BasicBlockFileHeader {
+  W64 magic;
+  // Layout of the file itself:
+  W64 version;
+  // GNU build id of the binary that wrote the file; files written
+  // by any other build are ignored, since its decoder may differ:
+  byte buildid[BUILD_ID_SIZE];
+  // Decoder options the translations depend on:
+  W32 sse128;
+
+  static const W64 MAGIC = 0x31306362624c5450ULL; // 'PTLbbc01'
+  static const W64 VERSION = 4;
+};
+
+struct BasicBlockFileStat {
+  W32 index;
+  W32s delta;
+};
+
+struct BasicBlockFileRecord {
+  W32 magic;
+  // Total size of the record, a multiple of 8 bytes:
+  W32 size;
+  W64 rip;
+  // Instruction bytes seen by the decoder:
+  W16 codebytes;
+  // Valid bytes at translation time, capped at (codebytes + 1):
+  W16 validbytes;
+  W16 statcount;
+  W16 use64:1, kernel:1, df:1, pad:13;
+
+  static const W32 MAGIC = 0x72626250; // 'Pbbr'
+
+  const BasicBlockBuffer* bb() const { return (const BasicBlockBuffer*)(this + 1); }
+  const BasicBlockFileStat* stats() const { return (const BasicBlockFileStat*)&bb()->transops[bb()->count]; }
+  const byte* code() const { return (const byte*)(stats() + statcount); }
+};
+
+bool open_bbcache_file(const char* filename);
+
 //
 // This part is used when parsing stats.h to build the
 // data store template; these must be in sync with the
@@ -219,9 +219,9 @@ inline W32 x86_sse_pmovmskw(vec8w vec) { return x86_sse_pmovmskb(x86_sse_packssw
 inline vec16b x86_sse_psadbw(vec16b a, vec16b b) { asm("psadbw %[b],%[a]" : [a] "+x" (a) : [b] "xg" (b)); return a; }
 template <int i> inline W16 x86_sse_pextrw(vec16b a) { W32 rd; asm("pextrw %[i],%[a],%[rd]" : [rd] "=r" (rd) : [a] "x" (a), [i] "N" (i)); return rd; }
 
-inline vec16b x86_sse_ldvbu(const vec16b* m) { vec16b rd; asm("movdqu %[m],%[rd]" : [rd] "=x" (rd) : [m] "xm" (*m)); return rd; }
+inline vec16b x86_sse_ldvbu(const vec16b* m) { vec16b rd; asm("movdqu %[m],%[rd]" : [rd] "=x" (rd) : [m] "m" (*m)); return rd; }
 inline void x86_sse_stvbu(vec16b* m, const vec16b ra) { asm("movdqu %[ra],%[m]" : [m] "=m" (*m) : [ra] "x" (ra) : "memory"); }
-inline vec8w x86_sse_ldvwu(const vec8w* m) { vec8w rd; asm("movdqu %[m],%[rd]" : [rd] "=x" (rd) : [m] "xm" (*m)); return rd; }
+inline vec8w x86_sse_ldvwu(const vec8w* m) { vec8w rd; asm("movdqu %[m],%[rd]" : [rd] "=x" (rd) : [m] "m" (*m)); return rd; }
 inline void x86_sse_stvwu(vec8w* m, const vec8w ra) { asm("movdqu %[ra],%[m]" : [m] "=m" (*m) : [ra] "x" (ra) : "memory"); }
 
 inline vec16b x86_sse_zerob() { vec16b rd; asm("pxor %[rd],%[rd]" : [rd] "+x" (rd)); return rd; }
@@ -247,6 +247,86 @@ inline vec8w x86_sse_dupw(const W16 b) {
   return v;
 }
 
+//
+// Wider versions of the compare-and-mask primitives above, used for
+// associative searches on hosts that have AVX2 or AVX-512 (see
+// host_simd_level). Everything else is built for SSE2 only, so these
+// are written directly in asm. The AVX2 versions end in vzeroupper,
+// and the AVX-512 versions only use ymm16 and k1, which compiled code
+// never touches; neither slows down the SSE code around them.
+//
+// Built with -march=k8, the compiler does not know these registers
+// exist (and refuses them as clobbers). If the tree is ever built for
+// an AVX or AVX-512 target, the scratch registers are declared as
+// clobbered, and vzeroupper is left out since it would destroy live
+// ymm values and all SSE code is VEX encoded anyway.
+//
+#ifdef __AVX512F__
+#define X86_AVX512_SCRATCH "xmm16", "k1"
+#else
+#define X86_AVX512_SCRATCH "cc"
+#endif
+
+#ifdef __AVX__
+#define X86_VZEROUPPER ""
+#else
+#define X86_VZEROUPPER "\n\tvzeroupper"
+#endif
+
+enum { HOST_SIMD_SSE2, HOST_SIMD_AVX2, HOST_SIMD_AVX512, HOST_SIMD_COUNT };
+extern const char* host_simd_names[HOST_SIMD_COUNT];
+extern int host_simd_level;
+extern bool host_fast_strings;
+int detect_host_simd();
+bool detect_host_fast_strings();
+bool select_host_simd(const char* name);
+
+// Compare the 32 bytes at m with b: one mask bit per byte
+inline W32 x86_avx2_pcmpeqb_mask(const void* m, byte b) {
+  W32 mask; vec16b t;
+  asm("vmovd %k[b],%[t]\n\tvpbroadcastb %[t],%t[t]\n\tvpcmpeqb %[m],%t[t],%t[t]\n\tvpmovmskb %t[t],%[mask]" X86_VZEROUPPER
+      : [mask] "=r" (mask), [t] "=&x" (t) : [b] "r" ((W32)b), [m] "m" (*(const vec16b (*)[2])m));
+  return mask;
+}
+
+inline W32 x86_avx512_pcmpeqb_mask(const void* m, byte b) {
+  W32 mask;
+  asm("vpbroadcastb %k[b],%%ymm16\n\tvpcmpeqb %[m],%%ymm16,%%k1\n\tkmovd %%k1,%[mask]"
+      : [mask] "=r" (mask) : [b] "r" ((W32)b), [m] "m" (*(const vec16b (*)[2])m) : X86_AVX512_SCRATCH);
+  return mask;
+}
+
+// Compare the 16 words at m with w: one mask bit per word
+inline W32 x86_avx2_pcmpeqw_mask(const void* m, W16 w) {
+  W32 mask; vec8w t, u;
+  asm("vmovd %k[w],%[t]\n\tvpbroadcastw %[t],%t[t]\n\tvpcmpeqw %[m],%t[t],%t[t]\n\tvextracti128 $1,%t[t],%[u]\n\tvpacksswb %[u],%[t],%[t]\n\tvpmovmskb %[t],%[mask]" X86_VZEROUPPER
+      : [mask] "=r" (mask), [t] "=&x" (t), [u] "=&x" (u) : [w] "r" ((W32)w), [m] "m" (*(const vec8w (*)[2])m));
+  return mask;
+}
+
+inline W32 x86_avx512_pcmpeqw_mask(const void* m, W16 w) {
+  W32 mask;
+  asm("vpbroadcastw %k[w],%%ymm16\n\tvpcmpeqw %[m],%%ymm16,%%k1\n\tkmovd %%k1,%[mask]"
+      : [mask] "=r" (mask) : [w] "r" ((W32)w), [m] "m" (*(const vec8w (*)[2])m) : X86_AVX512_SCRATCH);
+  return mask;
+}
+
+// Compare the 8 quadwords at m with q: one mask bit per quadword
+inline W32 x86_avx2_pcmpeqq_mask8(const void* m, W64 q) {
+  W32 mask, hi; vec16b t, u;
+  asm("vmovq %[q],%[t]\n\tvpbroadcastq %[t],%t[t]\n\tvpcmpeqq %[m_hi],%t[t],%t[u]\n\tvpcmpeqq %[m],%t[t],%t[t]\n\tvmovmskpd %t[t],%[mask]\n\tvmovmskpd %t[u],%[hi]" X86_VZEROUPPER
+      : [mask] "=&r" (mask), [hi] "=&r" (hi), [t] "=&x" (t), [u] "=&x" (u)
+      : [q] "r" (q), [m] "m" (*(const vec16b (*)[2])m), [m_hi] "m" (*(const vec16b (*)[2])((const byte*)m + 32)));
+  return mask | (hi << 4);
+}
+
+inline W32 x86_avx512_pcmpeqq_mask8(const void* m, W64 q) {
+  W32 mask;
+  asm("vpbroadcastq %[q],%%zmm16\n\tvpcmpeqq %[m],%%zmm16,%%k1\n\tkmovb %%k1,%[mask]"
+      : [mask] "=r" (mask) : [q] "r" (q), [m] "m" (*(const vec16b (*)[4])m) : X86_AVX512_SCRATCH);
+  return mask;
+}
+
 inline void x86_set_mxcsr(W32 value) { asm volatile("ldmxcsr %[value]" : : [value] "m" (value)); }
 inline W32 x86_get_mxcsr() { W32 value; asm volatile("stmxcsr %[value]" : [value] "=m" (value)); return value; }
 union MXCSR {
@@ -15,6 +15,7 @@
 
 #ifdef __x86_64__
 #include <asm/prctl.h>
+#include <sys/time.h>
 #endif
 
 #include <ptlsim.h>
@@ -2250,11 +2251,31 @@ extern "C" void external_signal_callback(int sig, siginfo_t* si, void* contextp)
     }
     break;
   }
+  case SIGVTALRM: {
+    // Interval sampling: the native part of this interval is over
+#ifdef __x86_64__
+    void* rip = (void*)context->uc_mcontext.gregs[REG_RIP];
+#else
+    void* rip = (void*)context->uc_mcontext.gregs[REG_EIP];
+#endif
+    remove_switch_to_sim_breakpoint();
+    if (logfile) logfile << "Sampling: switching tid ", sys_gettid(), " to simulation mode at rip ", rip, endl, flush;
+    set_switch_to_sim_breakpoint(rip);
+    break;
+  }
   default:
     if (logfile) logfile << "Warning: unknown signal ", si->si_signo, "; ignoring", endl, flush; break;
   }
 }
 
+#ifdef __x86_64__
+// x86-64 signal handlers must return through an sa_restorer
+extern "C" void signal_return_restorer();
+#ifndef SA_RESTORER
+#define SA_RESTORER 0x04000000
+#endif
+#endif
+
 void init_signal_callback() {
 #ifdef __x86_64__
   // On 64-bit builds, this only works when PTLsim binary and user thread are both 64-bit:
@@ -2265,10 +2286,114 @@ void init_signal_callback() {
   setzero(sa);
   sa.k_sa_handler = external_signal_callback;
   sa.sa_flags = SA_SIGINFO;
+#ifdef __x86_64__
+  sa.sa_flags |= SA_RESTORER;
+  sa.sa_restorer = signal_return_restorer;
+#endif
   assert(sys_rt_sigaction(SIGXCPU, &sa, NULL, sizeof(W64)) == 0);
+
+  if (config.sample_native_ms) {
+    // Interrupted system calls of the user process just continue:
+    sa.sa_flags |= SA_RESTART;
+    assert(sys_rt_sigaction(SIGVTALRM, &sa, NULL, sizeof(W64)) == 0);
+  }
+}
+
+void capture_checkpoint() {
+  // Checkpoints are only supported for raspsim jobs:
+  logfile << "Warning: checkpoints are not supported in this mode", endl;
+  next_checkpoint_at_insns = infinity;
+}
+
+//
+// Interval sampling
+//
+// With -sample-native-ms, each switch to simulation runs one window:
+// -sample-warmup instructions to warm up the caches and predictors
+// of the core (which starts cold on every switch), then the CPI is
+// measured over the next -sample-window instructions. The program
+// then continues natively until it has used another -sample-native-ms
+// of CPU time (ITIMER_VIRTUAL), and so on.
+//
+// The windows are a systematic sample of the run, spaced by CPU time
+// rather than by instructions. Averaging their CPI would give phases
+// that run slowly natively, which are the high CPI phases, more
+// windows per instruction than they deserve. So the estimate for the
+// whole run is the harmonic mean: the mean IPC over all windows,
+// inverted, with the 95% confidence interval of the mean IPC (from
+// its standard deviation) inverted the same way. It is printed after
+// each window, since the program may well exit while running natively.
+//
+
+static W64 sample_warmup_ends_at = infinity;
+static W64 sample_window_start_cycle;
+static W64 sample_window_start_insns;
+
+static W64 sample_count = 0;
+static double sample_ipc_sum = 0;
+static double sample_ipc_sum_squares = 0;
+
+static void run_sample_window() {
+  W64 saved_stop_at_user_insns = config.stop_at_user_insns;
+  W64 start = total_user_insns_committed;
+
+  sample_window_start_cycle = sim_cycle;
+  sample_window_start_insns = start;
+  sample_warmup_ends_at = (config.sample_warmup_insns) ? start + config.sample_warmup_insns : infinity;
+  config.stop_at_user_insns = min(saved_stop_at_user_insns, start + config.sample_warmup_insns + config.sample_window_insns);
+
+  simulate(config.core_name);
+
+  config.stop_at_user_insns = saved_stop_at_user_insns;
+
+  // Stopped early (e.g. by a switch to native mode from the program):
+  if unlikely ((sample_warmup_ends_at != infinity) | (total_user_insns_committed == sample_window_start_insns)) {
+    sample_warmup_ends_at = infinity;
+    logfile << "Sampling: window stopped during warm-up; not counted", endl, flush;
+    return;
+  }
+
+  W64 insns = total_user_insns_committed - sample_window_start_insns;
+  W64 cycles = sim_cycle - sample_window_start_cycle;
+  double cpi = (double)cycles / (double)insns;
+  double ipc = (double)insns / (double)cycles;
+
+  sample_count++;
+  sample_ipc_sum += ipc;
+  sample_ipc_sum_squares += ipc * ipc;
+
+  double mean = sample_ipc_sum / sample_count;
+  double error = 0;
+  if (sample_count > 1) {
+    double variance = (sample_ipc_sum_squares - sample_count * mean * mean) / (sample_count - 1);
+    error = 1.96 * math::sqrt(max(variance, 0.0) / sample_count);
+  }
+
+  // The interval is not symmetric around the CPI; the upper end is unbounded if the IPC interval includes 0:
+  stringbuf sb;
+  sb << "Sample ", sample_count, ": CPI ", floatstring(cpi, 0, 3), " (", cycles, " cycles, ", insns, " instructions); ",
+    "whole run: CPI ", floatstring(1.0 / mean, 0, 3), " (", floatstring(1.0 / (mean + error), 0, 3), " to ";
+  if (error < mean) sb << floatstring(1.0 / (mean - error), 0, 3); else sb << "inf";
+  sb << ", 95% confidence)", endl;
+  logfile << sb, flush;
+  cerr << sb, flush;
+}
+
+static void arm_sample_timer() {
+  struct itimerval timer;
+  setzero(timer);
+  timer.it_value.tv_sec = config.sample_native_ms / 1000;
+  timer.it_value.tv_usec = (config.sample_native_ms % 1000) * 1000;
+  sys_setitimer(ITIMER_VIRTUAL, &timer, null);
 }
 
 bool check_for_async_sim_break() {
+  if unlikely (total_user_insns_committed >= sample_warmup_ends_at) {
+    sample_window_start_cycle = sim_cycle;
+    sample_window_start_insns = total_user_insns_committed;
+    sample_warmup_ends_at = infinity;
+  }
+
   if unlikely ((sim_cycle >= config.stop_at_cycle) |
                (iterations >= config.stop_at_iteration) |
                (total_user_insns_committed >= config.stop_at_user_insns)) {
@@ -2639,7 +2764,8 @@ void switch_to_sim() {
   //
   x86_set_mxcsr(ctx.mxcsr | MXCSR_EXCEPTION_DISABLE_MASK);
 
-  simulate(config.core_name);
+  if (config.sample_native_ms) run_sample_window();
+  else simulate(config.core_name);
   capture_stats_snapshot("final");
   flush_stats();
 
@@ -2669,8 +2795,8 @@ void switch_to_sim() {
       bb = bbcache.translate(ctx, rip);
     }
 
-    assert(bb->transops[0].som);
-    int bytes = bb->transops[0].bytes;
+    assert(bb->uops[0].som);
+    int bytes = bb->uops[0].bytes;
     Waddr ripafter = rip + (config.overshoot_and_dump ? bytes : 0);
 
     logfile << endl;
@@ -2685,6 +2811,8 @@ void switch_to_sim() {
     *((byte*)ripafter) = 0xfb; // x86 invalid opcode
   }
 
+  if (config.sample_native_ms) arm_sample_timer();
+
   logfile.flush();
   switch_to_native_restore_context();
 }
@@ -0,0 +1,444 @@
+// -*- c++ -*-
+//
+// Vectorized memset, memcpy, memmove and memcmp for the simulator
+//
+// Copyright 2005-2008 Matt T. Yourst <yourst@yourst.com>
+//
+// This program is free software; it is licensed under the
+// GNU General Public License, Version 2.
+//
+// These only depend on globals.h, so tests/klibc/memtest can link
+// them into a normal host program and check them against glibc.
+//
+
+#include <globals.h>
+
+#ifdef __x86_64__
+
+//
+// Vectorized memset, memcpy, memmove and memcmp.
+//
+// The compiler only inlines fixed size copies, so all variable sized
+// ones (page zeroing, copy_from_user and copy_to_user, checkpoint pages,
+// clearing large structures) end up here. Up to 64 bytes (128 bytes for
+// memcpy and memmove) are done with one or two (possibly overlapping)
+// moves of each size, so odd sizes never need byte loops. Larger areas
+// move their first 32 bytes unaligned, everything after that as aligned
+// blocks of 64 bytes with SSE2, or of 128 bytes with AVX2 on hosts that
+// have it (host_simd_level; memcpy and memset called before it is set
+// use SSE2), and the last 64 bytes unaligned, again with no loop over
+// what is left. From 2 KB on, rep movsb and rep stosb are faster still
+// where the host has fast string instructions (host_fast_strings),
+// aligned or not, and so are rep movsq and rep stosq on other hosts,
+// as long as source and destination are aligned alike. memcmp skips
+// over equal blocks the same way.
+//
+
+static const size_t AVX2_STRING_THRESHOLD = 256;
+static const size_t REP_STRING_THRESHOLD = 2048;
+
+static inline void x86_sse_fill_blocks(byte* p, size_t blocks, vec16b v) {
+  asm volatile("1:\n\t"
+               "movdqa %[v],(%[p])\n\tmovdqa %[v],16(%[p])\n\tmovdqa %[v],32(%[p])\n\tmovdqa %[v],48(%[p])\n\t"
+               "add $64,%[p]\n\tdec %[blocks]\n\tjnz 1b"
+               : [p] "+r" (p), [blocks] "+r" (blocks) : [v] "x" (v) : "memory");
+}
+
+static inline void x86_avx2_fill_blocks(byte* p, size_t blocks, vec16b v) {
+  asm volatile("vinserti128 $1,%[v],%t[v],%t[v]\n"
+               "1:\n\t"
+               "vmovdqa %t[v],(%[p])\n\tvmovdqa %t[v],32(%[p])\n\tvmovdqa %t[v],64(%[p])\n\tvmovdqa %t[v],96(%[p])\n\t"
+               "add $128,%[p]\n\tdec %[blocks]\n\tjnz 1b" X86_VZEROUPPER
+               : [p] "+r" (p), [blocks] "+r" (blocks), [v] "+x" (v) : : "memory");
+}
+
+static inline void x86_sse_copy_blocks(byte* d, const byte* s, size_t blocks) {
+  vec16b t0, t1, t2, t3;
+  asm volatile("1:\n\t"
+               "movdqu (%[s]),%[t0]\n\tmovdqu 16(%[s]),%[t1]\n\tmovdqu 32(%[s]),%[t2]\n\tmovdqu 48(%[s]),%[t3]\n\t"
+               "movdqa %[t0],(%[d])\n\tmovdqa %[t1],16(%[d])\n\tmovdqa %[t2],32(%[d])\n\tmovdqa %[t3],48(%[d])\n\t"
+               "add $64,%[s]\n\tadd $64,%[d]\n\tdec %[blocks]\n\tjnz 1b"
+               : [d] "+r" (d), [s] "+r" (s), [blocks] "+r" (blocks),
+                 [t0] "=&x" (t0), [t1] "=&x" (t1), [t2] "=&x" (t2), [t3] "=&x" (t3) : : "memory");
+}
+
+// The same from the top down, ending at d and s
+static inline void x86_sse_copy_blocks_down(byte* d, const byte* s, size_t blocks) {
+  vec16b t0, t1, t2, t3;
+  asm volatile("1:\n\t"
+               "sub $64,%[s]\n\tsub $64,%[d]\n\t"
+               "movdqu 48(%[s]),%[t3]\n\tmovdqu 32(%[s]),%[t2]\n\tmovdqu 16(%[s]),%[t1]\n\tmovdqu (%[s]),%[t0]\n\t"
+               "movdqa %[t3],48(%[d])\n\tmovdqa %[t2],32(%[d])\n\tmovdqa %[t1],16(%[d])\n\tmovdqa %[t0],(%[d])\n\t"
+               "dec %[blocks]\n\tjnz 1b"
+               : [d] "+r" (d), [s] "+r" (s), [blocks] "+r" (blocks),
+                 [t0] "=&x" (t0), [t1] "=&x" (t1), [t2] "=&x" (t2), [t3] "=&x" (t3) : : "memory");
+}
+
+static inline void x86_avx2_copy_blocks(byte* d, const byte* s, size_t blocks) {
+  vec16b t0, t1, t2, t3;
+  asm volatile("1:\n\t"
+               "vmovdqu (%[s]),%t[t0]\n\tvmovdqu 32(%[s]),%t[t1]\n\tvmovdqu 64(%[s]),%t[t2]\n\tvmovdqu 96(%[s]),%t[t3]\n\t"
+               "vmovdqa %t[t0],(%[d])\n\tvmovdqa %t[t1],32(%[d])\n\tvmovdqa %t[t2],64(%[d])\n\tvmovdqa %t[t3],96(%[d])\n\t"
+               "add $128,%[s]\n\tadd $128,%[d]\n\tdec %[blocks]\n\tjnz 1b" X86_VZEROUPPER
+               : [d] "+r" (d), [s] "+r" (s), [blocks] "+r" (blocks),
+                 [t0] "=&x" (t0), [t1] "=&x" (t1), [t2] "=&x" (t2), [t3] "=&x" (t3) : : "memory");
+}
+
+static inline void x86_avx2_copy_blocks_down(byte* d, const byte* s, size_t blocks) {
+  vec16b t0, t1, t2, t3;
+  asm volatile("1:\n\t"
+               "sub $128,%[s]\n\tsub $128,%[d]\n\t"
+               "vmovdqu 96(%[s]),%t[t3]\n\tvmovdqu 64(%[s]),%t[t2]\n\tvmovdqu 32(%[s]),%t[t1]\n\tvmovdqu (%[s]),%t[t0]\n\t"
+               "vmovdqa %t[t3],96(%[d])\n\tvmovdqa %t[t2],64(%[d])\n\tvmovdqa %t[t1],32(%[d])\n\tvmovdqa %t[t0],(%[d])\n\t"
+               "dec %[blocks]\n\tjnz 1b" X86_VZEROUPPER
+               : [d] "+r" (d), [s] "+r" (s), [blocks] "+r" (blocks),
+                 [t0] "=&x" (t0), [t1] "=&x" (t1), [t2] "=&x" (t2), [t3] "=&x" (t3) : : "memory");
+}
+
+//
+// Copy the bytes up from d or down to d, with d 32-byte aligned, in
+// blocks of 64 bytes, or of 128 bytes with AVX2 for large enough
+// copies, until less than 64 bytes are left. Each block is loaded
+// before it is stored, so memmove can copy overlapping areas upwards
+// when d < s and downwards otherwise.
+//
+static inline void copy_blocks_up(byte* d, const byte* s, size_t bytes, size_t n) {
+  if ((n >= AVX2_STRING_THRESHOLD) && (host_simd_level >= HOST_SIMD_AVX2) && (bytes >= 128)) {
+    x86_avx2_copy_blocks(d, s, bytes / 128);
+    size_t done = bytes & ~127;
+    d += done; s += done; bytes -= done;
+  }
+  if (bytes >= 64) x86_sse_copy_blocks(d, s, bytes / 64);
+}
+
+static inline void copy_blocks_down(byte* d, const byte* s, size_t bytes, size_t n) {
+  if ((n >= AVX2_STRING_THRESHOLD) && (host_simd_level >= HOST_SIMD_AVX2) && (bytes >= 128)) {
+    x86_avx2_copy_blocks_down(d, s, bytes / 128);
+    size_t done = bytes & ~127;
+    d -= done; s -= done; bytes -= done;
+  }
+  if (bytes >= 64) x86_sse_copy_blocks_down(d, s, bytes / 64);
+}
+
+//
+// Skip over equal blocks of 64 (SSE2) or 128 (AVX2) bytes at p and q:
+// returns the number of bytes skipped, stopping at the first block
+// that differs.
+//
+static inline size_t x86_sse_compare_blocks(const byte* p, const byte* q, size_t blocks) {
+  const byte* start = p;
+  W32 mask;
+  vec16b t0, t1, t2, t3;
+  asm("1:\n\t"
+      "movdqu (%[q]),%[t0]\n\tmovdqu 16(%[q]),%[t1]\n\tmovdqu 32(%[q]),%[t2]\n\tmovdqu 48(%[q]),%[t3]\n\t"
+      "pcmpeqb (%[p]),%[t0]\n\tpcmpeqb 16(%[p]),%[t1]\n\tpcmpeqb 32(%[p]),%[t2]\n\tpcmpeqb 48(%[p]),%[t3]\n\t"
+      "pand %[t1],%[t0]\n\tpand %[t3],%[t2]\n\tpand %[t2],%[t0]\n\t"
+      "pmovmskb %[t0],%[mask]\n\tcmp $0xffff,%[mask]\n\tjne 2f\n\t"
+      "add $64,%[p]\n\tadd $64,%[q]\n\tdec %[blocks]\n\tjnz 1b\n"
+      "2:"
+      : [p] "+r" (p), [q] "+r" (q), [blocks] "+r" (blocks), [mask] "=&r" (mask),
+        [t0] "=&x" (t0), [t1] "=&x" (t1), [t2] "=&x" (t2), [t3] "=&x" (t3)
+      : : "memory");
+  return p - start;
+}
+
+static inline size_t x86_avx2_compare_blocks(const byte* p, const byte* q, size_t blocks) {
+  const byte* start = p;
+  W32 mask;
+  vec16b t0, t1, t2, t3;
+  asm("1:\n\t"
+      "vmovdqu (%[q]),%t[t0]\n\tvmovdqu 32(%[q]),%t[t1]\n\tvmovdqu 64(%[q]),%t[t2]\n\tvmovdqu 96(%[q]),%t[t3]\n\t"
+      "vpcmpeqb (%[p]),%t[t0],%t[t0]\n\tvpcmpeqb 32(%[p]),%t[t1],%t[t1]\n\t"
+      "vpcmpeqb 64(%[p]),%t[t2],%t[t2]\n\tvpcmpeqb 96(%[p]),%t[t3],%t[t3]\n\t"
+      "vpand %t[t1],%t[t0],%t[t0]\n\tvpand %t[t3],%t[t2],%t[t2]\n\tvpand %t[t2],%t[t0],%t[t0]\n\t"
+      "vpmovmskb %t[t0],%[mask]\n\tinc %[mask]\n\tjnz 2f\n\t"
+      "add $128,%[p]\n\tadd $128,%[q]\n\tdec %[blocks]\n\tjnz 1b\n"
+      "2:" X86_VZEROUPPER
+      : [p] "+r" (p), [q] "+r" (q), [blocks] "+r" (blocks), [mask] "=&r" (mask),
+        [t0] "=&x" (t0), [t1] "=&x" (t1), [t2] "=&x" (t2), [t3] "=&x" (t3)
+      : : "memory");
+  return p - start;
+}
+
+extern "C" void* memset(void* s, int c, size_t count) {
+  byte* p = (byte*)s;
+
+  if likely (count <= 16) {
+    W64 pat = ((W64)(byte)c) * 0x0101010101010101ULL; // distribute to all bytes
+    if (count >= 8) {
+      *(W64*)p = pat; *(W64*)(p + count - 8) = pat;
+    } else if (count >= 4) {
+      *(W32*)p = pat; *(W32*)(p + count - 4) = pat;
+    } else if (count) {
+      p[0] = pat; p[count >> 1] = pat; p[count - 1] = pat;
+    }
+    return s;
+  }
+
+  if (count >= REP_STRING_THRESHOLD) {
+    if (host_fast_strings) {
+      asm volatile("rep stosb" : "+D" (p), "+c" (count) : "a" (c) : "memory");
+    } else {
+      // Whole words from an 8-byte aligned start, and the ends unaligned
+      W64 pat = ((W64)(byte)c) * 0x0101010101010101ULL;
+      *(W64*)p = pat;
+      *(W64*)(p + count - 8) = pat;
+      byte* q = floorptr(p + 8, 8);
+      size_t words = ((p + count) - q) >> 3;
+      asm volatile("rep stosq" : "+D" (q), "+c" (words) : "a" (pat) : "memory");
+    }
+    return s;
+  }
+
+  vec16b v = x86_sse_dupb(c);
+  x86_sse_stvbu((vec16b*)p, v);
+  x86_sse_stvbu((vec16b*)(p + count - 16), v);
+  if (count <= 32) return s;
+  x86_sse_stvbu((vec16b*)(p + 16), v);
+  x86_sse_stvbu((vec16b*)(p + count - 32), v);
+  if (count <= 64) return s;
+
+  // Aligned blocks after the first 32 bytes, then the last 64 unaligned:
+  byte* q = floorptr(p + 32, 32);
+  size_t bytes = (p + count) - q;
+
+  if ((count >= AVX2_STRING_THRESHOLD) && (host_simd_level >= HOST_SIMD_AVX2)) {
+    x86_avx2_fill_blocks(q, bytes / 128, v);
+    q += bytes & ~127;
+    bytes &= 127;
+  }
+  if (bytes >= 64) x86_sse_fill_blocks(q, bytes / 64, v);
+
+  x86_sse_stvbu((vec16b*)(p + count - 64), v);
+  x86_sse_stvbu((vec16b*)(p + count - 48), v);
+
+  return s;
+}
+
+//
+// Copy up to 64 bytes, loading everything before storing anything
+// (so memmove can use this for overlapping areas as well)
+//
+static inline void copy_upto_64_bytes(byte* d, const byte* s, size_t n) {
+  if (n <= 16) {
+    if (n >= 8) {
+      W64 a = *(W64*)s; W64 b = *(W64*)(s + n - 8);
+      *(W64*)d = a; *(W64*)(d + n - 8) = b;
+    } else if (n >= 4) {
+      W32 a = *(W32*)s; W32 b = *(W32*)(s + n - 4);
+      *(W32*)d = a; *(W32*)(d + n - 4) = b;
+    } else if (n) {
+      byte a = s[0]; byte b = s[n >> 1]; byte c = s[n - 1];
+      d[0] = a; d[n >> 1] = b; d[n - 1] = c;
+    }
+  } else if (n <= 32) {
+    vec16b a = x86_sse_ldvbu((vec16b*)s);
+    vec16b b = x86_sse_ldvbu((vec16b*)(s + n - 16));
+    x86_sse_stvbu((vec16b*)d, a);
+    x86_sse_stvbu((vec16b*)(d + n - 16), b);
+  } else {
+    vec16b a = x86_sse_ldvbu((vec16b*)s);
+    vec16b b = x86_sse_ldvbu((vec16b*)(s + 16));
+    vec16b c = x86_sse_ldvbu((vec16b*)(s + n - 32));
+    vec16b e = x86_sse_ldvbu((vec16b*)(s + n - 16));
+    x86_sse_stvbu((vec16b*)d, a);
+    x86_sse_stvbu((vec16b*)(d + 16), b);
+    x86_sse_stvbu((vec16b*)(d + n - 32), c);
+    x86_sse_stvbu((vec16b*)(d + n - 16), e);
+  }
+}
+
+// The same for 64 to 128 bytes: the first and last 64
+static inline void copy_upto_128_bytes(byte* d, const byte* s, size_t n) {
+  vec16b a = x86_sse_ldvbu((vec16b*)s);
+  vec16b b = x86_sse_ldvbu((vec16b*)(s + 16));
+  vec16b c = x86_sse_ldvbu((vec16b*)(s + 32));
+  vec16b e = x86_sse_ldvbu((vec16b*)(s + 48));
+  vec16b f = x86_sse_ldvbu((vec16b*)(s + n - 64));
+  vec16b g = x86_sse_ldvbu((vec16b*)(s + n - 48));
+  vec16b h = x86_sse_ldvbu((vec16b*)(s + n - 32));
+  vec16b i = x86_sse_ldvbu((vec16b*)(s + n - 16));
+  x86_sse_stvbu((vec16b*)d, a);
+  x86_sse_stvbu((vec16b*)(d + 16), b);
+  x86_sse_stvbu((vec16b*)(d + 32), c);
+  x86_sse_stvbu((vec16b*)(d + 48), e);
+  x86_sse_stvbu((vec16b*)(d + n - 64), f);
+  x86_sse_stvbu((vec16b*)(d + n - 48), g);
+  x86_sse_stvbu((vec16b*)(d + n - 32), h);
+  x86_sse_stvbu((vec16b*)(d + n - 16), i);
+}
+
+extern "C" void* memcpy(void* to, const void* from, size_t n) {
+  byte* d = (byte*)to;
+  const byte* s = (const byte*)from;
+
+  if likely (n <= 64) {
+    copy_upto_64_bytes(d, s, n);
+    return to;
+  }
+
+  if (n <= 128) {
+    copy_upto_128_bytes(d, s, n);
+    return to;
+  }
+
+  //
+  // From 2 KB on, rep movsb is fastest with fast strings, and rep movsq
+  // without them, but only if source and destination are aligned alike:
+  // otherwise it is several times slower than the vector loops below.
+  //
+  if ((n >= REP_STRING_THRESHOLD) && (host_fast_strings || !(((Waddr)d - (Waddr)s) & 7))) {
+    if (host_fast_strings) {
+      asm volatile("rep movsb" : "+D" (d), "+S" (s), "+c" (n) : : "memory");
+    } else {
+      // Whole words from an 8-byte aligned start, and the ends unaligned
+      W64 head = *(W64*)s;
+      W64 tail = *(W64*)(s + n - 8);
+      *(W64*)d = head;
+      *(W64*)(d + n - 8) = tail;
+      byte* q = floorptr(d + 8, 8);
+      s += (q - d);
+      size_t words = ((d + n) - q) >> 3;
+      asm volatile("rep movsq" : "+D" (q), "+S" (s), "+c" (words) : : "memory");
+    }
+    return to;
+  }
+
+  // The first 32 bytes unaligned, aligned blocks, then the last 64:
+  copy_upto_64_bytes(d, s, 32);
+  byte* q = floorptr(d + 32, 32);
+  copy_blocks_up(q, s + (q - d), (d + n) - q, n);
+  copy_upto_64_bytes(d + n - 64, s + n - 64, 64);
+
+  return to;
+}
+
+extern "C" void* memmove(void* to, const void* from, size_t n) {
+  byte* d = (byte*)to;
+  const byte* s = (const byte*)from;
+
+  if likely (n <= 64) {
+    copy_upto_64_bytes(d, s, n);
+    return to;
+  }
+
+  if (n <= 128) {
+    copy_upto_128_bytes(d, s, n);
+    return to;
+  }
+
+  // Disjoint areas:
+  if ((((Waddr)d - (Waddr)s) >= n) && (((Waddr)s - (Waddr)d) >= n)) return memcpy(to, from, n);
+
+  //
+  // Overlapping areas: 64-byte blocks to 32-byte aligned destinations,
+  // each block loaded before it is stored, in the direction in which no
+  // store overwrites source bytes not yet loaded. The unaligned ends go
+  // last, but are loaded first, since the blocks may overwrite them.
+  //
+  vec16b head0 = x86_sse_ldvbu((vec16b*)s);
+  vec16b head1 = x86_sse_ldvbu((vec16b*)(s + 16));
+  vec16b head2 = x86_sse_ldvbu((vec16b*)(s + 32));
+  vec16b head3 = x86_sse_ldvbu((vec16b*)(s + 48));
+  vec16b tail0 = x86_sse_ldvbu((vec16b*)(s + n - 64));
+  vec16b tail1 = x86_sse_ldvbu((vec16b*)(s + n - 48));
+  vec16b tail2 = x86_sse_ldvbu((vec16b*)(s + n - 32));
+  vec16b tail3 = x86_sse_ldvbu((vec16b*)(s + n - 16));
+
+  if (d < s) {
+    byte* q = floorptr(d + 32, 32);
+    copy_blocks_up(q, s + (q - d), (d + n) - q, n);
+  } else {
+    byte* q = ceilptr(d + n - 32, 32);
+    copy_blocks_down(q, s + (q - d), q - d, n);
+  }
+
+  x86_sse_stvbu((vec16b*)d, head0);
+  x86_sse_stvbu((vec16b*)(d + 16), head1);
+  x86_sse_stvbu((vec16b*)(d + 32), head2);
+  x86_sse_stvbu((vec16b*)(d + 48), head3);
+  x86_sse_stvbu((vec16b*)(d + n - 64), tail0);
+  x86_sse_stvbu((vec16b*)(d + n - 48), tail1);
+  x86_sse_stvbu((vec16b*)(d + n - 32), tail2);
+  x86_sse_stvbu((vec16b*)(d + n - 16), tail3);
+
+  return to;
+}
+
+// Difference of the first unequal bytes in the 16 at p and q, if any
+static inline int compare_16_bytes(const byte* p, const byte* q) {
+  W32 eq = x86_sse_pmovmskb(x86_sse_pcmpeqb(x86_sse_ldvbu((vec16b*)p), x86_sse_ldvbu((vec16b*)q)));
+  if likely (eq == 0xffff) return 0;
+  int i = lsbindex32(~eq);
+  return (int)p[i] - (int)q[i];
+}
+
+// The same for a block of 64 bytes known to differ
+static inline int compare_64_bytes(const byte* p, const byte* q) {
+  foreach (i, 3) {
+    int diff = compare_16_bytes(p + i*16, q + i*16);
+    if (diff) return diff;
+  }
+  return compare_16_bytes(p + 48, q + 48);
+}
+
+extern "C" int memcmp(const void* a, const void* b, size_t n) {
+  const byte* p = (const byte*)a;
+  const byte* q = (const byte*)b;
+
+  if likely (n < 16) {
+    // Two overlapping words, and the first differing byte in them
+    W64 x = 0;
+    if (n >= 8) {
+      x = *(W64*)p ^ *(W64*)q;
+      if (!x) { p += n - 8; q += n - 8; x = *(W64*)p ^ *(W64*)q; }
+    } else if (n >= 4) {
+      x = *(W32*)p ^ *(W32*)q;
+      if (!x) { p += n - 4; q += n - 4; x = *(W32*)p ^ *(W32*)q; }
+    } else {
+      foreach (i, n) {
+        if (p[i] != q[i]) return (int)p[i] - (int)q[i];
+      }
+    }
+    if (!x) return 0;
+    int i = lsbindex64(x) >> 3;
+    return (int)p[i] - (int)q[i];
+  }
+
+  if (n <= 64) {
+    // 16 bytes at a time, then the last 16, overlapping the ones before
+    for (size_t i = 16; i < n; i += 16) {
+      int diff = compare_16_bytes(p, q);
+      if (diff) return diff;
+      p += 16; q += 16;
+    }
+    return compare_16_bytes((const byte*)a + n - 16, (const byte*)b + n - 16);
+  }
+
+  // Whole pages are compared when writing checkpoints, so skip over
+  // equal blocks quickly, with p 32-byte aligned, then compare the last
+  // 64 bytes as one more block:
+  const byte* plast = p + n - 64;
+  const byte* qlast = q + n - 64;
+
+  int diff = compare_16_bytes(p, q);
+  if (!diff) diff = compare_16_bytes(p + 16, q + 16);
+  if (diff) return diff;
+  size_t skip = 32 - ((Waddr)p & 31);
+  p += skip; q += skip; n -= skip;
+
+  if ((n >= AVX2_STRING_THRESHOLD) && (host_simd_level >= HOST_SIMD_AVX2)) {
+    size_t done = x86_avx2_compare_blocks(p, q, n / 128);
+    p += done; q += done; n -= done;
+  }
+
+  if (n >= 64) {
+    size_t done = x86_sse_compare_blocks(p, q, n / 64);
+    p += done; q += done; n -= done;
+    if (n >= 64) return compare_64_bytes(p, q);
+  }
+
+  return compare_64_bytes(plast, qlast);
+}
+
+#endif // __x86_64__
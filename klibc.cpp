@@ -11,9 +11,12 @@
 
 #include <globals.h>
 #include <superstl.h>
+#include <mm.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <syscalls.h>
+#include <sched.h>
+#include <linux/futex.h>
 
 //++MTY Needed for gcc 4.3+:
 #undef __USE_EXTERN_INLINES
@@ -23,64 +26,11 @@
 //
 #ifdef __x86_64__
 
-/* Only used for special circumstances. Stolen from i386/string.h */ 
-static inline void * __inline_memcpy(void * to, const void * from, size_t n)
-{
-unsigned long d0, d1, d2;
-__asm__ __volatile__(
-	"rep ; movsl\n\t"
-	"testb $2,%b4\n\t"
-	"je 1f\n\t"
-	"movsw\n"
-	"1:\ttestb $1,%b4\n\t"
-	"je 2f\n\t"
-	"movsb\n"
-	"2:"
-	: "=&c" (d0), "=&D" (d1), "=&S" (d2)
-	:"0" (n/4), "q" (n),"1" ((long) to),"2" ((long) from)
-	: "memory");
-return (to);
-}
-
-/* Even with __builtin_ the compiler may decide to use the out of line
-   function. */
-
-#define __HAVE_ARCH_MEMCPY 1
-extern "C" void *__memcpy(void *to, const void *from, size_t len); 
-#define memcpy(dst,src,len) \
-	({ size_t __len = (len);				\
-	   void *__ret;						\
-	   if (__builtin_constant_p(len) && __len >= 64)	\
-		 __ret = __memcpy((dst),(src),__len);		\
-	   else							\
-		 __ret = __builtin_memcpy((dst),(src),__len);	\
-	   __ret; }) 
-
+// memset, memcpy, memmove and memcmp are in klibc-mem.cpp
 #define __HAVE_ARCH_MEMSET
-extern "C" void* memset(void* s, int c, size_t count) {
-  W64 pat = ((W64)(byte)c) * 0x0101010101010101ULL; // distribute to all bytes
-
-  byte* p = (byte*)s;
-
-  while (count >= 8) {
-    *((W64*)p) = pat;
-    p += 8;
-    count -= 8;
-  }
-
-  while (count) {
-    *p++ = pat;
-    count--;
-  }
-
-	return s;
-}
-
-// #define __HAVE_ARCH_MEMMOVE
-void* memmove(void * dest,const void *src,size_t count);
-
-/* Use C out of line version for memcmp */ 
-#define memcmp __builtin_memcmp
+#define __HAVE_ARCH_MEMCPY
+#define __HAVE_ARCH_MEMMOVE
+#define __HAVE_ARCH_MEMCMP
 
 /* out of line string functions use always C versions */ 
 #define strlen __builtin_strlen
@@ -1415,7 +1365,8 @@ int format_float(char* buf, int bufsize, double v, int precision, int pad) {
   buf[n] = '.';
   total++;
   remaining--;
-  n = format_integer(buf + n + 1, max(min(remaining, precision+1), 0), fracint, 0, 0);
+  // Keep the leading zeros of the fraction (all logM digits, truncated to precision)
+  n = format_integer(buf + n + 1, max(min(remaining, precision+1), 0), fracint, 0, 0, 10, (fracint) ? logM : 0);
   total += n;
   buf[total] = 0;
   return total;
@@ -2047,6 +1998,164 @@ char* getenv(const char* name) {
   return null;
 }
 
+//
+// Threads
+//
+
+PTLThread ptl_main_thread = { null, null, null, 0, -1 };
+Waddr ptl_thread_stacks = 0;
+Waddr ptl_thread_stacks_bytes = 0;
+bool ptl_multithreaded = 0;
+
+static Mutex ptl_thread_lock;
+static W64 ptl_thread_slots_used = 0;
+
+static int ptl_thread_key_count = 0;
+static ptl_thread_key_destructor_t ptl_thread_key_destructors[PTL_THREAD_KEYS];
+
+void ptl_futex_wait(int& word, int expected) {
+  sys_futex(&word, FUTEX_WAIT|FUTEX_PRIVATE_FLAG, expected, null, null, 0);
+}
+
+void ptl_futex_wake(int& word, int count) {
+  sys_futex(&word, FUTEX_WAKE|FUTEX_PRIVATE_FLAG, count, null, null, 0);
+}
+
+int ptl_thread_key_create(ptl_thread_key_destructor_t destructor) {
+  int key = xadd(ptl_thread_key_count, 1);
+  assert(key < PTL_THREAD_KEYS);
+  ptl_thread_key_destructors[key] = destructor;
+  return key;
+}
+
+//
+// Reserve the stack area on first use: every slot is one
+// aligned PTL_THREAD_STACK_SIZE block with an inaccessible
+// guard page at the bottom. Pages only get committed as the
+// stacks grow into them.
+//
+static bool ptl_thread_reserve_stacks() {
+  Waddr bytes = (Waddr)PTL_THREAD_MAX * PTL_THREAD_STACK_SIZE;
+  byte* p = (byte*)sys_mmap(null, bytes + PTL_THREAD_STACK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if unlikely (mmap_invalid(p)) return false;
+
+  byte* base = (byte*)ceil((Waddr)p, PTL_THREAD_STACK_SIZE);
+  if (base != p) sys_munmap(p, base - p);
+  sys_munmap(base + bytes, (p + PTL_THREAD_STACK_SIZE) - base);
+
+  foreach (i, PTL_THREAD_MAX) {
+    sys_mprotect(base + (Waddr)i * PTL_THREAD_STACK_SIZE, PAGE_SIZE, PROT_NONE);
+  }
+
+  ptl_thread_stacks = (Waddr)base;
+  barrier();
+  ptl_thread_stacks_bytes = bytes;
+  return true;
+}
+
+asmlinkage void ptl_thread_start(PTLThread* thread) __attribute__((noreturn));
+
+asmlinkage void ptl_thread_start(PTLThread* thread) {
+  ptl_thread_exit(thread->func(thread->arg));
+}
+
+PTLThread* ptl_thread_create(ptl_thread_func_t func, void* arg) {
+#ifdef __x86_64__
+  ptl_thread_lock.acquire();
+
+  if unlikely ((!ptl_thread_stacks_bytes && !ptl_thread_reserve_stacks()) || (ptl_thread_slots_used == W64(-1))) {
+    ptl_thread_lock.release();
+    return null;
+  }
+
+  int slot = lsbindex64(~ptl_thread_slots_used);
+  setbit(ptl_thread_slots_used, slot);
+  ptl_thread_lock.release();
+
+  byte* top = (byte*)(ptl_thread_stacks + (Waddr)(slot + 1) * PTL_THREAD_STACK_SIZE);
+  PTLThread* thread = (PTLThread*)(top - sizeof(PTLThread));
+  memset(thread, 0, sizeof(PTLThread));
+  thread->func = func;
+  thread->arg = arg;
+  thread->slot = slot;
+
+  // The new thread starts with the PTLThread pointer on top of its stack
+  void** sp = (void**)floorptr((byte*)thread - 16, 16);
+  *sp = thread;
+
+  ptl_multithreaded = 1;
+
+  W64 flags = CLONE_VM|CLONE_FS|CLONE_FILES|CLONE_SIGHAND|CLONE_THREAD|CLONE_SYSVSEM|CLONE_PARENT_SETTID|CLONE_CHILD_CLEARTID;
+  register int* ctid asm("r10") = &thread->tid;
+  register W64 tls asm("r8") = 0;
+  long rc;
+
+  asm volatile("syscall\n"
+               "test %%rax,%%rax\n"
+               "jnz 1f\n"
+               "xor %%ebp,%%ebp\n"
+               "mov (%%rsp),%%rdi\n"
+               "call ptl_thread_start\n"
+               "1:\n"
+               : "=a" (rc)
+               : "0" (__NR_clone), "D" (flags), "S" (sp), "d" (&thread->tid), "r" (ctid), "r" (tls)
+               : "rcx", "r11", "memory");
+
+  if unlikely (rc < 0) {
+    ptl_thread_lock.acquire();
+    clearbit(ptl_thread_slots_used, slot);
+    ptl_thread_lock.release();
+    return null;
+  }
+
+  return thread;
+#else
+  return null;
+#endif
+}
+
+void ptl_thread_exit(void* rc) {
+  PTLThread* thread = ptl_thread_self();
+  assert(thread != &ptl_main_thread);
+
+  foreach (i, ptl_thread_key_count) {
+    void* value = thread->keys[i];
+    if (value && ptl_thread_key_destructors[i]) {
+      thread->keys[i] = null;
+      ptl_thread_key_destructors[i](value);
+    }
+  }
+
+  thread->rc = rc;
+  barrier();
+  sys_exit(0);
+  for (;;) { }
+}
+
+void* ptl_thread_join(PTLThread* thread) {
+  //
+  // The kernel clears the tid and wakes us once the thread is gone
+  // (CLONE_CHILD_CLEARTID). That wakeup is not a private futex one.
+  //
+  for (;;) {
+    int tid = *(volatile int*)&thread->tid;
+    if (!tid) break;
+    sys_futex(&thread->tid, FUTEX_WAIT, tid, null, null, 0);
+  }
+
+  void* rc = thread->rc;
+  int slot = thread->slot;
+
+  byte* base = (byte*)(ptl_thread_stacks + (Waddr)slot * PTL_THREAD_STACK_SIZE);
+  sys_madvise(base + PAGE_SIZE, PTL_THREAD_STACK_SIZE - PAGE_SIZE, MADV_DONTNEED);
+
+  ptl_thread_lock.acquire();
+  clearbit(ptl_thread_slots_used, slot);
+  ptl_thread_lock.release();
+
+  return rc;
+}
+
 //
 // From http://ecos.sourceware.org/ml/ecos-discuss/2005-02/msg00056.html
 //
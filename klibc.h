@@ -55,4 +55,159 @@ int format_float(char* buf, int bufsize, double v, int precision = 6, int pad =
 
 void call_global_constuctors();
 
+//
+// Threads
+//
+// Threads are created with clone() on stacks carved out of one
+// reserved area, each PTL_THREAD_STACK_SIZE aligned, with the
+// thread's control block at the top of its stack. A thread thus
+// finds itself from %rsp alone, without %fs or %gs, which still
+// belong to the guest in PTLsim's native mode. Code running on
+// any other stack (the initial thread) gets ptl_main_thread.
+//
+
+static const int PTL_THREAD_MAX = 64;
+static const int PTL_THREAD_STACK_SIZE = 1024*1024;
+static const int PTL_THREAD_KEYS = 16;
+
+typedef void* (*ptl_thread_func_t)(void* arg);
+typedef void (*ptl_thread_key_destructor_t)(void* value);
+
+struct PTLThread {
+  ptl_thread_func_t func;
+  void* arg;
+  void* rc;
+  int tid;   // cleared (and futex woken) by the kernel on exit
+  int slot;  // stack slot, or -1 for the initial thread
+  void* keys[PTL_THREAD_KEYS];
+};
+
+extern PTLThread ptl_main_thread;
+extern Waddr ptl_thread_stacks;
+extern Waddr ptl_thread_stacks_bytes;
+
+// Set before the first thread is created and never cleared
+extern bool ptl_multithreaded;
+
+static inline PTLThread* ptl_thread_self() {
+  Waddr sp;
+#ifdef __x86_64__
+  asm("mov %%rsp,%[sp]" : [sp] "=r" (sp));
+#else
+  asm("mov %%esp,%[sp]" : [sp] "=r" (sp));
+#endif
+  if likely ((sp - ptl_thread_stacks) >= ptl_thread_stacks_bytes) return &ptl_main_thread;
+  return (PTLThread*)((sp & ~Waddr(PTL_THREAD_STACK_SIZE-1)) + PTL_THREAD_STACK_SIZE - sizeof(PTLThread));
+}
+
+PTLThread* ptl_thread_create(ptl_thread_func_t func, void* arg);
+void* ptl_thread_join(PTLThread* thread);
+void ptl_thread_exit(void* rc) __attribute__((noreturn));
+
+//
+// Thread local storage: each key is one pointer sized slot
+// in every thread; the destructor (if any) is called with
+// the thread's value when it exits with a non-null value.
+//
+int ptl_thread_key_create(ptl_thread_key_destructor_t destructor = null);
+static inline void* ptl_thread_get(int key) { return ptl_thread_self()->keys[key]; }
+static inline void ptl_thread_set(int key, void* value) { ptl_thread_self()->keys[key] = value; }
+
+void ptl_futex_wait(int& word, int expected);
+void ptl_futex_wake(int& word, int count);
+
+//
+// Futex based mutex: 0 = unlocked, 1 = locked,
+// 2 = locked with (possible) waiters. Uncontended
+// acquire and release are one locked instruction
+// each and never enter the kernel.
+//
+struct Mutex {
+  int state;
+
+  Mutex() { reset(); }
+
+  void reset() { state = 0; }
+
+  void acquire() {
+    int c = cmpxchg(state, 1, 0);
+    if likely (!c) return;
+    if (c != 2) c = xchg(state, 2);
+    while (c) {
+      ptl_futex_wait(state, 2);
+      c = xchg(state, 2);
+    }
+  }
+
+  bool try_acquire() {
+    return (cmpxchg(state, 1, 0) == 0);
+  }
+
+  void release() {
+    if likely (xadd(state, -1) == 1) return;
+    state = 0;
+    ptl_futex_wake(state, 1);
+  }
+};
+
+struct ConditionVariable {
+  int seq;
+
+  ConditionVariable() { reset(); }
+
+  void reset() { seq = 0; }
+
+  // Must be called with m held; may return spuriously
+  void wait(Mutex& m) {
+    int s = seq;
+    m.release();
+    ptl_futex_wait(seq, s);
+    m.acquire();
+  }
+
+  void signal() {
+    xadd(seq, 1);
+    ptl_futex_wake(seq, 1);
+  }
+
+  void broadcast() {
+    xadd(seq, 1);
+    ptl_futex_wake(seq, 0x7fffffff);
+  }
+};
+
+struct Barrier {
+  Mutex lock;
+  ConditionVariable released;
+  int count;
+  int waiting;
+  int generation;
+
+  Barrier(int count = 1) { reset(count); }
+
+  void reset(int count) {
+    lock.reset();
+    released.reset();
+    this->count = count;
+    waiting = 0;
+    generation = 0;
+  }
+
+  // Returns true in exactly one of the threads of each round
+  bool wait() {
+    lock.acquire();
+    int gen = generation;
+    if (++waiting == count) {
+      waiting = 0;
+      generation++;
+      released.broadcast();
+      lock.release();
+      return true;
+    }
+    while (generation == gen) released.wait(lock);
+    lock.release();
+    return false;
+  }
+};
+
 #endif // _BASELIBC_H
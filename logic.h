@@ -529,6 +529,25 @@ struct FullyAssociativeTagsNbitOneHot {
   }
 
   int match(const vec16b* targetslices) const {
+    //
+    // With AVX-512, compare pairs of chunks into a bitmap instead;
+    // tags are unique, so its lowest bit is the match. (With AVX2,
+    // the vzeroupper after each slice makes this about twice as
+    // slow as SSE2: see tests/simd/tagsearch.)
+    //
+    if (((chunkcount % 2) == 0) && (chunkcount <= 4) && (host_simd_level >= HOST_SIMD_AVX512)) {
+      W64 m = 0;
+      for (int i = 0; i < chunkcount; i += 2) {
+        W32 eq = 0xffffffff;
+        foreach (j, slices) {
+          byte b = *((const byte*)&targetslices[j]);
+          eq &= x86_avx512_pcmpeqb_mask(&tags[j][i], b);
+        }
+        m |= ((W64)eq) << (i*16);
+      }
+      return (m) ? lsbindex64(m) : -1;
+    }
+
     vec16b sum = x86_sse_zerob();
 
     foreach (i, chunkcount) {
@@ -823,10 +842,21 @@ ostream& operator <<(ostream& os, const FullyAssociativeArray<T, V, ways>& assoc
   return assoc.print(os);
 }
 
+//
+// Set associative array, laid out as a structure of arrays: the
+// tags of each set are contiguous (and cache line aligned), so a
+// probe compares all of them with a few vector instructions on
+// hosts with AVX2 or AVX-512 (see host_simd_level). The MRU bits
+// and the data of all sets are kept apart from the tags. The
+// replacement policy is the same as in FullyAssociativeTags.
+//
 template <typename T, typename V, int setcount, int waycount, int linesize, typename stats = NullAssociativeArrayStatisticsCollector<T, V> >
 struct AssociativeArray {
-  typedef FullyAssociativeArray<T, V, waycount, stats> Set;
-  Set sets[setcount];
+  T tags[setcount][waycount] alignto(64);
+  bitvec<waycount> evictmap[setcount];
+  V data[setcount][waycount];
+
+  static const T INVALID = InvalidTag<T>::INVALID;
 
   AssociativeArray() {
     reset();
@@ -834,7 +864,11 @@ struct AssociativeArray {
 
   void reset() {
     foreach (set, setcount) {
-      sets[set].reset();
+      evictmap[set] = 0;
+      foreach (way, waycount) {
+        tags[set][way] = INVALID;
+        data[set][way].reset();
+      }
     }
   }
 
@@ -846,28 +880,106 @@ struct AssociativeArray {
     return floor(addr, linesize);
   }
 
+  //
+  // Every tag in a set is unique (except INVALID), so the
+  // lowest matching way is the only one:
+  //
+  int match(int set, T target) const {
+    const T* settags = tags[set];
+
+    if ((sizeof(T) == 8) && ((waycount % 8) == 0) && (host_simd_level >= HOST_SIMD_AVX2)) {
+      for (int i = 0; i < waycount; i += 8) {
+        W32 m = (host_simd_level >= HOST_SIMD_AVX512) ? x86_avx512_pcmpeqq_mask8(&settags[i], target) : x86_avx2_pcmpeqq_mask8(&settags[i], target);
+        if (m) return i + lsbindex32(m);
+      }
+      return -1;
+    }
+
+    int way = 0;
+    foreach (i, waycount) {
+      way += (settags[i] == target) ? (i + 1) : 0;
+    }
+
+    return way - 1;
+  }
+
+  void use(int set, int way) {
+    evictmap[set][way] = 1;
+  }
+
+  int lru(int set) const {
+    return (evictmap[set].allset()) ? 0 : (~evictmap[set]).lsb();
+  }
+
   V* probe(T addr) {
-    return sets[setof(addr)].probe(tagof(addr));
+    int set = setof(addr);
+    T tag = tagof(addr);
+    int way = match(set, tag);
+    if (way >= 0) use(set, way);
+    stats::probed((way < 0) ? data[set][0] : data[set][way], tag, way, (way >= 0));
+    return (way < 0) ? null : &data[set][way];
   }
 
   V* select(T addr, T& oldaddr) {
-    return sets[setof(addr)].select(tagof(addr), oldaddr);
+    int set = setof(addr);
+    T tag = tagof(addr);
+
+    int way = match(set, tag);
+    if (way < 0) {
+      way = lru(set);
+      if (evictmap[set].allset()) evictmap[set] = 0;
+      oldaddr = tags[set][way];
+      tags[set][way] = tag;
+    }
+    use(set, way);
+
+    V& slot = data[set][way];
+
+    if ((way >= 0) & (tag == oldaddr)) {
+      stats::probed(slot, tag, way, 1);
+    } else {
+      if (oldaddr == INVALID)
+        stats::inserted(slot, tag, way);
+      else stats::replaced(slot, oldaddr, tag, way);
+    }
+
+    return &slot;
   }
 
   V* select(T addr) {
     T dummy;
-    return sets[setof(addr)].select(tagof(addr), dummy);
+    return select(addr, dummy);
   }
 
   void invalidate(T addr) {
-    sets[setof(addr)].invalidate(tagof(addr));
+    int set = setof(addr);
+    T tag = tagof(addr);
+    int way = match(set, tag);
+    if (way < 0) return;
+
+    stats::invalidated(data[set][way], tags[set][way], way);
+    tags[set][way] = INVALID;
+    evictmap[set][way] = 0;
+    data[set][way].reset();
   }
 
   ostream& print(ostream& os) const {
     os << "AssociativeArray<", setcount, " sets, ", waycount, " ways, ", linesize, "-byte lines>:", endl;
     foreach (set, setcount) {
       os << "  Set ", set, ":", endl;
-      os << sets[set];
+      foreach (way, waycount) {
+        stringbuf sb;
+        sb << "  way ", intstring(way, -2), ": ";
+        if (tags[set][way] != INVALID) {
+          sb << "tag 0x", hexstring(tags[set][way], sizeof(T)*8);
+          if (evictmap[set][way]) sb << " (MRU)";
+        } else {
+          sb << "<invalid>";
+        }
+        os << padstring(sb, -40), " -> ";
+        data[set][way].print(os, tags[set][way]);
+        os << endl;
+      }
     }
     return os;
   }
@@ -1579,8 +1691,19 @@ struct FullyAssociativeTags8bit {
 
   bitvec<size> match(const vec_t target) const {
     bitvec<size> m = 0;
+    int i = 0;
 
-    foreach (i, chunkcount) {
+    // Pairs of chunks at once, if the host has wider vectors:
+    if ((chunkcount >= 2) && (host_simd_level >= HOST_SIMD_AVX2)) {
+      base_t tag = ((const base_t*)&target)[0];
+      if (host_simd_level >= HOST_SIMD_AVX512) {
+        for (; i+2 <= chunkcount; i += 2) m = m.accum(i*16, 32, x86_avx512_pcmpeqb_mask(&tags[i], tag));
+      } else {
+        for (; i+2 <= chunkcount; i += 2) m = m.accum(i*16, 32, x86_avx2_pcmpeqb_mask(&tags[i], tag));
+      }
+    }
+
+    for (; i < chunkcount; i++) {
       m = m.accum(i*16, 16, x86_sse_pmovmskb(x86_sse_pcmpeqb(target, tags[i])));
     }
 
@@ -1741,8 +1864,19 @@ struct FullyAssociativeTags16bit {
 
   bitvec<size> match(const vec_t target) const {
     bitvec<size> m = 0;
+    int i = 0;
 
-    foreach (i, chunkcount) {
+    // Pairs of chunks at once, if the host has wider vectors:
+    if ((chunkcount >= 2) && (host_simd_level >= HOST_SIMD_AVX2)) {
+      base_t tag = ((const base_t*)&target)[0];
+      if (host_simd_level >= HOST_SIMD_AVX512) {
+        for (; i+2 <= chunkcount; i += 2) m = m.accum(i*8, 16, x86_avx512_pcmpeqw_mask(&tags[i], tag));
+      } else {
+        for (; i+2 <= chunkcount; i += 2) m = m.accum(i*8, 16, x86_avx2_pcmpeqw_mask(&tags[i], tag));
+      }
+    }
+
+    for (; i < chunkcount; i++) {
       m = m.accum(i*8, 8, x86_sse_pmovmskw(x86_sse_pcmpeqw(target, tags[i])));
     }
 
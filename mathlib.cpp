@@ -5116,6 +5116,32 @@ union ieee754_double {
     return explog::__ieee754_exp2(x);
   }
 
+  //
+  // 2^x - 1 for the x87 f2xm1 assist, where fpcw is the guest's x87
+  // control word. The host instruction keeps the digits exp2(x) - 1
+  // loses for small x, but it only rounds to the double the guest
+  // expects under round to nearest with double or extended precision
+  // control. Any other fpcw takes the soft path.
+  //
+  bool f2xm1_on_host(W16 fpcw) {
+    int pc = bits(fpcw, 8, 2);
+    int rc = bits(fpcw, 10, 2);
+    return (rc == 0) && (pc >= 2);
+  }
+
+  double f2xm1(double x, W16 fpcw) {
+    if (!f2xm1_on_host(fpcw)) return exp2(x) - 1;
+
+    // The host fpcw may be anything the guest last loaded: use the
+    // guest's precision, with all exceptions masked
+    W16 oldfpcw;
+    W16 tempfpcw = (fpcw & 0x0300) | 0x007f;
+    double r;
+    asm("fstcw %[oldfpcw]; fldcw %[tempfpcw]; fldl %[x]; f2xm1; fstpl %[r]; fldcw %[oldfpcw];"
+        : [r] "=m" (r), [oldfpcw] "=m" (oldfpcw) : [x] "m" (x), [tempfpcw] "m" (tempfpcw));
+    return r;
+  }
+
   //#define FP_ILOGB0       (-2147483647)
   //#define FP_ILOGBNAN     (2147483647)
 
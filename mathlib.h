@@ -52,6 +52,9 @@ namespace math {
   double cos(double a);
   double exp2(double x);
 
+  bool f2xm1_on_host(W16 fpcw);
+  double f2xm1(double x, W16 fpcw);
+
   int ilogb(double x);
   double significand(double x);
 
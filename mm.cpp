@@ -1124,6 +1124,131 @@ static const int SLAB_ALLOC_SLOT_COUNT = (SLAB_ALLOC_LARGE_OBJ_THRESH / SlabAllo
 
 SlabAllocator slaballoc[SLAB_ALLOC_SLOT_COUNT];
 
+//
+// Threads
+//
+// Once the first thread is created (ptl_multithreaded), the
+// allocators and the event log are only touched with mm_lock
+// held. The lock is recursive since reclaim handlers and the
+// logging code free memory while it is held.
+//
+// In front of the slabs, each thread keeps a few free objects
+// of every size, refilled from and drained back to the slab in
+// batches, so most small allocations and frees do not take the
+// lock at all. Objects sitting in these caches still count as
+// allocated in the slab statistics, and the event log does not
+// see allocations served by them. Larger objects always go
+// through genalloc with the lock held.
+//
+// Before any thread exists, none of this happens: the single
+// threaded simulator and its statistics are exactly as before.
+//
+
+struct MemoryManagerLock {
+  Mutex lock;
+  PTLThread* owner;
+  int depth;
+
+  void acquire() {
+    PTLThread* self = ptl_thread_self();
+    if (owner == self) { depth++; return; }
+    lock.acquire();
+    owner = self;
+    depth = 1;
+  }
+
+  void release() {
+    if (--depth) return;
+    owner = null;
+    lock.release();
+  }
+};
+
+static MemoryManagerLock mm_lock;
+
+struct MemoryManagerLockScope {
+  bool locked;
+  MemoryManagerLockScope() { locked = ptl_multithreaded; if unlikely (locked) mm_lock.acquire(); }
+  ~MemoryManagerLockScope() { if unlikely (locked) mm_lock.release(); }
+};
+
+struct ThreadSlabCache {
+  struct FreeObject { FreeObject* next; };
+
+  FreeObject* freelist[SLAB_ALLOC_SLOT_COUNT];
+  W16 count[SLAB_ALLOC_SLOT_COUNT];
+
+  // Objects moved between a thread and its slab at once; at most twice that are cached
+  static const int BATCH = 16;
+
+  void* alloc(int slot, size_t bytes) {
+    FreeObject* obj = freelist[slot];
+    if likely (obj) {
+      freelist[slot] = obj->next;
+      count[slot]--;
+      return obj;
+    }
+
+    MemoryManagerLockScope lock;
+    void* p = slaballoc[slot].alloc();
+    if unlikely (!p) {
+      ptl_mm_reclaim(bytes);
+      p = slaballoc[slot].alloc();
+      if unlikely (!p) return null;
+    }
+
+    foreach (i, BATCH-1) {
+      FreeObject* extra = (FreeObject*)slaballoc[slot].alloc();
+      if unlikely (!extra) break;
+      extra->next = freelist[slot];
+      freelist[slot] = extra;
+      count[slot]++;
+    }
+
+    return p;
+  }
+
+  void free(int slot, void* p) {
+    FreeObject* obj = (FreeObject*)p;
+    obj->next = freelist[slot];
+    freelist[slot] = obj;
+    count[slot]++;
+    if unlikely (count[slot] > 2*BATCH) drain(slot, BATCH);
+  }
+
+  void drain(int slot, int n) {
+    MemoryManagerLockScope lock;
+    while (n-- && freelist[slot]) {
+      FreeObject* obj = freelist[slot];
+      freelist[slot] = obj->next;
+      count[slot]--;
+      slaballoc[slot].free(obj);
+    }
+  }
+
+  void drain() {
+    foreach (i, SLAB_ALLOC_SLOT_COUNT) drain(i, count[i]);
+  }
+};
+
+static int mm_thread_cache_key = -1;
+
+static void ptl_mm_thread_exit(void* value) {
+  ThreadSlabCache* cache = (ThreadSlabCache*)value;
+  cache->drain();
+  ptl_mm_free_private_pages(cache, sizeof(ThreadSlabCache));
+}
+
+static ThreadSlabCache* ptl_mm_thread_cache() {
+  ThreadSlabCache* cache = (ThreadSlabCache*)ptl_thread_get(mm_thread_cache_key);
+  if likely (cache) return cache;
+
+  // Fresh anonymous pages are already zeroed
+  cache = (ThreadSlabCache*)ptl_mm_alloc_private_pages(sizeof(ThreadSlabCache));
+  ptl_thread_set(mm_thread_cache_key, cache);
+  return cache;
+}
+
 W64 ptl_mm_dump_free_bytes(ostream& os) {
   W64 slaballoc_free_bytes = 0;
   foreach (i, SLAB_ALLOC_SLOT_COUNT) {
@@ -1144,6 +1269,7 @@ W64 ptl_mm_dump_free_bytes(ostream& os) {
 }
 
 void ptl_mm_dump(ostream& os) {
+  MemoryManagerLockScope lock;
   ptl_mm_dump_free_bytes(os);
 
 #ifdef PTLSIM_HYPERVISOR
@@ -1171,11 +1297,16 @@ extern ostream logfile;
 // Full-system PTLsim running on the bare hardware:
 //
 void* ptl_mm_try_alloc_private_pages(Waddr bytecount, int prot, Waddr base, void* caller) {
+  MemoryManagerLockScope lock;
   void* p = pagealloc.alloc(bytecount);
   ptl_mm_add_event(PTL_MM_EVENT_ALLOC, PTL_MM_POOL_PAGES, caller, p, bytecount);
   return p;
 }
 
+static void* ptl_mm_try_alloc_pool_pages(Waddr bytecount, int prot, Waddr base, void* caller) {
+  return ptl_mm_try_alloc_private_pages(bytecount, prot, base, caller);
+}
+
 void* ptl_mm_alloc_private_pages(Waddr bytecount, int prot, Waddr base) { 
   static const int retry_count = 64;
 
@@ -1200,10 +1331,12 @@ void* ptl_mm_alloc_private_pages(Waddr bytecount, int prot, Waddr base) {
 }
 
 void* ptl_mm_alloc_private_32bit_pages(Waddr bytecount, int prot, Waddr base) {
+  MemoryManagerLockScope lock;
   return ptl_mm_alloc_private_pages(bytecount, prot, base);
 }
 
 void ptl_mm_free_private_pages(void* addr, Waddr bytecount) {
+  MemoryManagerLockScope lock;
   assert(addr);
   ptl_mm_add_event(PTL_MM_EVENT_FREE, PTL_MM_POOL_PAGES, getcaller(), addr, bytecount);
   pagealloc.free(floorptr(addr, PAGE_SIZE), ceil(bytecount, PAGE_SIZE));
@@ -1213,9 +1346,121 @@ void ptl_mm_zero_private_pages(void* addr, Waddr bytecount) {
   memset(addr, 0, bytecount);
 }
 
+// PTLxen manages the physical pages itself
+void ptl_mm_set_huge_pages(bool enable) { }
+
 #else
 
-void* ptl_mm_try_alloc_private_pages(Waddr bytecount, int prot, Waddr base, void* caller) {
+//
+// Huge page arena
+//
+// With ptl_mm_set_huge_pages(true), read/write page allocations
+// without a fixed address (SPAT chunks, translation arena chunks,
+// event logs, thread contexts and so on) are carved out of one
+// reserved area, committed 2 MB at a time.
+// Each 2 MB region is mapped with MAP_HUGETLB if the host has
+// huge pages reserved, or otherwise madvise(MADV_HUGEPAGE)'d for
+// transparent huge pages; if neither works, it still is an
+// ordinary mapping. Freed pages go back to hugealloc rather than
+// to the host, and pages are zeroed when handed out again.
+//
+// Unlike the normal pools, the arena is never MAP_SHARED: the
+// kernel only uses transparent huge pages for private memory.
+//
+// The genalloc pools never come from the arena. Raspsim keeps the
+// guest's pages there, and passes their host addresses to the cache
+// model as physical addresses, so the arena is also reserved far
+// away from everything else: the host layout of all other mappings,
+// and with it the simulated cycle count, does not change with the
+// option.
+//
+
+static const Waddr HUGE_PAGE_SIZE = 2*1024*1024;
+static const Waddr HUGE_ARENA_SIZE = 64ULL*1024*1024*1024;
+static const Waddr HUGE_ARENA_HINT = 0x200000000000ULL;
+
+ExtentAllocator<4096, 512, 512> hugealloc;
+
+static bool huge_pages_enabled = false;
+static bool huge_pages_hugetlb = true;
+static byte* huge_arena_base = null;
+static byte* huge_arena_top = null;
+static byte* huge_arena_end = null;
+
+static inline bool inside_huge_arena(void* p) {
+  return huge_arena_base && inrange((byte*)p, huge_arena_base, huge_arena_end-1);
+}
+
+void ptl_mm_set_huge_pages(bool enable) {
+  MemoryManagerLockScope lock;
+
+  if (enable && (!huge_arena_base)) {
+    byte* p = (byte*)sys_mmap((void*)HUGE_ARENA_HINT, HUGE_ARENA_SIZE + HUGE_PAGE_SIZE, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if unlikely (mmap_invalid(p)) {
+      logfile << "mm: cannot reserve ", HUGE_ARENA_SIZE, " bytes for the huge page arena; using normal pages", endl;
+      return;
+    }
+
+    hugealloc.reset();
+    huge_arena_base = (byte*)ceil((Waddr)p, HUGE_PAGE_SIZE);
+    huge_arena_top = huge_arena_base;
+    huge_arena_end = huge_arena_base + HUGE_ARENA_SIZE;
+  }
+
+  huge_pages_enabled = (enable && huge_arena_base);
+}
+
+static bool ptl_mm_grow_huge_arena(Waddr bytecount) {
+  bytecount = ceil(bytecount, HUGE_PAGE_SIZE);
+  if unlikely ((huge_arena_top + bytecount) > huge_arena_end) return false;
+
+  byte* p = huge_arena_top;
+  bool mapped = false;
+
+  if (huge_pages_hugetlb) {
+    void* addr = sys_mmap(p, bytecount, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED|MAP_HUGETLB, -1, 0);
+    mapped = mmap_valid(addr);
+    if unlikely (!mapped) {
+      logfile << "mm: no MAP_HUGETLB pages available; using transparent huge pages", endl;
+      huge_pages_hugetlb = false;
+    }
+  }
+
+  //
+  // A failed MAP_FIXED mmap may already have unmapped the reserved
+  // range, so map it again rather than just mprotect()ing it, or
+  // other mappings could land in the hole.
+  //
+  if (!mapped) {
+    void* addr = sys_mmap(p, bytecount, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED|MAP_NORESERVE, -1, 0);
+    if unlikely (mmap_invalid(addr)) return false;
+    if unlikely (sys_madvise(p, bytecount, MADV_HUGEPAGE)) {
+      static bool warned = false;
+      if (!warned) logfile << "mm: madvise(MADV_HUGEPAGE) failed; huge page arena uses normal pages", endl;
+      warned = true;
+    }
+  }
+
+  huge_arena_top += bytecount;
+  hugealloc.add_to_free_pool(p, bytecount);
+  return true;
+}
+
+static void* ptl_mm_try_alloc_huge_arena_pages(Waddr bytecount) {
+  void* p = hugealloc.alloc(bytecount);
+  if unlikely (!p) {
+    if unlikely (!ptl_mm_grow_huge_arena(bytecount)) return null;
+    p = hugealloc.alloc(bytecount);
+  }
+
+  // Callers expect fresh pages, as from mmap:
+  if likely (p) memset(p, 0, bytecount);
+  return p;
+}
+
+// Pages from the host, never from the huge page arena:
+static void* ptl_mm_try_alloc_pool_pages(Waddr bytecount, int prot, Waddr base, void* caller) {
+  MemoryManagerLockScope lock;
   int flags = MAP_ANONYMOUS|MAP_NORESERVE | (base ? MAP_FIXED : 0);
   flags |= (inside_ptlsim) ? MAP_SHARED : MAP_PRIVATE;
   if (base == 0) base = PTL_PAGE_POOL_BASE;
@@ -1230,11 +1475,29 @@ void* ptl_mm_try_alloc_private_pages(Waddr bytecount, int prot, Waddr base, void
   return addr;
 }
 
+void* ptl_mm_try_alloc_private_pages(Waddr bytecount, int prot, Waddr base, void* caller) {
+  MemoryManagerLockScope lock;
+
+  if unlikely (huge_pages_enabled && (!base) && (prot == (PROT_READ|PROT_WRITE))) {
+    void* addr = ptl_mm_try_alloc_huge_arena_pages(ceil(bytecount, PAGE_SIZE));
+    ptl_mm_add_event(PTL_MM_EVENT_ALLOC, PTL_MM_POOL_PAGES, caller, addr, bytecount);
+    if likely (addr) {
+      pagealloc.allocs++;
+      pagealloc.current_bytes_allocated += ceil(bytecount, PAGE_SIZE);
+      pagealloc.peak_bytes_allocated = max(pagealloc.peak_bytes_allocated, pagealloc.current_bytes_allocated);
+      return addr;
+    }
+  }
+
+  return ptl_mm_try_alloc_pool_pages(bytecount, prot, base, caller);
+}
+
 void* ptl_mm_alloc_private_pages(Waddr bytecount, int prot, Waddr base) {
   return ptl_mm_try_alloc_private_pages(bytecount, prot, base, getcaller());
 }
 
 void* ptl_mm_alloc_private_32bit_pages(Waddr bytecount, int prot, Waddr base) {
+  MemoryManagerLockScope lock;
 #ifdef __x86_64__
   int flags = MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE | (base ? MAP_FIXED : MAP_32BIT);
 #else
@@ -1252,15 +1515,18 @@ void* ptl_mm_alloc_private_32bit_pages(Waddr bytecount, int prot, Waddr base) {
 }
 
 void ptl_mm_free_private_pages(void* addr, Waddr bytecount) {
+  MemoryManagerLockScope lock;
   bytecount = ceil(bytecount, PAGE_SIZE);
 
   pagealloc.frees++;
   pagealloc.current_bytes_allocated -= min(pagealloc.current_bytes_allocated, (W64)bytecount);
-  sys_munmap(addr, bytecount);
+  if unlikely (inside_huge_arena(addr)) hugealloc.free(addr, bytecount); else sys_munmap(addr, bytecount);
   ptl_mm_add_event(PTL_MM_EVENT_FREE, PTL_MM_POOL_PAGES, getcaller(), addr, bytecount);
 }
 
 void ptl_mm_zero_private_pages(void* addr, Waddr bytecount) {
+  // Dropping part of a huge page would split it:
+  if unlikely (inside_huge_arena(addr)) { memset(addr, 0, bytecount); return; }
   sys_madvise((void*)floor((Waddr)addr, PAGE_SIZE), bytecount, MADV_DONTNEED);
 }
 
@@ -1301,6 +1567,8 @@ void ptl_mm_init(byte* heap_start, byte* heap_end) {
     slaballoc[i].reset((i+1) * SlabAllocator::GRANULARITY);
   }
 
+  mm_thread_cache_key = ptl_thread_key_create(ptl_mm_thread_exit);
+
 #ifdef ENABLE_MM_LOGGING
   mm_event_buffer_head = mm_event_buffer;
   mm_event_buffer_end = mm_event_buffer_head + mm_event_buffer_size;
@@ -1335,6 +1603,8 @@ void* ptl_mm_alloc(size_t bytes, void* caller) {
     bytes = ceil(bytes, SlabAllocator::GRANULARITY);
     int slot = (bytes >> log2(SlabAllocator::GRANULARITY))-1;
     assert(slot < SLAB_ALLOC_SLOT_COUNT);
+    if unlikely (ptl_multithreaded) return ptl_mm_thread_cache()->alloc(slot, bytes);
+
     void* p = slaballoc[slot].alloc();
     if unlikely (!p) {
       ptl_mm_add_event(PTL_MM_EVENT_ALLOC, PTL_MM_POOL_SLAB, caller, null, bytes, slot);
@@ -1352,6 +1622,7 @@ void* ptl_mm_alloc(size_t bytes, void* caller) {
     //
     bytes = ceil(bytes + 16, 16);
 
+    MemoryManagerLockScope lock;
     W64* p = (W64*)genalloc.alloc(bytes);
     if unlikely (!p) {
       ptl_mm_add_event(PTL_MM_EVENT_ALLOC, PTL_MM_POOL_GENERAL, caller, null, bytes);
@@ -1365,7 +1636,7 @@ void* ptl_mm_alloc(size_t bytes, void* caller) {
       // page tables and can put the entire page pool in one 2 GB aligned block.
       //
       int prot = PROT_READ|PROT_WRITE;
-      void* newpool = ptl_mm_try_alloc_private_pages(pagebytes, prot, 0, getcaller());
+      void* newpool = ptl_mm_try_alloc_pool_pages(pagebytes, prot, 0, getcaller());
       if unlikely (!newpool) {
         size_t largest_free_extent = pagealloc.largest_free_extent_bytes();
         logfile << "mm: attempted to allocate ", bytes, " bytes: failed allocation of new gen pool chunk (",
@@ -1378,7 +1649,7 @@ void* ptl_mm_alloc(size_t bytes, void* caller) {
           // If we get here, largest_free_extent must be < pagebytes:
           //
           pagebytes = largest_free_extent;
-          newpool = ptl_mm_try_alloc_private_pages(pagebytes, prot, 0, getcaller());
+          newpool = ptl_mm_try_alloc_pool_pages(pagebytes, prot, 0, getcaller());
           // Must have some space for at least this amount:
           assert(newpool);
         } else {
@@ -1425,6 +1696,8 @@ void* ptl_mm_try_alloc(size_t bytes) {
 
   if unlikely (!bytes) return null;
 
+  MemoryManagerLockScope lock;
+
   if likely ((bytes <= SLAB_ALLOC_LARGE_OBJ_THRESH)) {
     //
     // Allocate from slab
@@ -1470,6 +1743,8 @@ void* ptl_mm_alloc_aligned(int alignbits) {
 
   if unlikely (bytes > SLAB_ALLOC_LARGE_OBJ_THRESH) return null;
 
+  MemoryManagerLockScope lock;
+
   //
   // Allocate from slab
   //
@@ -1511,6 +1786,11 @@ void ptl_mm_free(void* p, void* caller) {
     //
     // From slab allocation pool: all objects on a given page are the same size
     //
+    if unlikely (ptl_multithreaded) {
+      ptl_mm_thread_cache()->free(sa - slaballoc, p);
+      return;
+    }
+
     ptl_mm_add_event(PTL_MM_EVENT_FREE, PTL_MM_POOL_SLAB, caller, p, sa->objsize, sa - slaballoc);
     sa->free(p);
   } else {
@@ -1523,6 +1803,7 @@ void ptl_mm_free(void* p, void* caller) {
     W64* pp = ((W64*)p)-2;
     Waddr bytes = *pp;
 
+    MemoryManagerLockScope lock;
     ptl_mm_add_event(PTL_MM_EVENT_FREE, PTL_MM_POOL_GENERAL, caller, p, bytes);
     genalloc.free(pp, bytes);
   }
@@ -1533,6 +1814,7 @@ void ptl_mm_free(void* p) {
 }
 
 void ptl_mm_validate() {
+  MemoryManagerLockScope lock;
   logfile << "ptl_mm_validate() called by ", getcaller(), endl;
   pagealloc.fast_validate();
   genalloc.fast_validate();
@@ -1570,6 +1852,7 @@ bool ptl_mm_register_reclaim_handler(mm_reclaim_handler_t handler) {
 // retained as a slab cache page.
 //
 void ptl_mm_cleanup() {
+  MemoryManagerLockScope lock;
   ptl_mm_add_event(PTL_MM_EVENT_CLEANUP, PTL_MM_POOL_ALL, getcaller(), null, 0);
 
   foreach (i, SLAB_ALLOC_SLOT_COUNT) {
@@ -1595,6 +1878,7 @@ void ptl_mm_cleanup() {
 // for other types of big allocations.
 //
 void ptl_mm_reclaim(size_t bytes, int urgency) {
+  MemoryManagerLockScope lock;
   ptl_mm_add_event(PTL_MM_EVENT_RECLAIM_START, PTL_MM_POOL_ALL, getcaller(), null, bytes);
 
   foreach (i, reclaim_handler_list_count) {
@@ -1611,6 +1895,7 @@ void ptl_mm_reclaim(size_t bytes, int urgency) {
 }
 
 DataStoreNode& ptl_mm_capture_stats(DataStoreNode& root) {
+  MemoryManagerLockScope lock;
 #ifndef PTLSIM_HYPERVISOR
   pagealloc.capture_stats(root("page"));
   genalloc.capture_stats(root("general"));
@@ -270,6 +270,7 @@ namespace OutOfOrderModel {
     print_value_and_flags(sb, physreg.data, physreg.flags);
     os << "TH ", physreg.threadid, " rfid ", physreg.rfid;
     os << "  r", intstring(physreg.index(), -3), " state ", padstring(physreg.get_state_list().name, -12), " ", sb;
+    if (physreg.vec128) os << " hi ", hexstring(physreg.datahi, 64);
     if (physreg.rob) os << " rob ", physreg.rob->index(), " (uuid ", physreg.rob->uop.uuid, ")";
     os << " refcount ", physreg.refcount;
     
@@ -475,7 +476,7 @@ bool OutOfOrderCore::runcycle() {
   //
   // Flush event log ring buffer
   //
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     // logfile << "[cycle ", sim_cycle, "] Miss buffer contents:", endl;
     // logfile << caches.missbuf;
     if unlikely (config.flush_event_log_every_cycle) {
@@ -581,7 +582,7 @@ bool OutOfOrderCore::runcycle() {
     ThreadContext* thread = threads[i];
     if unlikely (!thread->ctx.running) break;
 
-    if unlikely ((sim_cycle - thread->last_commit_at_cycle) > 4096) {
+    if unlikely ((sim_cycle - thread->last_commit_at_cycle) > COMMIT_DEADLOCK_TIMEOUT_CYCLES) {
       stringbuf sb;
       sb << "[vcpu ", thread->ctx.vcpuid, "] thread ", thread->threadid, ": WARNING: At cycle ",
         sim_cycle, ", ", total_user_insns_committed,  " user commits: no instructions have committed for ",
@@ -595,6 +596,154 @@ bool OutOfOrderCore::runcycle() {
   return exiting;
 }
 
+//
+// Idle cycle skipping
+//
+// While the core waits on cache misses or long latency functional
+// units, each cycle until the next fill, completion, frontend stage
+// transfer or dispatch deadlock check is identical: the same stall
+// counters are incremented and the only state that moves is a set
+// of countdowns. The machine simulates one such cycle as a template,
+// confirms via capture_activity() that no uop changed state, then
+// replays its stats delta and advances the countdowns for all the
+// remaining cycles up to the next event in one step.
+//
+
+//
+// Cheap precheck: can this cycle possibly be idle? The last cycle
+// must not have moved anything, and anything with all operands
+// ready could issue, so only uops waiting on operands, a cache
+// miss or a countdown are allowed.
+//
+bool OutOfOrderCore::quiescent() {
+  // Anything committed, written back or dispatched in the last cycle?
+  if likely (commitcount | writecount | dispatchcount) return false;
+  if unlikely (*caches.lfrq.ready) return false;
+
+  foreach (i, threadcount) {
+    ThreadContext* thread = threads[i];
+    if unlikely (!thread->ctx.running) return false;
+    if (thread->stop_at_next_eom | thread->handle_interrupt_at_next_eom) return false;
+    if (thread->rob_tlb_miss_list.count) return false;
+
+    for_each_cluster (cluster) {
+      if (thread->rob_ready_to_issue_list[cluster].count | thread->rob_ready_to_store_list[cluster].count |
+          thread->rob_ready_to_load_list[cluster].count | thread->rob_completed_list[cluster].count |
+          thread->rob_ready_to_writeback_list[cluster].count) return false;
+    }
+  }
+
+  return (cycles_to_next_event(MIN_IDLE_CYCLES_TO_SKIP) >= MIN_IDLE_CYCLES_TO_SKIP);
+}
+
+void OutOfOrderCore::capture_activity(ActivitySignature& sig) {
+  sig.reset();
+
+  foreach (i, threadcount) {
+    ThreadContext* thread = threads[i];
+    foreach (j, thread->rob_states.count) sig.add(thread->rob_states[j]->count);
+    foreach (j, thread->lsq_states.count) sig.add(thread->lsq_states[j]->count);
+    sig.add(thread->ROB.count);
+    sig.add(thread->LSQ.count);
+    sig.add(thread->fetchq.count);
+    sig.add(thread->fetchrip.rip);
+    sig.add((Waddr)thread->current_basic_block);
+    sig.add(thread->current_basic_block_transop_index);
+    sig.add(thread->fetch_uuid);
+    sig.add(thread->stall_frontend);
+    sig.add(thread->waiting_for_icache_fill);
+    sig.add(thread->issueq_count);
+    sig.add(thread->loads_in_flight);
+    sig.add(thread->stores_in_flight);
+    sig.add(thread->total_uops_committed);
+  }
+
+  foreach (j, physreg_states.count) sig.add(physreg_states[j]->count);
+
+  sig.add(total_uops_executed);
+  sig.add(total_uops_committed);
+
+  sig.add(caches.lfrq.freemap.integer());
+  sig.add(caches.lfrq.waiting.integer());
+  sig.add(caches.lfrq.ready.integer());
+  sig.add(caches.missbuf.freemap.integer());
+  foreach (i, CacheSubsystem::MISSBUF_COUNT) sig.add(caches.missbuf.missbufs[i].state);
+}
+
+//
+// Number of the first upcoming cycle (the next one being 1) in
+// which some countdown expires, or 0 if nothing is pending. Once
+// an event closer than <limit> is found, the search stops there.
+//
+W64 OutOfOrderCore::cycles_to_next_event(W64s limit) {
+  W64s cycles = caches.missbuf.cycles_to_next_event();
+  if (!cycles) cycles = limits<W64s>::max;
+
+  ReorderBufferEntry* rob;
+
+  foreach (i, threadcount) {
+    ThreadContext* thread = threads[i];
+
+    // Nothing dispatches, so the deadlock countdown runs:
+    if (thread->rob_ready_to_dispatch_list.count) cycles = min(cycles, W64s(thread->dispatch_deadlock_countdown));
+
+    // Leaves the frontend in the cycle after cycles_left reaches 0:
+    foreach_list_mutable(thread->rob_frontend_list, rob, entry, nextentry) {
+      if (cycles < limit) break;
+      cycles = min(cycles, W64s(rob->cycles_left) + 1);
+    }
+
+    // Completes in the cycle cycles_left reaches 0:
+    for_each_cluster (cluster) {
+      foreach_list_mutable(thread->rob_issued_list[cluster], rob, entry, nextentry) {
+        if (cycles < limit) break;
+        cycles = min(cycles, W64s(rob->cycles_left));
+      }
+    }
+  }
+
+  return (cycles == limits<W64s>::max) ? 0 : max(cycles, W64s(0));
+}
+
+//
+// How many cycles after the current one are guaranteed to be
+// identical to it, as far as the core itself is concerned
+//
+W64 OutOfOrderCore::idle_cycles_until_next_event() {
+  W64s cycles = W64s(cycles_to_next_event()) - 1;
+
+  // The commit watchdog must still fire in the right cycle:
+  foreach (i, threadcount) {
+    ThreadContext* thread = threads[i];
+    cycles = min(cycles, W64s(thread->last_commit_at_cycle + COMMIT_DEADLOCK_TIMEOUT_CYCLES + 1 - sim_cycle));
+  }
+
+  // So must the periodic cache stats reset in CacheHierarchy::clock():
+  cycles = min(cycles, W64s(0x7fffffff - (sim_cycle & 0x7fffffff)));
+
+  return max(cycles, W64s(0));
+}
+
+void OutOfOrderCore::skip_idle_cycles(W64 cycles) {
+  caches.missbuf.skip(cycles);
+
+  ReorderBufferEntry* rob;
+
+  foreach (i, threadcount) {
+    ThreadContext* thread = threads[i];
+
+    foreach_list_mutable(thread->rob_frontend_list, rob, entry, nextentry) rob->cycles_left -= cycles;
+
+    for_each_cluster (cluster) {
+      foreach_list_mutable(thread->rob_issued_list[cluster], rob, entry, nextentry) rob->cycles_left -= cycles;
+    }
+
+    if (thread->rob_ready_to_dispatch_list.count) thread->dispatch_deadlock_countdown -= cycles;
+  }
+
+  round_robin_tid = add_index_modulo(round_robin_tid, +(cycles % threadcount), threadcount);
+}
+
 //
 // ReorderBufferEntry
 //
@@ -624,6 +773,7 @@ void ReorderBufferEntry::reset() {
   executable_on_cluster_mask = 0;
   pteupdate = 0;
   cluster = -1;
+  hi_operands = 0;
 #ifdef ENABLE_TRANSIENT_VALUE_TRACKING
   dest_renamed_before_writeback = 0;
   no_branches_between_renamings = 0;
@@ -692,13 +842,13 @@ ThreadContext& ReorderBufferEntry::getthread() const { return *getcore().threads
 
 issueq_tag_t ReorderBufferEntry::get_tag() {
   int mask = ((1 << MAX_THREADS_BIT) - 1) << MAX_ROB_IDX_BIT;
-  if (logable(100)) logfile << " get_tag() thread ", (void*) threadid, " rob idx ", (void*)idx, " mask ", (void*)mask, endl;
+  if (logable(100)) logfile << " get_tag() thread ", (void*)(Waddr)threadid, " rob idx ", (void*)(Waddr)idx, " mask ", (void*)(Waddr)mask, endl;
 
   assert(!(idx & mask)); 
   assert(!(threadid >> MAX_THREADS_BIT));
   //  int threadid = 1;  
   issueq_tag_t rc = (idx | (threadid << MAX_ROB_IDX_BIT));
-  if (logable(100)) logfile <<  " tag ", (void*) rc, endl;
+  if (logable(100)) logfile <<  " tag ", (void*)(Waddr)rc, endl;
   return rc;
 }
 
@@ -938,7 +1088,7 @@ bool ThreadContext::handle_barrier() {
   
   if (logable(6)) logfile << "Calling assist function at ", (void*)assist, "...", endl, flush; 
   
-  update_assist_stats(assist);
+  update_assist_stats(assistid);
   if (logable(6)) {
     logfile << "Before assist:", endl, ctx, endl;
 #ifdef PTLSIM_HYPERVISOR
@@ -1663,7 +1813,8 @@ bool OutOfOrderMachine::init(PTLsimConfig& config) {
   foreach (i, contextcount) {
     OutOfOrderCore& core = *cores[0];
     core.threadcount++;
-    ThreadContext* thread = new ThreadContext(core, i, contextof(i));
+    // Page aligned, so the ROB entries start on cache line boundaries
+    ThreadContext* thread = new (ptl_mm_alloc_private_pages(sizeof(ThreadContext))) ThreadContext(core, i, contextof(i));
     core.threads[i] = thread;
     thread->init();
 
@@ -1681,13 +1832,14 @@ bool OutOfOrderMachine::init(PTLsimConfig& config) {
   return true;
 }
 
+// Stats before the current idle cycle skipping template cycle
+static PTLsimStats idle_template_stats;
+
 //
 // Run the processor model, until a stopping point
 // is hit (as configured elsewhere in config).
 //
 int OutOfOrderMachine::run(PTLsimConfig& config) {
-  time_this_scope(cttotal);
-
   logfile << "Starting out-of-order core toplevel loop", endl, flush;
 
   // All VCPUs are running:
@@ -1703,13 +1855,15 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
 
   logfile << "IssueQueue states:", endl;
 
-  if unlikely (config.event_log_enabled && (!cores[0]->eventlog.start)) {
+  if (event_logable() && (!cores[0]->eventlog.start)) {
     cores[0]->eventlog.init(config.event_log_ring_buffer_size);
     cores[0]->eventlog.logfile = &logfile;
   }
 
   bool exiting = false;
   bool stopping = false;
+  idle_in_last_cycle = 0;
+  W64 profile_countdown = 1;
 
   for (;;) {
     if unlikely (iterations >= config.start_log_at_iteration) {
@@ -1739,7 +1893,32 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
 #endif
     }
 
-    exiting |= core.runcycle();
+    //
+    // Idle cycle skipping: a cycle following an idle cycle serves as
+    // the template whose stats are replayed over the skipped cycles.
+    // Logging must be off since skipped cycles print nothing.
+    //
+    bool idle_candidate = (!config.no_skip_idle_cycles) && (!event_logable()) && (!logable(1)) && (!stopping) && core.quiescent();
+    bool idle_template = false;
+
+    if unlikely (idle_candidate) {
+      core.capture_activity(activity_before);
+      idle_template = idle_in_last_cycle;
+      if (idle_template) idle_template_stats = stats;
+    }
+
+    profile_this_cycle = (config.profile_interval && (--profile_countdown == 0));
+
+    if unlikely (profile_this_cycle) {
+      profile_countdown = config.profile_interval;
+      profiled_cycles++;
+      W64 t = rdtsc();
+      exiting |= core.runcycle();
+      cttotal.total += rdtsc() - t;
+      profile_this_cycle = 0;
+    } else {
+      exiting |= core.runcycle();
+    }
 
     if unlikely (check_for_async_sim_break() && (!stopping)) {
       logfile << "Waiting for all VCPUs to reach stopping point, starting at cycle ", sim_cycle, endl;
@@ -1761,6 +1940,15 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
     unhalted_cycle_count += (running_thread_count > 0);
     iterations++;
 
+    if unlikely (idle_candidate) {
+      core.capture_activity(activity_after);
+      bool idle = (activity_before == activity_after);
+      if (idle & idle_template & (!exiting) & (!stopping)) skip_idle_cycles(core, idle_template_stats, (running_thread_count > 0));
+      idle_in_last_cycle = idle;
+    } else {
+      idle_in_last_cycle = 0;
+    }
+
     if unlikely (stopping) {
       // logfile << "Waiting for all VCPUs to stop at ", sim_cycle, ": mask = ", stopped, " (need ", contextcount, " VCPUs)", endl;
       exiting |= (stopped.integer() == bitmask(contextcount));
@@ -1787,6 +1975,13 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
   config.dump_state_now = 0;
 
   dump_state(logfile);
+
+  if (config.profile_interval) {
+    stringbuf sb;
+    print_profile(sb);
+    logfile << sb, flush;
+    cerr << sb, flush;
+  }
   
   // Flush everything to remove any remaining refs to basic blocks
   flush_all_pipelines();
@@ -1794,6 +1989,78 @@ int OutOfOrderMachine::run(PTLsimConfig& config) {
   return exiting;
 }
 
+//
+// The parts of PTLsimStats that only hold integer event counters, as
+// byte offsets [start, end). Only these may change in an idle cycle:
+// the rest (configuration, decoder, host timing and the few floating
+// point fields) is never replayed over skipped cycles.
+//
+struct StatsCounterRange {
+  W64 start;
+  W64 end;
+};
+
+static const StatsCounterRange idle_cycle_counters[] = {
+  {offsetof_(PTLsimStats, summary), offsetof_(PTLsimStats, simulator)},
+  {offsetof_(PTLsimStats, ooocore), offsetof_(PTLsimStats, ooocore.simulator)},
+  {offsetof_(PTLsimStats, dcache), offsetof_(PTLsimStats, dcache.lfrq.average_latency)},
+  {offsetof_(PTLsimStats, dcache.lfrq.average_latency) + sizeof(double), offsetof_(PTLsimStats, external)},
+};
+
+//
+// Fast forward over the idle cycles following the template cycle
+// just simulated, given the stats as they were before that cycle.
+// Stopping points, snapshots and log triggers are all checked at
+// cycle granularity, so never skip past the next one of those.
+//
+void OutOfOrderMachine::skip_idle_cycles(OutOfOrderCore& core, const PTLsimStats& template_stats, bool running) {
+  W64s cycles = core.idle_cycles_until_next_event();
+
+  cycles = min(cycles, W64s(config.stop_at_cycle - sim_cycle));
+  cycles = min(cycles, W64s(config.stop_at_iteration - iterations));
+  if (!logenable) cycles = min(cycles, W64s(config.start_log_at_iteration - iterations));
+  if (config.snapshot_cycles != infinity) cycles = min(cycles, W64s(last_stats_captured_at_cycle + config.snapshot_cycles - sim_cycle));
+
+  if unlikely (cycles <= 0) return;
+
+  //
+  // The template cycle's delta of each counter is simply scaled.
+  // Only a few dozen words change in an idle cycle, so find them
+  // 16 bytes at a time.
+  //
+  byte* statsbase = (byte*)&stats;
+  const byte* templatebase = (const byte*)&template_stats;
+  W64 checked = 0;
+
+  foreach (r, lengthof(idle_cycle_counters)) {
+    const StatsCounterRange& range = idle_cycle_counters[r];
+    assert(!memcmp(statsbase + checked, templatebase + checked, range.start - checked));
+
+    W64* p = (W64*)(statsbase + range.start);
+    const W64* q = (const W64*)(templatebase + range.start);
+    int words = (range.end - range.start) / sizeof(W64);
+
+    foreach (i, words / 2) {
+      const vec16b* pv = (const vec16b*)(p + 2*i);
+      const vec16b* qv = (const vec16b*)(q + 2*i);
+      if likely (x86_sse_pmovmskb(x86_sse_pcmpeqb(x86_sse_ldvbu(pv), x86_sse_ldvbu(qv))) == 0xffff) continue;
+      p[2*i] += (p[2*i] - q[2*i]) * cycles;
+      p[2*i+1] += (p[2*i+1] - q[2*i+1]) * cycles;
+    }
+
+    if (words & 1) p[words-1] += (p[words-1] - q[words-1]) * cycles;
+    checked = range.end;
+  }
+
+  assert(!memcmp(statsbase + checked, templatebase + checked, sizeof(PTLsimStats) - checked));
+
+  core.skip_idle_cycles(cycles);
+  sim_cycle += cycles;
+  iterations += cycles;
+  unhalted_cycle_count += (running) ? cycles : 0;
+  stats.ooocore.simulator.idle_cycles_skipped += cycles;
+}
+
 void OutOfOrderCore::flush_tlb(Context& ctx, int threadid, bool selective, Waddr virtaddr) {
   ThreadContext& thread =* threads[threadid];
   if (logable(5)) {
@@ -1841,7 +2108,7 @@ void OutOfOrderMachine::dump_state(ostream& os) {
     if (!cores[i]) continue;
     OutOfOrderCore& core =* cores[i];
     Context& ctx = contextof(i);
-    if unlikely (config.event_log_enabled) 
+    if (event_logable()) 
                   core.eventlog.print(logfile);
     else
       os << " config.event_log_enabled is not enabled ", config.event_log_enabled, endl;
@@ -1867,6 +2134,10 @@ void OutOfOrderMachine::dump_state(ostream& os) {
 }
 
 namespace OutOfOrderModel {
+  bool profile_this_cycle = 0;
+  W64 profiled_cycles = 0;
+  W64 profile_issue_cycles[OPCLASS_COUNT];
+
   CycleTimer cttotal;
   CycleTimer ctfetch;
   CycleTimer ctdecode;
@@ -1908,6 +2179,50 @@ void OutOfOrderMachine::update_stats(PTLsimStats& stats) {
   stats.ooocore.simulator.cputime.transfer = cttransfer.seconds();
   stats.ooocore.simulator.cputime.writeback = ctwriteback.seconds();
   stats.ooocore.simulator.cputime.commit = ctcommit.seconds();
+
+  stats.ooocore.simulator.profiled_cycles = profiled_cycles;
+  foreach (i, OPCLASS_COUNT) stats.ooocore.simulator.issue_host_cycles[i] = profile_issue_cycles[i];
+}
+
+//
+// Host cycles per simulated cycle in the cycles timed by -profile,
+// by pipeline stage and by the class of the uops issued.
+//
+void OutOfOrderMachine::print_profile(stringbuf& sb) {
+  static const CycleTimer* stages[] = {
+    &ctfetch, &ctdecode, &ctrename, &ctfrontend, &ctdispatch, &ctissue, &ctissueload, &ctissuestore,
+    &ctcomplete, &cttransfer, &ctwriteback, &ctcommit,
+  };
+
+  static const char* stage_names[] = {
+    "fetch", "decode", "rename", "frontend", "dispatch", "issue", "issueload", "issuestore",
+    "complete", "transfer", "writeback", "commit",
+  };
+
+  double n = max(profiled_cycles, W64(1));
+  double total = cttotal.cycles() / n;
+  double accounted = 0;
+
+  sb << "Profile of ", profiled_cycles, " cycles (1 in ", config.profile_interval, "), in host cycles per simulated cycle:", endl;
+  sb << "  ", padstring("total", -12), floatstring(total, 10, 1), endl;
+
+  foreach (i, lengthof(stages)) {
+    double c = stages[i]->cycles() / n;
+    // issue includes the load and store parts, shown separately
+    if (stages[i] == &ctissue) c -= (ctissueload.cycles() + ctissuestore.cycles()) / n;
+    accounted += c;
+    sb << "  ", padstring(stage_names[i], -12), floatstring(c, 10, 1), floatstring(percent(c, total), 7, 1), "%", endl;
+  }
+
+  double other = total - accounted;
+  sb << "  ", padstring("other", -12), floatstring(other, 10, 1), floatstring(percent(other, total), 7, 1), "%", endl;
+
+  sb << "Issue by uop class:", endl;
+  foreach (i, OPCLASS_COUNT) {
+    if (!profile_issue_cycles[i]) continue;
+    double c = profile_issue_cycles[i] / n;
+    sb << "  ", padstring(opclass_names[i], -12), floatstring(c, 10, 1), floatstring(percent(c, total), 7, 1), "%", endl;
+  }
 }
 
 //
@@ -1935,7 +2250,23 @@ void OutOfOrderMachine::flush_all_pipelines() {
   }  
 }
 
-OutOfOrderMachine ooomodel("ooo");
+#ifndef OOOCORE_FAST
+//
+// Functional units and latency of a uop on this core, for
+// decode_code_buffer(), which has no core of its own
+//
+void uop_fu_info(int opcode, W16& fu, byte& latency) {
+  const FunctionalUnitInfo& info = fuinfo[opcode];
+  fu = info.fu;
+  latency = info.latency;
+}
+#endif
+
+#ifdef OOOCORE_FAST
+static OutOfOrderMachine ooomodel("ooofast");
+#else
+static OutOfOrderMachine ooomodel("ooo");
+#endif
 
 OutOfOrderCore& OutOfOrderModel::coreof(int coreid) {
   return *ooomodel.cores[coreid];
@@ -10,9 +10,26 @@
 #ifndef _OOOCORE_H_
 #define _OOOCORE_H_
 
+//
+// The core is built twice: the "ooo" core with all logging, event
+// logging and checks, and the "ooofast" core (OOOCORE_FAST, in the
+// *-fast.o objects) with all of them compiled out. The latter lives
+// in its own namespace so both can be linked into one binary.
+//
+#ifdef OOOCORE_FAST
+#define OutOfOrderModel OutOfOrderModelFast
+#else
 // With these disabled, simulation is faster
 #define ENABLE_CHECKS
 #define ENABLE_LOGGING
+#define ENABLE_EVENT_LOG
+#endif
+
+#ifdef ENABLE_EVENT_LOG
+#define event_logable() (unlikely (config.event_log_enabled))
+#else
+#define event_logable() (0)
+#endif
 
 //
 // Enable SMT operation:
@@ -35,16 +52,11 @@ static const int MAX_THREADS_PER_CORE = 2;
 static const int MAX_THREADS_PER_CORE = 1;
 #endif
 
-//#define ENABLE_SIM_TIMING
-#ifdef ENABLE_SIM_TIMING
-#define time_this_scope(ct) CycleTimerScope ctscope(ct)
-#define start_timer(ct) ct.start()
-#define stop_timer(ct) ct.stop()
-#else
-#define time_this_scope(ct) (0)
-#define start_timer(ct) (0)
-#define stop_timer(ct) (0)
-#endif
+//
+// Per-stage host timers: these only run in the cycles sampled by -profile
+// (see ProfileScope), so they cost one branch per stage otherwise.
+//
+#define time_this_scope(ct) ProfileScope ctscope((ct).total)
 
 #define per_context_ooocore_stats_ref(vcpuid) (*(((PerContextOutOfOrderCoreStats*)&stats.ooocore.vcpu0) + (vcpuid)))
 #define per_context_ooocore_stats_update(vcpuid, expr) stats.ooocore.total.expr, per_context_ooocore_stats_ref(vcpuid).expr
@@ -664,11 +676,15 @@ namespace OutOfOrderModel {
   // This same structure is used to represent both dispatched but not yet issued 
   // uops as well as issued uops.
   //
+  // The fields the frontend, complete, transfer and writeback stages touch
+  // every cycle for each uop in flight come first, so together with the list
+  // link they fill the first cache line of the (cache line aligned) entry.
+  // The operands and the uop itself are only needed when the uop dispatches,
+  // issues or commits; the load/store state is needed even less often.
+  //
   struct ReorderBufferEntry: public selfqueuelink {
-    FetchBufferEntry uop;
     struct StateList* current_state_list;
     PhysicalRegister* physreg;
-    PhysicalRegister* operands[MAX_OPERANDS];
     LoadStoreQueueEntry* lsq;
     W16s idx;
     W16s cycles_left; // execution latency counter, decremented every cycle when executing
@@ -682,15 +698,23 @@ namespace OutOfOrderModel {
     W8   threadid;
     byte fu;
     byte consumer_count;
+    byte entry_valid:1, load_store_second_phase:1, all_consumers_off_bypass:1, dest_renamed_before_writeback:1, no_branches_between_renamings:1, transient:1, lock_acquired:1, issued:1;
+
+    PhysicalRegister* operands[MAX_OPERANDS];
+    // Bit i set: operand i is the high half of a vec128 physreg
+    byte hi_operands;
+    FetchBufferEntry uop;
+
     PTEUpdate pteupdate;
+    byte tlb_walk_level;
     Waddr origvirt; // original virtual address, with low bits
     Waddr virtpage; // virtual page number actually accessed by the load or store
-    byte entry_valid:1, load_store_second_phase:1, all_consumers_off_bypass:1, dest_renamed_before_writeback:1, no_branches_between_renamings:1, transient:1, lock_acquired:1, issued:1;
-    byte tlb_walk_level;
 
     int index() const { return idx; }
     void validate() { entry_valid = true; }
 
+    W64 operand_data(int i) const;
+
     void changestate(StateList& newqueue, bool place_at_head = false, ReorderBufferEntry* prevrob = null) {
       if (current_state_list)
         current_state_list->remove(this);
@@ -737,7 +761,7 @@ namespace OutOfOrderModel {
 
     ThreadContext& getthread() const;
     issueq_tag_t get_tag();
-  };
+  } alignto(64);
 
   void decode_tag(issueq_tag_t tag, int& threadid, int& idx) {
     threadid = tag >> MAX_ROB_IDX_BIT;
@@ -816,13 +840,14 @@ namespace OutOfOrderModel {
   struct PhysicalRegister: public selfqueuelink {
     ReorderBufferEntry* rob;
     W64 data;
+    W64 datahi; // high half of a vec128 uop's result
     W16 flags;
     W16 idx;
     W8  coreid;
     W8  rfid;
     W8  state;
     W8  archreg;
-    W8  all_consumers_sourced_from_bypass:1;
+    W8  all_consumers_sourced_from_bypass:1, vec128:1;
     W16s refcount;
     W8 threadid;
 
@@ -871,6 +896,7 @@ namespace OutOfOrderModel {
       refcount = 0;
       threadid = 0xff;
       all_consumers_sourced_from_bypass = 1;
+      vec128 = 0;
     }
 
   private:
@@ -934,6 +960,10 @@ namespace OutOfOrderModel {
     void reset();
   };
 
+  inline W64 ReorderBufferEntry::operand_data(int i) const {
+    return (bit(hi_operands, i)) ? operands[i]->datahi : operands[i]->data;
+  }
+
   static inline ostream& operator <<(ostream& os, const PhysicalRegisterFile& physregs) {
     return physregs.print(os);
   }
@@ -989,6 +1019,34 @@ namespace OutOfOrderModel {
 
   struct OutOfOrderMachine;
 
+  //
+  // Everything that changes when any part of the core makes
+  // forward progress (state list populations, fetch position,
+  // miss buffer states, ...), but not the miss buffer countdowns.
+  // Two equal signatures around a cycle mean that cycle did
+  // nothing but wait for outstanding misses.
+  //
+  struct ActivitySignature {
+    static const int MAX_WORDS = 1024;
+    W64 words[MAX_WORDS];
+    int count;
+
+    void reset() { count = 0; }
+
+    void add(W64 value) {
+      assert(count < MAX_WORDS);
+      words[count++] = value;
+    }
+
+    bool operator ==(const ActivitySignature& sig) const {
+      if (count != sig.count) return false;
+      foreach (i, count) {
+        if (words[i] != sig.words[i]) return false;
+      }
+      return true;
+    }
+  };
+
   struct OutOfOrderCoreCacheCallbacks: public CacheSubsystem::PerCoreCacheCallbacks {
     OutOfOrderCore& core;
     OutOfOrderCoreCacheCallbacks(OutOfOrderCore& core_): core(core_) { }
@@ -1372,6 +1430,10 @@ namespace OutOfOrderModel {
   static const int ICACHE_FETCH_GRANULARITY = 16;
   // Deadlock timeout: if nothing dispatches for this many cycles, flush the pipeline
   static const int DISPATCH_DEADLOCK_COUNTDOWN_CYCLES = 256;
+  // Deadlock watchdog: if nothing commits for this many cycles, stop the simulation
+  static const int COMMIT_DEADLOCK_TIMEOUT_CYCLES = 4096;
+  // Idle cycle skipping only pays off if the next event is at least this far away
+  static const int MIN_IDLE_CYCLES_TO_SKIP = 16;
   // Size of unaligned predictor Bloom filter
   static const int UNALIGNED_PREDICTOR_SIZE = 4096;
 
@@ -1410,6 +1472,34 @@ namespace OutOfOrderModel {
     Queue<ReorderBufferEntry, ROB_SIZE> ROB;
 
     Queue<LoadStoreQueueEntry, LSQ_SIZE> LSQ;
+
+    //
+    // Store queue index: what the load and store issue searches need
+    // to know about each LSQ slot, as a flat address array and bitmaps
+    // so all older stores can be checked at once instead of walking
+    // the LSQ backwards. Must be refreshed with update_stq_index()
+    // whenever store, lfence, sfence, addrvalid or physaddr change.
+    //
+    W64 stq_physaddr[LSQ_SIZE];         // physaddr of stores (not fences) with a known address, else STQ_NO_ADDRESS
+    bitvec<LSQ_SIZE> stq_unresolved;    // stores (not fences) whose address is still unknown
+    bitvec<LSQ_SIZE> stq_lfence;        // lfence/mfence uops not yet at the head of the LSQ
+    bitvec<LSQ_SIZE> stq_sfence;        // sfence/mfence uops not yet at the head of the LSQ
+
+    static const W64 STQ_NO_ADDRESS = W64(-1); // physaddr is only 45 bits, so this never matches
+
+    void update_stq_index(const LoadStoreQueueEntry& lsq) {
+      int i = lsq.index();
+      bool pending = lsq.store & (!lsq.addrvalid);
+      bool fence = lsq.lfence | lsq.sfence;
+      stq_physaddr[i] = (lsq.store & lsq.addrvalid & (!fence)) ? W64(lsq.physaddr) : STQ_NO_ADDRESS;
+      stq_unresolved[i] = pending & (!fence);
+      stq_lfence[i] = pending & lsq.lfence;
+      stq_sfence[i] = pending & lsq.sfence;
+    }
+
+    bitvec<LSQ_SIZE> match_stq_physaddr(W64 physaddr) const;
+    LoadStoreQueueEntry* find_youngest_older(const LoadStoreQueueEntry& lsq, const bitvec<LSQ_SIZE>& hits);
+
     RegisterRenameTable specrrt;
     RegisterRenameTable commitrrt;
 
@@ -1652,6 +1742,13 @@ namespace OutOfOrderModel {
     // Callbacks
     void flush_tlb(Context& ctx, int threadid, bool selective = false, Waddr virtaddr = 0);
 
+    // Idle cycle skipping
+    bool quiescent();
+    void capture_activity(ActivitySignature& sig);
+    W64 cycles_to_next_event(W64s limit = 0);
+    W64 idle_cycles_until_next_event();
+    void skip_idle_cycles(W64 cycles);
+
     // Debugging
     void dump_smt_state(ostream& os);
     void print_smt_state(ostream& os);
@@ -1664,6 +1761,9 @@ namespace OutOfOrderModel {
   struct OutOfOrderMachine: public PTLsimMachine {
     OutOfOrderCore* cores[MAX_SMT_CORES];
     bitvec<MAX_CONTEXTS> stopped;
+    ActivitySignature activity_before;
+    ActivitySignature activity_after;
+    bool idle_in_last_cycle;
     OutOfOrderMachine(const char* name);
     virtual bool init(PTLsimConfig& config);
     virtual int run(PTLsimConfig& config);
@@ -1672,6 +1772,31 @@ namespace OutOfOrderModel {
     virtual void flush_tlb(Context& ctx);
     virtual void flush_tlb_virt(Context& ctx, Waddr virtaddr);
     void flush_all_pipelines();
+    void skip_idle_cycles(OutOfOrderCore& core, const PTLsimStats& template_stats, bool running);
+    void print_profile(stringbuf& sb);
+  };
+
+  //
+  // With -profile <N>, every Nth cycle is timed stage by stage with rdtsc.
+  // profile_this_cycle is set for the duration of such a cycle; each scope
+  // then adds the host cycles it took to its counter.
+  //
+  extern bool profile_this_cycle;
+  extern W64 profiled_cycles;
+  extern W64 profile_issue_cycles[OPCLASS_COUNT];
+
+  struct ProfileScope {
+    W64* total;
+    W64 start;
+
+    ProfileScope(W64& counter) {
+      total = (profile_this_cycle) ? &counter : null;
+      if unlikely (total) start = rdtsc();
+    }
+
+    ~ProfileScope() {
+      if unlikely (total) *total += rdtsc() - start;
+    }
   };
 
   extern CycleTimer cttotal;
@@ -2035,6 +2160,10 @@ struct OutOfOrderCoreStats { // rootnode:
 
   struct simulator {
     double total_time;
+    W64 idle_cycles_skipped;
+    // Cycles timed by -profile, and the host cycles spent issuing uops of each class in them
+    W64 profiled_cycles;
+    W64 issue_host_cycles[OPCLASS_COUNT]; // label: opclass_names
     struct cputime { // node: summable
       double fetch;
       double decode;
@@ -120,7 +120,7 @@ bool IssueQueue<size, operandcount>::insert(tag_t uopid, const tag_t* operands,
 
 template <int size, int operandcount>
 void IssueQueue<size, operandcount>::tally_broadcast_matches(IssueQueue<size, operandcount>::tag_t sourceid, const bitvec<size>& mask, int operand) const {
-  if likely (!config.event_log_enabled) return;
+  if likely (!event_logable()) return;
 
   OutOfOrderCore& core = getcore();
   int threadid, rob_idx;
@@ -166,7 +166,7 @@ bool IssueQueue<size, operandcount>::broadcast(tag_t uopid) {
   if (logable(6)) {
     foreach (operand, operandcount) {
       bitvec<size> mask = tags[operand].invalidate(tagvec);
-      if unlikely (config.event_log_enabled) tally_broadcast_matches(uopid, mask, operand);
+      if (event_logable()) tally_broadcast_matches(uopid, mask, operand);
     }
   } else {
     foreach (operand, operandcount) tags[operand].invalidate(tagvec);
@@ -282,7 +282,7 @@ int ReorderBufferEntry::issue() {
 
   // Are any FUs available in this cycle?
   if unlikely (!executable_on_fu) {
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event = core.eventlog.add(EVENT_ISSUE_NO_FU, this);
       event->issue.fu_avail = core.fu_avail;
     }
@@ -319,9 +319,9 @@ int ReorderBufferEntry::issue() {
   IssueState state;
   state.reg.rdflags = 0;
 
-  W64 radata = ra.data;
-  W64 rbdata = (uop.rb == REG_imm) ? uop.rbimm : rb.data;
-  W64 rcdata = (uop.rc == REG_imm) ? uop.rcimm : rc.data;
+  W64 radata = operand_data(RA);
+  W64 rbdata = (uop.rb == REG_imm) ? uop.rbimm : operand_data(RB);
+  W64 rcdata = (uop.rc == REG_imm) ? uop.rcimm : operand_data(RC);
 
   bool ld = isload(uop.opcode);
   bool st = isstore(uop.opcode);
@@ -350,8 +350,10 @@ int ReorderBufferEntry::issue() {
     per_physregfile_stats_update(stats.ooocore.issue.source, rc.rfid, [rc.state]++);
   }
 
+  W16 rsflags = (uop.vec128) ? operands[RS]->flags : 0;
+
   bool propagated_exception = 0;
-  if unlikely ((ra.flags | rb.flags | rc.flags) & FLAG_INV) {
+  if unlikely ((ra.flags | rb.flags | rc.flags | rsflags) & FLAG_INV) {
     //
     // Invalid data propagated through operands: mark output as
     // invalid and don't even execute the uop at all.
@@ -389,6 +391,18 @@ int ReorderBufferEntry::issue() {
       }
     } else if unlikely (uop.opcode == OP_ld_pre) {
       issueprefetch(state, radata, rbdata, rcdata, uop.cachelevel);
+    } else if unlikely (uop.vec128) {
+      //
+      // Both halves at once: rc and rs hold the high halves of ra and rb,
+      // and each half sees zero as its own rc.
+      //
+      W64 rbhidata = (uop.rb == REG_imm) ? uop.rbimm : operand_data(RS);
+      IssueState hi;
+      hi.reg.rdflags = 0;
+      uop.synthop(state, radata, rbdata, 0, ra.flags, rb.flags, 0);
+      uop.synthop(hi, rcdata, rbhidata, 0, rc.flags, rsflags, 0);
+      physreg->datahi = hi.reg.rddata;
+      if unlikely ((hi.reg.rdflags & FLAG_INV) && !(state.reg.rdflags & FLAG_INV)) state.reg = hi.reg;
     } else {
       if unlikely (br) {
         state.brreg.riptaken = uop.riptaken;
@@ -434,7 +448,7 @@ int ReorderBufferEntry::issue() {
 
   bool mispredicted = (physreg->data != uop.riptaken);
 
-  if unlikely (config.event_log_enabled && (propagated_exception | (!(ld|st)))) {
+  if (event_logable() && (propagated_exception | (!(ld|st)))) {
     event = core.eventlog.add(EVENT_ISSUE_OK, this);
     event->issue.state = state;
     event->issue.cycles_left = cycles_left;
@@ -626,7 +640,7 @@ bool ReorderBufferEntry::handle_common_load_store_exceptions(LoadStoreQueueEntry
   state.data = exception | ((W64)pfec << 32);
   state.datavalid = 1;
 
-  if unlikely (config.event_log_enabled) core.eventlog.add_load_store((st) ? EVENT_STORE_EXCEPTION : EVENT_LOAD_EXCEPTION, this, null, addr);
+  if (event_logable()) core.eventlog.add_load_store((st) ? EVENT_STORE_EXCEPTION : EVENT_LOAD_EXCEPTION, this, null, addr);
 
   if unlikely (exception == EXCEPTION_UnalignedAccess) {
     //
@@ -636,7 +650,7 @@ bool ReorderBufferEntry::handle_common_load_store_exceptions(LoadStoreQueueEntry
     // of the x86 macro-op. The frontend will then split the uop into
     // low and high parts as it is refetched.
     //
-    if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_ALIGNMENT_FIXUP, this, null, addr);
+    if (event_logable()) core.eventlog.add_load_store(EVENT_ALIGNMENT_FIXUP, this, null, addr);
 
     core.set_unaligned_hint(uop.rip, 1);
 
@@ -694,7 +708,7 @@ bool ReorderBufferEntry::release_mem_lock(bool forced) {
   OutOfOrderCore& core = getcore();
   ThreadContext& thread = getthread();
  
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     OutOfOrderCoreEvent* event = core.eventlog.add_load_store((forced) ? EVENT_STORE_LOCK_ANNULLED : EVENT_STORE_LOCK_RELEASED, this, null, physaddr);
     event->loadstore.locking_vcpuid = lock->vcpuid;
     event->loadstore.locking_uuid = lock->uuid;
@@ -754,6 +768,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
   Waddr physaddr = addrgen(state, origaddr, virtpage, ra, rb, rc, pteupdate, addr, exception, pfec, annul);
 
   if unlikely (exception) {
+    thread.update_stq_index(state);
     return (handle_common_load_store_exceptions(state, origaddr, addr, exception, pfec)) ? ISSUE_COMPLETED : ISSUE_MISSPECULATED;
   }
 
@@ -778,44 +793,21 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
   // of the ROB and LSQ; only at that point can future loads and stores issue.
   //
   // All memory fences are considered stores, since in this way both loads and
-  // stores can depend on them using the rs dependency.
+  // stores can depend on them using the rs dependency. Fences never match by
+  // address, and stores can always pass load fences (stq_sfence only holds
+  // mf.sfence and mf.mfence).
+  //
+  // If the address of an older store is unknown, it must still be treated as
+  // a match: stores to a given word must issue in program order to composite
+  // data correctly, but we can't do that without the address.
   //
 
-  LoadStoreQueueEntry* sfra = null;
-
-  foreach_backward_before(LSQ, lsq, i) {
-    LoadStoreQueueEntry& stbuf = LSQ[i];
-
-    // Skip over loads (we only care about the store queue subset):
-    if likely (!stbuf.store) continue;
-
-    if likely (stbuf.addrvalid) {
-
-      // Only considered a match if it's not a fence (which doesn't match anything)
-      if unlikely (stbuf.lfence | stbuf.sfence) continue;
-
-      if (stbuf.physaddr == state.physaddr) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.stq_address_match++);
-        sfra = &stbuf;
-        break;
-      }
-    } else {
-      //
-      // Address is unknown: stores to a given word must issue in program order
-      // to composite data correctly, but we can't do that without the address.
-      //
-      // This also catches any unresolved store fences (but not load fences).
-      //
+  thread.update_stq_index(state);
 
-      if unlikely (stbuf.lfence & !stbuf.sfence) {
-        // Stores can always pass load fences
-        continue;
-      }
+  LoadStoreQueueEntry* sfra = thread.find_youngest_older(state,
+    thread.match_stq_physaddr(state.physaddr) | thread.stq_unresolved | thread.stq_sfence);
 
-      sfra = &stbuf;
-      break;
-    }
-  }
+  if (sfra && sfra->addrvalid) per_context_ooocore_stats_update(threadid, dcache.load.dependency.stq_address_match++);
 
   if (sfra && sfra->addrvalid && sfra->datavalid) {
     assert(sfra->physaddr == state.physaddr);
@@ -852,7 +844,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
   //
 
   if unlikely (!ready) {
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event = core.eventlog.add_load_store(EVENT_STORE_WAIT, this, sfra, addr);
       event->loadstore.rcready = rcready;
     }
@@ -929,7 +921,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
       }
 
       if unlikely (parallel_forwarding_match) {
-        if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_STORE_PARALLEL_FORWARDING_MATCH, this, &ldbuf, addr);
+        if (event_logable()) event = core.eventlog.add_load_store(EVENT_STORE_PARALLEL_FORWARDING_MATCH, this, &ldbuf, addr);
         per_context_ooocore_stats_update(threadid, dcache.store.issue.replay.parallel_aliasing++);
 
         replay();
@@ -940,7 +932,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
       state.data = EXCEPTION_LoadStoreAliasing;
       state.datavalid = 1;
 
-      if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_STORE_ALIASED_LOAD, this, &ldbuf, addr);
+      if (event_logable()) event = core.eventlog.add_load_store(EVENT_STORE_ALIASED_LOAD, this, &ldbuf, addr);
 
       // Add the rip to the load to the load/store alias predictor:
       lsap.select(ldbuf.rob->uop.rip);
@@ -985,7 +977,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
       // locked block. We must replay the store until the block
       // becomes unlocked.
       //
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         event = core.eventlog.add_load_store(EVENT_STORE_LOCK_REPLAY, this, null, addr);
         event->loadstore.locking_vcpuid = lock->vcpuid;
         event->loadstore.locking_uuid = lock->uuid;
@@ -1031,7 +1023,7 @@ int ReorderBufferEntry::issuestore(LoadStoreQueueEntry& state, Waddr& origaddr,
   per_context_ooocore_stats_update(threadid, dcache.store.forward.sfr += (sfra != null));
   per_context_ooocore_stats_update(threadid, dcache.store.datatype[uop.datatype]++);
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     event = core.eventlog.add_load_store(EVENT_STORE_ISSUED, this, sfra, addr);
     event->loadstore.data_to_store = rc;
   }
@@ -1115,44 +1107,21 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
   // of the ROB and LSQ; only at that point can future loads and stores issue.
   //
   // All memory fence are considered stores, since in this way both loads and
-  // stores can depend on them using the rs dependency.
+  // stores can depend on them using the rs dependency. Fences never match by
+  // address, and loads can always pass store fences (stq_lfence only holds
+  // mf.lfence and mf.mfence). Older stores with an unknown address only count
+  // if this load is known to alias with them, and therefore cannot be hoisted.
   //
 
-  foreach_backward_before(LSQ, lsq, i) {
-    LoadStoreQueueEntry& stbuf = LSQ[i];
-    
-    // Skip over loads (we only care about the store queue subset):
-    if likely (!stbuf.store) continue;
+  bitvec<LSQ_SIZE> hits = thread.match_stq_physaddr(state.physaddr) | thread.stq_lfence;
+  if (load_is_known_to_alias_with_store) hits |= thread.stq_unresolved;
 
-    if likely (stbuf.addrvalid) {
-      // Only considered a match if it's not a fence (which doesn't match anything)
-      if unlikely (stbuf.lfence | stbuf.sfence) continue;
+  sfra = thread.find_youngest_older(state, hits);
 
-      if (stbuf.physaddr == state.physaddr) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.stq_address_match++);
-        sfra = &stbuf;
-        break;
-      }
-    } else {
-      // Address is unknown: is it a memory fence that hasn't committed?
-      if unlikely (stbuf.lfence) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.fence++);
-        sfra = &stbuf;
-        break;
-      }
-
-      if unlikely (stbuf.sfence) {
-        // Loads can always pass store fences
-        continue;
-      }
-
-      // Is this load known to alias with prior stores, and therefore cannot be hoisted?
-      if unlikely (load_is_known_to_alias_with_store) {
-        per_context_ooocore_stats_update(threadid, dcache.load.dependency.predicted_alias_unresolved++);
-        sfra = &stbuf;
-        break;
-      }
-    }
+  if (sfra) {
+    per_context_ooocore_stats_update(threadid, dcache.load.dependency.stq_address_match += sfra->addrvalid);
+    per_context_ooocore_stats_update(threadid, dcache.load.dependency.fence += ((!sfra->addrvalid) & sfra->lfence));
+    per_context_ooocore_stats_update(threadid, dcache.load.dependency.predicted_alias_unresolved += ((!sfra->addrvalid) & (!sfra->lfence)));
   }
 
   per_context_ooocore_stats_update(threadid, dcache.load.dependency.independent += (sfra == null));
@@ -1192,7 +1161,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
 
     assert(sfra);
 
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event = core.eventlog.add_load_store(EVENT_LOAD_WAIT, this, sfra, addr);
       event->loadstore.predicted_alias = (load_is_known_to_alias_with_store && sfra && (!sfra->addrvalid));
     }
@@ -1221,7 +1190,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     // as well use it.
     //
     if unlikely ((prevaddr != state.physaddr) && (lowbits(prevaddr, log2(CacheSubsystem::L1_DCACHE_BANKS)) == lowbits(state.physaddr, log2(CacheSubsystem::L1_DCACHE_BANKS)))) {
-      if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_LOAD_BANK_CONFLICT, this, null, addr);
+      if (event_logable()) core.eventlog.add_load_store(EVENT_LOAD_BANK_CONFLICT, this, null, addr);
       per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.bank_conflict++);
 
       replay();
@@ -1236,7 +1205,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
   // control logic to avoid replays once we pass this point.
   //
   if unlikely (core.caches.lfrq_or_missbuf_full()) {
-    if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_LOAD_LFRQ_FULL, this, null, addr);
+    if (event_logable()) core.eventlog.add_load_store(EVENT_LOAD_LFRQ_FULL, this, null, addr);
     per_context_ooocore_stats_update(threadid, dcache.load.issue.replay.missbuf_full++);
 
     replay();
@@ -1271,7 +1240,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
       // Some other thread or core has locked up this word: replay
       // the uop until it becomes unlocked.
       //
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         event = core.eventlog.add_load_store(EVENT_LOAD_LOCK_REPLAY, this, null, addr);
         event->loadstore.locking_vcpuid = lock->vcpuid;
         event->loadstore.locking_uuid = lock->uuid;
@@ -1319,7 +1288,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
         // is two. As long as the lock buffer associativity is
         // bigger than this, we will eventually get an entry.
         //
-        if unlikely (config.event_log_enabled) {
+        if (event_logable()) {
           core.eventlog.add_load_store(EVENT_LOAD_LOCK_OVERFLOW, this, null, addr);
         }
 
@@ -1334,7 +1303,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
       lock->threadid = threadid;
       lock_acquired = 1;
       
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         core.eventlog.add_load_store(EVENT_LOAD_LOCK_ACQUIRED, this, null, addr);
       }
     }
@@ -1381,7 +1350,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
       state.invalid = 0;
       state.datavalid = 1;
 
-      if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_LOAD_HIGH_ANNULLED, this, sfra, addr);
+      if (event_logable()) core.eventlog.add_load_store(EVENT_LOAD_HIGH_ANNULLED, this, sfra, addr);
 
       return ISSUE_COMPLETED;
     }
@@ -1412,7 +1381,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
   if unlikely (uop.internal) {
     cycles_left = LOADLAT;
 
-    if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_LOAD_HIT, this, sfra, addr);
+    if (event_logable()) core.eventlog.add_load_store(EVENT_LOAD_HIT, this, sfra, addr);
 
     load_store_second_phase = 1;
     state.datavalid = 1;
@@ -1430,7 +1399,7 @@ int ReorderBufferEntry::issueload(LoadStoreQueueEntry& state, Waddr& origaddr, W
     //
     // TLB miss: 
     //
-    if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_LOAD_TLB_MISS, this, sfra, addr);
+    if (event_logable()) event = core.eventlog.add_load_store(EVENT_LOAD_TLB_MISS, this, sfra, addr);
     cycles_left = 0;
     tlb_walk_level = thread.ctx.page_table_level_count();
     changestate(thread.rob_tlb_miss_list);
@@ -1464,7 +1433,7 @@ int ReorderBufferEntry::probecache(Waddr addr, LoadStoreQueueEntry* sfra) {
   if likely (L1hit) {    
     cycles_left = LOADLAT;
 
-    if unlikely (config.event_log_enabled) core.eventlog.add_load_store(EVENT_LOAD_HIT, this, sfra, addr);
+    if (event_logable()) core.eventlog.add_load_store(EVENT_LOAD_HIT, this, sfra, addr);
     
     load_store_second_phase = 1;
     state.datavalid = 1;
@@ -1498,7 +1467,7 @@ int ReorderBufferEntry::probecache(Waddr addr, LoadStoreQueueEntry* sfra) {
   lfrqslot = core.caches.issueload_slowpath(physaddr, dummysfr, lsi);
   assert(lfrqslot >= 0);
 
-  if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_LOAD_MISS, this, sfra, addr);
+  if (event_logable()) event = core.eventlog.add_load_store(EVENT_LOAD_MISS, this, sfra, addr);
 
   return ISSUE_COMPLETED;
 }
@@ -1522,12 +1491,12 @@ void ReorderBufferEntry::tlbwalk() {
       // This is required because the load or store cannot be replayed if no MB
       // entries are free (since the uop already left the scheduler).
       //
-      if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_NO_LFRQ_MB, this, null, 0);
+      if (event_logable()) event = core.eventlog.add_load_store(EVENT_TLBWALK_NO_LFRQ_MB, this, null, 0);
       per_context_dcache_stats_update(threadid, load.tlbwalk.no_lfrq_mb++);
       return;
     }
 
-    if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_COMPLETE, this, null, virtaddr);
+    if (event_logable()) event = core.eventlog.add_load_store(EVENT_TLBWALK_COMPLETE, this, null, virtaddr);
     core.caches.dtlb.insert(virtaddr, threadid);
 
     if unlikely (isprefetch(uop.opcode)) {
@@ -1555,7 +1524,7 @@ void ReorderBufferEntry::tlbwalk() {
     //
     // The PTE was in the cache: directly proceed to the next level
     //
-    if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_HIT, this, null, pteaddr);
+    if (event_logable()) event = core.eventlog.add_load_store(EVENT_TLBWALK_HIT, this, null, pteaddr);
     per_context_dcache_stats_update(threadid, load.tlbwalk.L1_dcache_hit++);
 
     tlb_walk_level--;
@@ -1575,7 +1544,7 @@ void ReorderBufferEntry::tlbwalk() {
   // TODO: For prefetches, we might want to drop the TLB miss!
   //
   if (lfrqslot < 0) {
-    if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_NO_LFRQ_MB, this, null, pteaddr);
+    if (event_logable()) event = core.eventlog.add_load_store(EVENT_TLBWALK_NO_LFRQ_MB, this, null, pteaddr);
     per_context_dcache_stats_update(threadid, load.tlbwalk.no_lfrq_mb++);
     return;
   }
@@ -1583,7 +1552,7 @@ void ReorderBufferEntry::tlbwalk() {
   cycles_left = 0;
   changestate(thread.rob_cache_miss_list);
 
-  if unlikely (config.event_log_enabled) event = core.eventlog.add_load_store(EVENT_TLBWALK_MISS, this, null, pteaddr);
+  if (event_logable()) event = core.eventlog.add_load_store(EVENT_TLBWALK_MISS, this, null, pteaddr);
   per_context_dcache_stats_update(threadid, load.tlbwalk.L1_dcache_miss++);
 }
 
@@ -1607,25 +1576,60 @@ LoadStoreQueueEntry* ReorderBufferEntry::find_nearest_memory_fence() {
   bool ld = isload(uop.opcode);
   bool st = (uop.opcode == OP_st);
 
-  foreach_backward_before(thread.LSQ, lsq, i) {
-    LoadStoreQueueEntry& stbuf = thread.LSQ[i];
-    
-    // Skip over everything except fences
-    if unlikely (!(stbuf.lfence | stbuf.sfence)) continue;
-    
-    // Skip over fences that have already completed
-    if unlikely (stbuf.addrvalid) continue;
-    
-    // Do not allow loads to pass lfence or mfence
-    // Do not allow stores to pass sfence or mfence
-    bool match = (ld) ? stbuf.lfence : (st) ? stbuf.sfence : 0;
-    if unlikely (match) return &stbuf;
-    
-    // Loads can always pass store fences
-    // Stores can always pass load fences
+  // Do not allow loads to pass lfence or mfence
+  // Do not allow stores to pass sfence or mfence
+  // Loads can always pass store fences
+  // Stores can always pass load fences
+  if unlikely (!(ld | st)) return null;
+
+  return thread.find_youngest_older(*lsq, (ld) ? thread.stq_lfence : thread.stq_sfence);
+}
+
+//
+// Compare physaddr against every entry of the store queue index at once:
+// returns the LSQ slots of the stores (not fences) to that 8-byte chunk.
+//
+bitvec<LSQ_SIZE> ThreadContext::match_stq_physaddr(W64 physaddr) const {
+  // Collect the masks a word at a time, then assemble the bitvec once
+  W64 words[(LSQ_SIZE + 63) / 64];
+  foreach (i, lengthof(words)) words[i] = 0;
+
+  if (((LSQ_SIZE % 8) == 0) && (host_simd_level >= HOST_SIMD_AVX2)) {
+    for (int i = 0; i < LSQ_SIZE; i += 8) {
+      W32 m = (host_simd_level >= HOST_SIMD_AVX512) ? x86_avx512_pcmpeqq_mask8(&stq_physaddr[i], physaddr) : x86_avx2_pcmpeqq_mask8(&stq_physaddr[i], physaddr);
+      words[i / 64] |= W64(m) << (i % 64);
+    }
+  } else {
+    foreach (i, LSQ_SIZE) words[i / 64] |= W64(stq_physaddr[i] == physaddr) << (i % 64);
+  }
+
+  bitvec<LSQ_SIZE> hits = 0;
+  for (int i = lengthof(words)-1; i >= 0; i--) hits = (hits << 64) | bitvec<LSQ_SIZE>(words[i]);
+
+  return hits;
+}
+
+//
+// Of the LSQ slots in hits, find the youngest one that is older than lsq
+// (i.e. the first one foreach_backward_before(LSQ, lsq, i) would reach).
+//
+LoadStoreQueueEntry* ThreadContext::find_youngest_older(const LoadStoreQueueEntry& lsq, const bitvec<LSQ_SIZE>& hits) {
+  int slot = lsq.index();
+  int head = LSQ.head;
+
+  if unlikely (slot == head) return null;
+
+  if likely (head < slot) {
+    int i = hits(head, slot - head).msb(-1);
+    return (i >= 0) ? &LSQ[head + i] : null;
   }
 
-  return null;
+  // Wrapped around: first the slots below this one, then from the head up
+  int i = (hits % slot).msb(-1);
+  if (i >= 0) return &LSQ[i];
+
+  i = (hits >> head).msb(-1);
+  return (i >= 0) ? &LSQ[head + i] : null;
 }
 
 //
@@ -1663,8 +1667,9 @@ int ReorderBufferEntry::issuefence(LoadStoreQueueEntry& state) {
   state.datavalid = 0;
   state.addrvalid = 0;
   state.physaddr = bitmask(48-3);
+  thread.update_stq_index(state);
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     event = core.eventlog.add_load_store(EVENT_FENCE_ISSUED, this);
     event->loadstore.data_to_store = 0;
   }
@@ -1711,7 +1716,7 @@ void ReorderBufferEntry::issueprefetch(IssueState& state, W64 ra, W64 rb, W64 rc
     // Note that most x86 processors will not prefetch beyond 
     // a TLB miss, so this is disabled by default.
     //
-    if unlikely (config.event_log_enabled) OutOfOrderCoreEvent* event = core.eventlog.add_load_store(EVENT_LOAD_TLB_MISS, this, null, addr);
+    if (event_logable()) OutOfOrderCoreEvent* event = core.eventlog.add_load_store(EVENT_LOAD_TLB_MISS, this, null, addr);
     cycles_left = 0;
     tlb_walk_level = thread.ctx.page_table_level_count();
     changestate(thread.rob_tlb_miss_list);
@@ -1744,12 +1749,12 @@ void OutOfOrderCoreCacheCallbacks::dcache_wakeup(LoadStoreInfo lsi, W64 physaddr
 void ReorderBufferEntry::loadwakeup() {
   if (tlb_walk_level) {
     // Wake up from TLB walk wait and move to next level
-    if unlikely (config.event_log_enabled) getcore().eventlog.add_load_store(EVENT_TLBWALK_WAKEUP, this);
+    if (event_logable()) getcore().eventlog.add_load_store(EVENT_TLBWALK_WAKEUP, this);
     lfrqslot = -1;
     changestate(getthread().rob_tlb_miss_list);
   } else {
     // Actually wake up the load
-    if unlikely (config.event_log_enabled) getcore().eventlog.add_load_store(EVENT_LOAD_WAKEUP, this);
+    if (event_logable()) getcore().eventlog.add_load_store(EVENT_LOAD_WAKEUP, this);
 
     physreg->flags &= ~FLAG_WAIT;
     physreg->complete();
@@ -1767,7 +1772,7 @@ void ReorderBufferEntry::loadwakeup() {
 void ReorderBufferEntry::fencewakeup() {
   ThreadContext& thread = getthread();
 
-  if unlikely (config.event_log_enabled) getcore().eventlog.add_commit(EVENT_COMMIT_FENCE_COMPLETED, this);
+  if (event_logable()) getcore().eventlog.add_commit(EVENT_COMMIT_FENCE_COMPLETED, this);
 
   assert(!load_store_second_phase);
   assert(current_state_list == &thread.rob_ready_to_commit_queue);
@@ -1780,6 +1785,7 @@ void ReorderBufferEntry::fencewakeup() {
   physreg->complete();
   lsq->datavalid = 1;
   lsq->addrvalid = 1;
+  thread.update_stq_index(*lsq);
   
   cycles_left = 0;
   lfrqslot = -1;
@@ -1814,7 +1820,7 @@ void ReorderBufferEntry::replay() {
   OutOfOrderCore& core = getcore();
   ThreadContext& thread = getthread();
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_REPLAY, this);
     foreach (i, MAX_OPERANDS) {
       operands[i]->fill_operand_info(event->replay.opinfo[i]);
@@ -1858,7 +1864,7 @@ void ReorderBufferEntry::replay_locked() {
   OutOfOrderCore& core = getcore();
   ThreadContext& thread = getthread();
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_REPLAY, this);
     foreach (i, MAX_OPERANDS) {
       operands[i]->fill_operand_info(event->replay.opinfo[i]);
@@ -1946,7 +1952,15 @@ int OutOfOrderCore::issue(int cluster) {
     ReorderBufferEntry& rob = thread->ROB[idx];
 
     rob.iqslot = iqslot;
-    int rc = rob.issue();
+    int rc;
+    if unlikely (profile_this_cycle) {
+      W16 opcode = rob.uop.opcode;
+      W64 t = rdtsc();
+      rc = rob.issue();
+      profile_issue_cycles[opclassof(opcode)] += rdtsc() - t;
+    } else {
+      rc = rob.issue();
+    }
     // Stop issuing from this cluster once something replays or has a mis-speculation
     issuecount++;
     if unlikely (rc <= 0) break;
@@ -1974,7 +1988,7 @@ int ReorderBufferEntry::forward() {
   W32 targets = forward_at_cycle_lut[cluster][forward_cycle];
   foreach (i, MAX_CLUSTERS) {
     if likely (!bit(targets, i)) continue;
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       OutOfOrderCoreEvent* event = getcore().eventlog.add(EVENT_BROADCAST, this);
       event->forwarding.target_cluster = i;
       event->forwarding.forward_cycle = forward_cycle;
@@ -2048,7 +2062,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
   if unlikely (startidx == ROB.tail) {
     // The uop causing the mis-speculation was the only uop in the ROB:
     // no action is necessary (but in practice this is generally not possible)
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_ANNUL_NO_FUTURE_UOPS, this);
       event->annul.somidx = somidx; event->annul.eomidx = eomidx;
     }
@@ -2062,7 +2076,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
   // For branches, branch must always terminate the macro-op
   if (keep_misspec_uop) assert(eomidx == index());
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     event = core.eventlog.add(EVENT_ANNUL_MISSPECULATION, this);
     event->annul.startidx = startidx; event->annul.endidx = endidx;
     event->annul.somidx = somidx; event->annul.eomidx = eomidx;
@@ -2140,7 +2154,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
 
     lastrob = &annulrob;
 
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event = core.eventlog.add(EVENT_ANNUL_EACH_ROB, &annulrob);
       event->annul.annulras = 0;
     }
@@ -2189,7 +2203,7 @@ W64 ReorderBufferEntry::annul(bool keep_misspec_uop, bool return_first_annulled_
       // BR mispredicts, so everything after BR must be annulled.
       // RAS contains: C1 C3 C4, so we need to annul [C4 C3].
       //
-      if unlikely (config.event_log_enabled) event->annul.annulras = 1;
+      if (event_logable()) event->annul.annulras = 1;
       branchpred.annulras(annulrob.uop.predinfo);
     }
 
@@ -2239,7 +2253,7 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
   }
   OutOfOrderCoreEvent* event;
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     event = core.eventlog.add(EVENT_REDISPATCH_EACH_ROB, this);
     event->redispatch.current_state_list = current_state_list;
     event->redispatch.dependent_operands = dependent_operands.integer();
@@ -2260,7 +2274,7 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
       }
       thread.issueq_count--;
     }
-    if unlikely (config.event_log_enabled) event->redispatch.iqslot = found;
+    if (event_logable()) event->redispatch.iqslot = found;
     cluster = -1;
   }
 
@@ -2280,6 +2294,7 @@ void ReorderBufferEntry::redispatch(const bitvec<MAX_OPERANDS>& dependent_operan
     lsq->data = 0;
     lsq->physaddr = 0;
     lsq->invalid = 0;
+    thread.update_stq_index(*lsq);
 
     if (operands[RS]->nonnull()) {
       operands[RS]->unref(*this, thread.threadid);
@@ -2314,7 +2329,7 @@ void ReorderBufferEntry::redispatch_dependents(bool inclusive) {
   depmap[index()] = 1;
 
   OutOfOrderCoreEvent* event;
-  if unlikely (config.event_log_enabled) event = core.eventlog.add(EVENT_REDISPATCH_DEPENDENTS, this);
+  if (event_logable()) event = core.eventlog.add(EVENT_REDISPATCH_DEPENDENTS, this);
 
   //
   // Go through the ROB and identify the slice of all uops
@@ -2364,7 +2379,7 @@ void ReorderBufferEntry::redispatch_dependents(bool inclusive) {
   assert(inrange(count, 1, ROB_SIZE));
   per_context_ooocore_stats_update(threadid, dispatch.redispatch.dependent_uops[count-1]++);
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     event = core.eventlog.add(EVENT_REDISPATCH_DEPENDENTS_DONE, this);
     event->redispatch.count = count;
   }
@@ -2377,12 +2392,18 @@ int ReorderBufferEntry::pseudocommit() {
   RegisterRenameTable& specrrt = thread.specrrt;
   RegisterRenameTable& commitrrt = thread.commitrrt;
 
-  if unlikely (config.event_log_enabled) core.eventlog.add(EVENT_ANNUL_PSEUDOCOMMIT, this);
+  if (event_logable()) core.eventlog.add(EVENT_ANNUL_PSEUDOCOMMIT, this);
 
   if likely (archdest_can_commit[uop.rd]) {
     specrrt[uop.rd]->unspecref(uop.rd, thread.threadid);
     specrrt[uop.rd] = physreg;
     specrrt[uop.rd]->addspecref(uop.rd, thread.threadid);
+
+    if unlikely (uop.vec128) {
+      specrrt[uop.rd + 1]->unspecref(uop.rd + 1, thread.threadid);
+      specrrt[uop.rd + 1] = physreg;
+      specrrt[uop.rd + 1]->addspecref(uop.rd + 1, thread.threadid);
+    }
   }
 
   if likely (!uop.nouserflags) {
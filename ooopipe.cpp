@@ -77,7 +77,7 @@ void ThreadContext::annul_fetchq() {
   foreach_backward (fetchq, i) {
     FetchBufferEntry& fetchbuf = fetchq[i];
     if unlikely (isbranch(fetchbuf.opcode) && (fetchbuf.predinfo.bptype & (BRANCH_HINT_CALL|BRANCH_HINT_RET))) {
-      if unlikely (config.event_log_enabled) core.eventlog.add(EVENT_ANNUL_FETCHQ_RAS, fetchbuf);
+      if (event_logable()) core.eventlog.add(EVENT_ANNUL_FETCHQ_RAS, fetchbuf);
       branchpred.annulras(fetchbuf.predinfo);
     }
   }
@@ -131,7 +131,7 @@ void ThreadContext::flush_pipeline() {
     flush_mem_lock_release_list();
     rob.physreg->reset(threadid); // free all register allocated by rob
 
-    if unlikely (config.event_log_enabled)
+    if (event_logable())
       core.eventlog.add(EVENT_ANNUL_FLUSH, &rob);
 
   }
@@ -389,7 +389,7 @@ bool ThreadContext::fetch() {
   OutOfOrderCoreEvent* event;
 
   if unlikely (stall_frontend) {
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event = eventlog.add(EVENT_FETCH_STALLED);
       event->threadid = threadid;
     }
@@ -398,7 +398,7 @@ bool ThreadContext::fetch() {
   }
 
   if unlikely (waiting_for_icache_fill) {
-    if unlikely (config.event_log_enabled){
+    if (event_logable()){
       event = eventlog.add(EVENT_FETCH_ICACHE_WAIT);
       event->threadid = threadid;
       event->rip = fetchrip;
@@ -410,7 +410,7 @@ bool ThreadContext::fetch() {
 
   while ((fetchcount < FETCH_WIDTH) && (taken_branch_count == 0)) {
     if unlikely (!fetchq.remaining()) {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         if (!fetchcount) {
           event =  eventlog.add(EVENT_FETCH_FETCHQ_FULL);
           event->threadid = threadid;
@@ -455,7 +455,7 @@ bool ThreadContext::fetch() {
     }
 
     if unlikely (current_basic_block->invalidblock) {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         event = eventlog.add(EVENT_FETCH_BOGUS_RIP, fetchrip);
         event->threadid = threadid;
       }
@@ -478,7 +478,7 @@ bool ThreadContext::fetch() {
       hit |= config.perfect_cache;
       if unlikely (!hit) {
         int missbuf = core.caches.initiate_icache_miss(physaddr, fetch_uuid,threadid);
-        if unlikely (config.event_log_enabled) {
+        if (event_logable()) {
           event = eventlog.add(EVENT_FETCH_ICACHE_MISS, fetchrip);
           event->fetch.missbuf = missbuf;
           event->threadid = threadid;
@@ -506,7 +506,7 @@ bool ThreadContext::fetch() {
     assert(current_basic_block->synthops);
 
     if likely (!unaligned_ldst_buf.get(transop, synthop)) {
-      transop = current_basic_block->transops[current_basic_block_transop_index];
+      current_basic_block->getuop(current_basic_block_transop_index, transop);
       synthop = current_basic_block->synthops[current_basic_block_transop_index];
     }
 
@@ -527,7 +527,7 @@ bool ThreadContext::fetch() {
     // are forced into the pipeline.
     //
     if unlikely (transop.unaligned) {
-      if unlikely (config.event_log_enabled) eventlog.add(EVENT_FETCH_SPLIT, transop);
+      if (event_logable()) eventlog.add(EVENT_FETCH_SPLIT, transop);
       split_unaligned(transop, unaligned_ldst_buf);
       assert(unaligned_ldst_buf.get(transop, synthop));
     }
@@ -541,7 +541,7 @@ bool ThreadContext::fetch() {
 
     if unlikely (isclass(transop.opcode, OPCLASS_BARRIER)) {
       // We've hit an assist: stall the frontend until we resume or redirect
-      if unlikely (config.event_log_enabled) eventlog.add(EVENT_FETCH_ASSIST, transop);
+      if (event_logable()) eventlog.add(EVENT_FETCH_ASSIST, transop);
       per_context_ooocore_stats_update(threadid, fetch.stop.microcode_assist++);
       stall_frontend = 1;
     }
@@ -590,7 +590,7 @@ bool ThreadContext::fetch() {
 
     per_context_ooocore_stats_update(threadid, fetch.opclass[opclassof(transop.opcode)]++);
 
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event = eventlog.add(EVENT_FETCH_OK, transop);
       event->fetch.predrip = predrip;
     }
@@ -628,26 +628,40 @@ bool ThreadContext::fetch() {
 BasicBlock* ThreadContext::fetch_or_translate_basic_block(const RIPVirtPhys& rvp) {
   time_this_scope(ctdecode);
 
-  if likely (current_basic_block) {
-    // Release our ref to the old basic block being fetched
-    current_basic_block->release();
-    current_basic_block = null;
-  }
-
-  BasicBlock* bb = bbcache(rvp);
+  //
+  // If we just ran off the end of a block (we still hold a ref to it,
+  // so it cannot have been freed), try its direct link to the block
+  // at the predicted rip before going through the bbcache.
+  //
+  BasicBlock* prevbb = current_basic_block;
+  BasicBlock* bb = (prevbb) ? bbcache.successor(prevbb, rvp) : null;
+  if unlikely (bb && !(bb->rip == rvp)) bb = null;
 
   if likely (bb) {
-    current_basic_block = bb;
+    stats.decoder.bbcache.links_followed++;
   } else {
-    current_basic_block = bbcache.translate(ctx, rvp);
-    assert(current_basic_block);
-    if unlikely (config.event_log_enabled) {
-      OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_FETCH_TRANSLATE, rvp);
-      event->fetch.bb_uop_count = current_basic_block->count;
-      event->threadid = threadid;
+    bb = bbcache(rvp);
+
+    if unlikely (!bb) {
+      bb = bbcache.translate(ctx, rvp);
+      assert(bb);
+      if (event_logable()) {
+        OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_FETCH_TRANSLATE, rvp);
+        event->fetch.bb_uop_count = bb->count;
+        event->threadid = threadid;
+      }
     }
+
+    if (prevbb) bbcache.link(prevbb, bb);
+  }
+
+  if likely (prevbb) {
+    // Release our ref to the old basic block being fetched
+    prevbb->release();
   }
 
+  current_basic_block = bb;
+
   //
   // Acquire a reference to the new basic block being fetched.
   // This must be done right away so future allocations do not
@@ -678,7 +692,7 @@ void ThreadContext::rename() {
 
   while (prepcount < FRONTEND_WIDTH) {
     if unlikely (fetchq.empty()) {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         if likely (!prepcount) {
           event = core.eventlog.add(EVENT_RENAME_FETCHQ_EMPTY);
           event->threadid = threadid;
@@ -689,7 +703,7 @@ void ThreadContext::rename() {
     }
 
     if unlikely (!ROB.remaining()) {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         if likely (!prepcount) {
           event = core.eventlog.add(EVENT_RENAME_ROB_FULL);
           event->threadid = threadid;
@@ -713,7 +727,7 @@ void ThreadContext::rename() {
     }
 
     if (phys_reg_file < 0) {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         if likely (!prepcount) {
           event = core.eventlog.add()->fill(EVENT_RENAME_PHYSREGS_FULL);
           event->threadid = threadid;
@@ -728,19 +742,19 @@ void ThreadContext::rename() {
     bool br = isbranch(fetchbuf.opcode);
 
     if unlikely (ld && (loads_in_flight >= LDQ_SIZE)) {
-      if unlikely (config.event_log_enabled) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_LDQ_FULL)->threadid = threadid; }
+      if (event_logable()) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_LDQ_FULL)->threadid = threadid; }
       per_context_ooocore_stats_update(threadid, frontend.status.ldq_full++);
       break;
     }
 
     if unlikely (st && (stores_in_flight >= STQ_SIZE)) {
-      if unlikely (config.event_log_enabled) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_STQ_FULL)->threadid = threadid; }
+      if (event_logable()) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_STQ_FULL)->threadid = threadid; }
       per_context_ooocore_stats_update(threadid, frontend.status.stq_full++);
       break;
     }
 
     if unlikely ((ld|st) && (!LSQ.remaining())) {
-      if unlikely (config.event_log_enabled) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_MEMQ_FULL)->threadid = threadid; }
+      if (event_logable()) { if likely (!prepcount) core.eventlog.add(EVENT_RENAME_MEMQ_FULL)->threadid = threadid; }
       break;
     }
 
@@ -767,6 +781,7 @@ void ThreadContext::rename() {
       lsq.datavalid = 0;
       lsq.addrvalid = 0;
       lsq.invalid = 0;
+      update_stq_index(lsq);
       loads_in_flight += (st == 0);
       stores_in_flight += (st == 1);
     }
@@ -785,6 +800,24 @@ void ThreadContext::rename() {
     rob.operands[RC] = specrrt[transop.rc];
     rob.operands[RS] = &core.physregfiles[0][PHYS_REG_NULL]; // used for loads and stores only
 
+    //
+    // A vec128 uop reads the high halves of ra and rb through rc and rs.
+    // Any operand may be the high half of an earlier vec128 uop's result.
+    //
+    int srcregs[MAX_OPERANDS] = {transop.ra, transop.rb, transop.rc, REG_zero};
+    if unlikely (transop.vec128) {
+      srcregs[RC] = vec128_hi(transop.ra);
+      srcregs[RS] = vec128_hi(transop.rb);
+      rob.operands[RC] = specrrt[srcregs[RC]];
+      rob.operands[RS] = specrrt[srcregs[RS]];
+    }
+
+    rob.hi_operands = 0;
+    foreach (i, MAX_OPERANDS) {
+      const PhysicalRegister* source = rob.operands[i];
+      rob.hi_operands |= (source->vec128 & (srcregs[i] == (source->archreg + 1))) << i;
+    }
+
     // See notes above on Physical Register Recycling Complications
     foreach (i, MAX_OPERANDS) {
       rob.operands[i]->addref(rob, threadid);
@@ -830,6 +863,8 @@ void ThreadContext::rename() {
     assert(physreg);
     physreg->flags = FLAG_WAIT;
     physreg->data = 0xdeadbeefdeadbeefULL;
+    physreg->datahi = 0xdeadbeefdeadbeefULL;
+    physreg->vec128 = transop.vec128;
     physreg->rob = &rob;
     physreg->archreg = rob.uop.rd;
     rob.physreg = physreg;
@@ -839,7 +874,7 @@ void ThreadContext::rename() {
     // Logging
     //
 
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_RENAME_OK, &rob);
 
       foreach (i, MAX_OPERANDS) rob.operands[i]->fill_operand_info(event->rename.opinfo[i]);
@@ -876,6 +911,12 @@ void ThreadContext::rename() {
       specrrt[transop.rd] = rob.physreg;
       rob.physreg->addspecref(transop.rd, threadid);
       renamed_reg = archdest_is_visible[transop.rd];
+
+      if unlikely (transop.vec128) {
+        specrrt[transop.rd + 1]->unspecref(transop.rd + 1, threadid);
+        specrrt[transop.rd + 1] = rob.physreg;
+        rob.physreg->addspecref(transop.rd + 1, threadid);
+      }
     }
 
     if unlikely (!transop.nouserflags) {
@@ -926,7 +967,7 @@ void ThreadContext::frontend() {
       rob->cycles_left = -1;
       rob->changestate(rob_ready_to_dispatch_list);
     } else {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_FRONTEND, rob);
         event->frontend.cycles_left = rob->cycles_left;
       }
@@ -1175,14 +1216,14 @@ int ReorderBufferEntry::select_cluster() {
 
   executable_on_cluster &= cluster_issue_queue_avail_mask;
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     event = getcore().eventlog.add(EVENT_CLUSTER_OK, this);
     event->select_cluster.allowed_clusters = executable_on_cluster_mask;
     foreach (i, MAX_CLUSTERS) event->select_cluster.iq_avail[i] = cluster_issue_queue_avail_count[i];
   }
 
   if unlikely (!executable_on_cluster) {
-    if unlikely (config.event_log_enabled) event->type = EVENT_CLUSTER_NO_CLUSTER;
+    if (event_logable()) event->type = EVENT_CLUSTER_NO_CLUSTER;
     return -1;
   }
 
@@ -1198,7 +1239,7 @@ int ReorderBufferEntry::select_cluster() {
 
   per_context_ooocore_stats_update(threadid, dispatch.cluster[cluster]++);
 
-  if unlikely (config.event_log_enabled) event->cluster = cluster;
+  if (event_logable()) event->cluster = cluster;
 
   return cluster;
 }
@@ -1227,7 +1268,7 @@ int ThreadContext::dispatch() {
     // abort dispatching for this cycle.
     //
     if unlikely (rob->cluster < 0) {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         event = core.eventlog.add(EVENT_DISPATCH_NO_CLUSTER, rob);
         foreach (i, MAX_OPERANDS) rob->operands[i]->fill_operand_info(event->dispatch.opinfo[i]);
       }
@@ -1268,7 +1309,7 @@ int ThreadContext::dispatch() {
       rob->changestate(rob->get_ready_to_issue_list());
     }
 
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event = core.eventlog.add(EVENT_DISPATCH_OK, rob);
       foreach (i, MAX_OPERANDS) rob->operands[i]->fill_operand_info(event->dispatch.opinfo[i]);
     }
@@ -1333,7 +1374,7 @@ int ThreadContext::complete(int cluster) {
     rob->cycles_left--;
 
     if unlikely (rob->cycles_left <= 0) {
-      if unlikely (config.event_log_enabled) core.eventlog.add(EVENT_COMPLETE, rob);
+      if (event_logable()) core.eventlog.add(EVENT_COMPLETE, rob);
       rob->changestate(rob_completed_list[cluster]);
       rob->physreg->complete();
       rob->forward_cycle = 0;
@@ -1404,7 +1445,7 @@ int ThreadContext::writeback(int cluster) {
 #endif
 
     if likely (!isclass(rob->uop.opcode, OPCLASS_STORE|OPCLASS_BRANCH)) {
-      if unlikely (config.event_log_enabled) {
+      if (event_logable()) {
         OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_WRITEBACK, rob);
         event->writeback.data = rob->physreg->data;
         event->writeback.flags = rob->physreg->flags;
@@ -1517,7 +1558,7 @@ int ThreadContext::commit() {
     PhysicalRegister* physreg;
     foreach_list_mutable(statelist, physreg, entry, nextentry) {
       if unlikely (!physreg->referenced()) {
-        if unlikely (config.event_log_enabled) {
+        if (event_logable()) {
           OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_RECLAIM_PHYSREG);
           event->physreg = physreg->index();
           event->threadid = physreg->threadid;
@@ -1569,7 +1610,7 @@ void ThreadContext::flush_mem_lock_release_list(int start) {
       assert(false);
     }
 
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       OutOfOrderCoreEvent* event = core.eventlog.add(EVENT_RELEASE_MEM_LOCK);
       event->threadid = ctx.vcpuid;
       event->loadstore.sfr.physaddr = lockaddr >> 3;
@@ -1702,7 +1743,7 @@ int ReorderBufferEntry::commit() {
         ctx.cr2 = subrob.origvirt;
       }
 
-      if unlikely (config.event_log_enabled) core.eventlog.add_commit(EVENT_COMMIT_EXCEPTION_DETECTED, &subrob);
+      if (event_logable()) core.eventlog.add_commit(EVENT_COMMIT_EXCEPTION_DETECTED, &subrob);
 
       macro_op_has_exceptions = true;
       all_ready_to_commit = true;
@@ -1727,6 +1768,7 @@ int ReorderBufferEntry::commit() {
   }
 
   PhysicalRegister* oldphysreg = thread.commitrrt[uop.rd];
+  PhysicalRegister* oldphysreghi = (uop.vec128) ? thread.commitrrt[uop.rd + 1] : oldphysreg;
 
   bool ld = isload(uop.opcode);
   bool st = isstore(uop.opcode);
@@ -1735,12 +1777,12 @@ int ReorderBufferEntry::commit() {
   per_context_ooocore_stats_update(threadid, commit.opclass[opclassof(uop.opcode)]++);
 
   if unlikely (macro_op_has_exceptions) {
-    if unlikely (config.event_log_enabled) event = core.eventlog.add_commit(EVENT_COMMIT_EXCEPTION_ACKNOWLEDGED, this);
+    if (event_logable()) event = core.eventlog.add_commit(EVENT_COMMIT_EXCEPTION_ACKNOWLEDGED, this);
 
     // See notes in handle_exception():
     if likely (isclass(uop.opcode, OPCLASS_CHECK) & (ctx.exception == EXCEPTION_SkipBlock)) {
       thread.chk_recovery_rip = ctx.commitarf[REG_rip] + uop.bytes;
-      if unlikely (config.event_log_enabled) event->type = EVENT_COMMIT_SKIPBLOCK;
+      if (event_logable()) event->type = EVENT_COMMIT_SKIPBLOCK;
       per_context_ooocore_stats_update(threadid, commit.result.skipblock++);
     } else {
       per_context_ooocore_stats_update(threadid, commit.result.exception++);
@@ -1758,7 +1800,7 @@ int ReorderBufferEntry::commit() {
   //
   bool page_crossing = ((lowbits(uop.rip.rip, 12) + (uop.bytes-1)) >> 12);
   if unlikely (uop.eom && (smc_isdirty(uop.rip.mfnlo) | (page_crossing && smc_isdirty(uop.rip.mfnhi)))) {
-    if unlikely (config.event_log_enabled) core.eventlog.add_commit(EVENT_COMMIT_SMC_DETECTED, this);
+    if (event_logable()) core.eventlog.add_commit(EVENT_COMMIT_SMC_DETECTED, this);
 
     //
     // Invalidate the pages only after the pipeline is flushed: we may still
@@ -1799,7 +1841,7 @@ int ReorderBufferEntry::commit() {
     MemoryInterlockEntry* lock = interlocks.probe(lockaddr);
 
     if unlikely (lock && (lock->vcpuid != thread.ctx.vcpuid)) {
-      if unlikely (config.event_log_enabled) core.eventlog.add_commit(EVENT_COMMIT_MEM_LOCKED, this);
+      if (event_logable()) core.eventlog.add_commit(EVENT_COMMIT_MEM_LOCKED, this);
 
       per_context_ooocore_stats_update(threadid, commit.result.memlocked++);
       return COMMIT_RESULT_NONE;
@@ -1874,9 +1916,9 @@ int ReorderBufferEntry::commit() {
   //
   // The commit of all uops in the x86 macro-op is guaranteed to happen after this point
   //
-  if unlikely (config.event_log_enabled) event = core.eventlog.add_commit(EVENT_COMMIT_OK, this);
+  if (event_logable()) event = core.eventlog.add_commit(EVENT_COMMIT_OK, this);
 
-  if unlikely (config.event_log_enabled) {
+  if (event_logable()) {
     if unlikely ((uop.rip.rip == config.log_backwards_from_trigger_rip) && (uop.som)) {
       logfile << "Hit trigger rip ", (void*)(Waddr)config.log_backwards_from_trigger_rip, "; printing event ring buffer:", endl, flush;
       core.eventlog.print(logfile);
@@ -1891,6 +1933,14 @@ int ReorderBufferEntry::commit() {
 
     if likely (uop.rd < ARCHREG_COUNT) ctx.commitarf[uop.rd] = physreg->data;
 
+    if unlikely (uop.vec128) {
+      thread.commitrrt[uop.rd + 1]->uncommitref(uop.rd + 1, thread.threadid);
+      thread.commitrrt[uop.rd + 1] = physreg;
+      thread.commitrrt[uop.rd + 1]->addcommitref(uop.rd + 1, thread.threadid);
+
+      if likely (uop.rd < ARCHREG_COUNT) ctx.commitarf[uop.rd + 1] = physreg->datahi;
+    }
+
     physreg->rob = null;
   }
 
@@ -1902,7 +1952,7 @@ int ReorderBufferEntry::commit() {
       assert(!isbranch(uop.opcode));
       ctx.commitarf[REG_rip] += uop.bytes;
     }
-    if unlikely (config.event_log_enabled) event->commit.target_rip = ctx.commitarf[REG_rip];
+    if (event_logable()) event->commit.target_rip = ctx.commitarf[REG_rip];
   }
 
   if likely ((!ld) & (!st) & (!uop.nouserflags)) {
@@ -1912,7 +1962,7 @@ int ReorderBufferEntry::commit() {
     per_context_ooocore_stats_update(threadid, commit.setflags.no += (uop.setflags == 0));
     per_context_ooocore_stats_update(threadid, commit.setflags.yes += (uop.setflags != 0));
 
-    if unlikely (config.event_log_enabled) event->commit.state.reg.rdflags = ctx.commitarf[REG_flags];
+    if (event_logable()) event->commit.state.reg.rdflags = ctx.commitarf[REG_flags];
 
     if likely (uop.setflags & SETFLAG_ZF) {
       thread.commitrrt[REG_zf]->uncommitref(REG_zf, thread.threadid);
@@ -1954,11 +2004,27 @@ int ReorderBufferEntry::commit() {
   }
 
   assert(archdest_can_commit[uop.rd]);
-  assert(oldphysreg->state == PHYSREG_ARCH);
 
-  if unlikely (config.event_log_enabled) event->commit.oldphysreg = -1;
-  if likely (oldphysreg->nonnull()) {
-    if unlikely (config.event_log_enabled) {
+  //
+  // A vec128 physreg stays mapped to the other half of its register
+  // pair when only one half is overwritten; it then waits in the
+  // pending free state until the other half is overwritten too.
+  //
+  assert((oldphysreg->state == PHYSREG_ARCH) | ((oldphysreg->state == PHYSREG_PENDINGFREE) & oldphysreg->vec128));
+
+  if unlikely ((oldphysreghi != oldphysreg) && oldphysreghi->nonnull() && (oldphysreghi->state == PHYSREG_ARCH)) {
+    if unlikely (oldphysreghi->referenced()) {
+      oldphysreghi->changestate(PHYSREG_PENDINGFREE);
+      stats.ooocore.commit.freereg.pending++;
+    } else {
+      oldphysreghi->free();
+      stats.ooocore.commit.freereg.free++;
+    }
+  }
+
+  if (event_logable()) event->commit.oldphysreg = -1;
+  if likely (oldphysreg->nonnull() & (oldphysreg->state == PHYSREG_ARCH)) {
+    if (event_logable()) {
       event->commit.oldphysreg = oldphysreg->index();
       event->commit.oldphysreg_refcount = oldphysreg->refcount;
     }
@@ -2003,7 +2069,7 @@ int ReorderBufferEntry::commit() {
     bool taken = (ctx.commitarf[REG_rip] != end_of_branch_x86_insn);
     bool predtaken = (uop.riptaken != end_of_branch_x86_insn);
 
-    if unlikely (config.event_log_enabled) {
+    if (event_logable()) {
       event->commit.taken = taken;
       event->commit.predtaken = predtaken;
     }
@@ -2036,7 +2102,7 @@ int ReorderBufferEntry::commit() {
     return COMMIT_RESULT_SMC;
 
   if unlikely (uop_is_barrier) {
-    if unlikely (config.event_log_enabled) core.eventlog.add(EVENT_COMMIT_ASSIST, RIPVirtPhys(ctx.commitarf[REG_rip]))->threadid = thread.threadid;
+    if (event_logable()) core.eventlog.add(EVENT_COMMIT_ASSIST, RIPVirtPhys(ctx.commitarf[REG_rip]))->threadid = thread.threadid;
     per_context_ooocore_stats_update(threadid, commit.result.barrier++);
     return COMMIT_RESULT_BARRIER;
   }
@@ -421,6 +421,7 @@ stringbuf& operator <<(stringbuf& sb, const TransOpBase& op) {
   if ((ld|st) && (op.cachelevel > 0)) sbname << ".L", (char)('1' + op.cachelevel);
   if ((ld|st) && (op.locked)) sbname << ((ld) ? ".acq" : ".rel");
   if (op.internal) sbname << ".p";
+  if (op.vec128) sbname << ".v";
   if (op.eom) sbname << ".", (op.any_flags_in_insn ? "+" : "-");
 
   sb << padstring((char*)sbname, -12), " ", arch_reg_names[op.rd];
@@ -490,7 +491,7 @@ ostream& RIPVirtPhysBase::print(ostream& os) const {
   return os;
 }
 
-void BasicBlock::reset() {
+void BasicBlockBuffer::reset() {
   setzero(*((BasicBlockBase*)this));
   hashlink.reset();
   mfnlo_loc.reset();
@@ -498,43 +499,15 @@ void BasicBlock::reset() {
   type = BB_TYPE_COND;
 }
 
-void BasicBlock::reset(const RIPVirtPhys& rip) {
+void BasicBlockBuffer::reset(const RIPVirtPhys& rip) {
   reset();
   this->rip = rip;
   rip_taken = rip;
   rip_not_taken = rip;
 }
 
-//
-// This is explicitly defined instead of just using a
-// destructor since we do some fancy dynamic resizing
-// in the clone() method that c++ will croak on.
-//
-// Once you call this, the basic block is *gone* and
-// cannot be accessed ever again, even if it is still
-// in scope. Don't call this with non-cloned() blocks.
-//
-void BasicBlock::free() {
-  if (synthops) delete[] synthops;
-  synthops = null;
-  ::free(this);
-}
-
-BasicBlock* BasicBlock::clone() {
-  BasicBlock* bb = (BasicBlock*)malloc(sizeof(BasicBlockBase) + (count * sizeof(TransOp)));
-
-  memcpy(bb, this, sizeof(BasicBlockBase));
-
-  bb->synthops = null;
-  // hashlink, mfnlo_loc, mfnhi_loc are always updated after cloning
-  bb->hashlink.reset();
-  bb->use(0);
-
-  foreach (i, count) bb->transops[i] = this->transops[i];
-  return bb;
-}
-
-ostream& operator <<(ostream& os, const BasicBlock& bb) {
+template <typename T>
+static ostream& print_basic_block(ostream& os, const T& bb) {
   os << "BasicBlock ", (void*)(Waddr)bb.rip, " of type ", branch_type_names[bb.brtype], ": ", bb.bytes, " bytes, ", bb.count, " transops (", bb.tagcount, "t ", bb.memcount, "m ", bb.storecount, "s";
   if (bb.repblock) os << " rep";
   os << ", uses ", bitstring(bb.usedregs, 64, true), "), ";
@@ -543,7 +516,8 @@ ostream& operator <<(ostream& os, const BasicBlock& bb) {
   int bytes_in_insn;
 
   foreach (i, bb.count) {
-    const TransOp& transop = bb.transops[i];
+    TransOp transop;
+    bb.getuop(i, transop);
     os << "  ", (void*)rip, ": ", transop;
 
     // if (transop.som) os << " [som bytes ", transop.bytes, "]";
@@ -559,6 +533,14 @@ ostream& operator <<(ostream& os, const BasicBlock& bb) {
   return os;
 }
 
+ostream& operator <<(ostream& os, const BasicBlock& bb) {
+  return print_basic_block(os, bb);
+}
+
+ostream& operator <<(ostream& os, const BasicBlockBuffer& bb) {
+  return print_basic_block(os, bb);
+}
+
 const char* bb_type_names[BB_TYPE_COUNT] = {"br", "bru", "jmp", "brp"};
 
 char* regname(int r) {
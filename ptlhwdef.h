@@ -1309,7 +1309,12 @@ enum {
 };
 extern const char* datatype_names[DATATYPE_COUNT];
 
-struct TransOpBase {
+//
+// Everything about a uop except its immediates. Cached basic blocks
+// keep this part for every uop, but only the nonzero immediates
+// (see PackedTransOp).
+//
+struct TransOpHeader {
   // Opcode:
   byte opcode;
   // Size shift, extshift
@@ -1325,7 +1330,10 @@ struct TransOpBase {
   // Index in basic block
   byte bbindex;
   // Misc info (terminal writer of targets in this insn, etc)
-  byte final_insn_in_bb:1, final_arch_in_insn:1, final_flags_in_insn:1, any_flags_in_insn:1, pad:3, marked:1;
+  byte final_insn_in_bb:1, final_arch_in_insn:1, final_flags_in_insn:1, any_flags_in_insn:1, vec128:1, pad:2, marked:1;
+};
+
+struct TransOpBase: public TransOpHeader {
   // Immediates
   W64s rbimm;
   W64s rcimm;
@@ -1354,6 +1362,20 @@ struct TransOp: public TransOpBase {
   }
 };
 
+//
+// A vec128 uop does the work of a pair of identical SSE uops on the
+// low and high halves of a register pair: it writes rd and rd+1 from
+// ra, ra+1 and rb, rb+1. Register pairs are xmmlN/xmmhN and temp0/1
+// through temp6/7; REG_zero and REG_imm stand for both halves.
+//
+static inline bool is_vec128_pair(int r) {
+  return (inrange(r, REG_xmml0, REG_xmmh15) | inrange(r, REG_temp0, REG_temp7)) & ((r & 1) == 0);
+}
+
+static inline int vec128_hi(int r) {
+  return ((r == REG_zero) | (r == REG_imm)) ? r : (r + 1);
+}
+
 enum { LDST_ALIGN_NORMAL, LDST_ALIGN_LO, LDST_ALIGN_HI };
 
 ostream& operator <<(ostream& os, const TransOpBase& op);
@@ -1367,9 +1389,13 @@ typedef void (*uopimpl_func_t)(IssueState& state, W64 ra, W64 rb, W64 rc, W16 ra
 //
 // List of all BBs on a physical page (for SMC invalidation)
 // With 60 (or 62 on 32-bit PTLsim) 32-bit entries per page,
-// this comes out to exactly 256 bytes per chunk.
+// this comes out to exactly 256 bytes per chunk. Userspace
+// PTLsim allocates basic blocks anywhere in the 64-bit address
+// space, so it needs full pointers (29 per chunk).
 //
-#ifdef __x86_64__
+#if defined(__x86_64__) && !defined(PTLSIM_HYPERVISOR)
+#define BB_PTRS_PER_CHUNK 29
+#elif defined(__x86_64__)
 #define BB_PTRS_PER_CHUNK 60
 #else
 #define BB_PTRS_PER_CHUNK 62
@@ -1383,7 +1409,7 @@ typedef void (*uopimpl_func_t)(IssueState& state, W64 ra, W64 rb, W64 rc, W16 ra
 #ifdef PTLSIM_HYPERVISOR
 typedef shortptr<BasicBlock, W32, PTLSIM_VIRT_BASE> BasicBlockPtr;
 #else
-typedef shortptr<BasicBlock> BasicBlockPtr;
+typedef shortptr<BasicBlock, Waddr> BasicBlockPtr;
 #endif
 
 struct BasicBlockChunkList: public ChunkList<BasicBlockPtr, BB_PTRS_PER_CHUNK> {
@@ -1460,6 +1486,24 @@ static const char* branch_type_names[8] = {
 };
 
 
+//
+// Pre-decoded uop for the sequential core's fast path (seqcore.cpp):
+// the uop implementation is resolved and source operands are already
+// remapped to architectural registers, so the common case never has
+// to look at the original TransOp.
+//
+enum { SEQUOP_SLOW, SEQUOP_ALU, SEQUOP_BRANCH, SEQUOP_LOAD, SEQUOP_STORE, SEQUOP_VEC128 };
+
+struct SequentialUop {
+  uopimpl_func_t synthop;
+  W64s rbimm;
+  W64s rcimm;
+  W16 flagmask;
+  byte ra, rb, rc, rd;
+  byte type:3, som:1, eom:1, barrier:1, userflags:1, pad:1;
+  byte bytes:4, rbimm_valid:1, rcimm_valid:1, is_sse:1, is_x87:1;
+};
+
 struct BasicBlockBase {
   RIPVirtPhys rip;
   selflistlink hashlink;
@@ -1477,12 +1521,25 @@ struct BasicBlockBase {
   byte marked:1, mfence:1, x87:1, sse:1, nondeterministic:1, brtype:3;
   W64 usedregs;
   uopimpl_func_t* synthops;
+  SequentialUop* seqops;
+  // Compiled host code, valid while jit_generation matches the code cache (seqcore.cpp)
+  void* jitcode;
+  W64 jit_generation;
   int refcount;
   W32 hitcount;
   W32 predcount;
   W32 confidence;
   W64 lastused;
   W64 lasttarget;
+  // Blocks at rip_taken and rip_not_taken (see BasicBlockCache::link)
+  BasicBlock* taken_link;
+  BasicBlock* not_taken_link;
+  W64 link_generation;
+  // Ring of cached blocks swept by BasicBlockCache::evict(); the block
+  // was used since the hand last passed it if lastused >= clockstamp
+  BasicBlock* clock_prev;
+  BasicBlock* clock_next;
+  W64 clockstamp;
 
   void acquire() {
     refcount++;
@@ -1495,17 +1552,64 @@ struct BasicBlockBase {
   }
 };
 
+//
+// Uop as stored in a cached BasicBlock: the header, plus the position
+// of its nonzero immediates in the block's immediate pool.
+//
+enum {
+  PACKED_RBIMM    = (1 << 0),
+  PACKED_RCIMM    = (1 << 1),
+  PACKED_RIPTAKEN = (1 << 2),
+  PACKED_RIPSEQ   = (1 << 3),
+};
+
+struct PackedTransOp: public TransOpHeader {
+  W16 immindex;
+  byte immmask;
+  byte pad;
+};
+
+//
+// Cached basic block. Only <count> uops are allocated, followed by
+// the synthops array and then the pool of immediates, all in one
+// piece of the translation arena.
+//
 struct BasicBlock: public BasicBlockBase {
+  PackedTransOp uops[MAX_BB_UOPS*2];
+
+  uopimpl_func_t* synthop_area() { return (uopimpl_func_t*)&uops[count]; }
+  const W64* immediates() const { return (const W64*)((const uopimpl_func_t*)&uops[count] + count); }
+
+  void getuop(int i, TransOp& uop) const {
+    const PackedTransOp& packed = uops[i];
+    static_cast<TransOpHeader&>(uop) = packed;
+    const W64* imm = immediates() + packed.immindex;
+    uop.rbimm = (packed.immmask & PACKED_RBIMM) ? *imm++ : 0;
+    uop.rcimm = (packed.immmask & PACKED_RCIMM) ? *imm++ : 0;
+    uop.riptaken = (packed.immmask & PACKED_RIPTAKEN) ? *imm++ : 0;
+    uop.ripseq = (packed.immmask & PACKED_RIPSEQ) ? *imm++ : 0;
+  }
+
+  W64 getsize() const;
+  void free();
+  void use(W64 counter) { lastused = counter; };
+};
+
+//
+// Basic block as built by the decoder, with room for the maximum
+// number of uops; clone() packs it into a new cached BasicBlock.
+//
+struct BasicBlockBuffer: public BasicBlockBase {
   TransOp transops[MAX_BB_UOPS*2];
 
   void reset();
   void reset(const RIPVirtPhys& rip);
-  BasicBlock* clone();
-  void free();
-  void use(W64 counter) { lastused = counter; };
+  BasicBlock* clone() const;
+  void getuop(int i, TransOp& uop) const { uop = transops[i]; }
 };
 
 ostream& operator <<(ostream& os, const BasicBlock& bb);
+ostream& operator <<(ostream& os, const BasicBlockBuffer& bb);
 
 //
 // Printing and information
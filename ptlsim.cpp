@@ -31,6 +31,7 @@ W64 total_uops_executed = 0;
 W64 total_uops_committed = 0;
 W64 total_user_insns_committed = 0;
 W64 total_basic_blocks_committed = 0;
+W64 next_checkpoint_at_insns = infinity;
 #endif
 
 void PTLsimConfig::reset() {
@@ -57,6 +58,7 @@ void PTLsimConfig::reset() {
   mm_log_buffer_size = 16384;
   enable_inline_mm_logging = 0;
   enable_mm_validate = 0;
+  huge_pages = 0;
 
   event_log_enabled = 0;
   event_log_ring_buffer_size = 32768;
@@ -70,6 +72,7 @@ void PTLsimConfig::reset() {
   stats_filename.reset();
   snapshot_cycles = infinity;
   snapshot_now.reset();
+  profile_interval = 0;
 
 #ifndef PTLSIM_HYPERVISOR
   // Starting Point
@@ -111,15 +114,35 @@ void PTLsimConfig::reset() {
   validation_start_cycle = 0;
 
   perfect_cache = 0;
+  no_skip_idle_cycles = 0;
+  host_simd.reset();
+  seq_jit = 0;
 
   dumpcode_filename = "test.dat";
   dump_at_end = 0;
   overshoot_and_dump = 0;
   bbcache_dump_filename.reset();
+  bbcache_filename.reset();
+  bbcache_budget = 0;
+  sse128_uops = 0;
 
 #ifndef PTLSIM_HYPERVISOR
   sequential_mode_insns = 0;
   exit_after_fullsim = 0;
+
+  checkpoint_interval = 0;
+  checkpoint_prefix = "ptlsim.ckpt";
+  restore_checkpoint.reset();
+
+  vectors_filename.reset();
+  vector_regs = "rax";
+  vector_max_insns = 1000000;
+
+  sample_native_ms = 0;
+  sample_warmup_insns = 200000;
+  sample_window_insns = 50000;
+
+  decode_bench_iterations = 0;
 #endif
 }
 
@@ -158,6 +181,7 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   add(mm_log_buffer_size,           "mm-logbuf-size",       "Size of PTLsim memory manager log buffer (in events, not bytes)");
   add(enable_inline_mm_logging,     "mm-log-inline",        "Print every memory manager request in the main log file");
   add(enable_mm_validate,           "mm-validate",          "Validate every memory manager request against internal structures (slow)");
+  add(huge_pages,                   "huge-pages",           "Back PTLsim's own page pools with 2 MB huge pages where the host allows");
 
   section("Event Ring Buffer Logging Control");
   add(event_log_enabled,            "ringbuf",              "Log all core events to the ring buffer for backwards-in-time debugging");
@@ -171,6 +195,7 @@ void ConfigurationParser<PTLsimConfig>::setup() {
   add(stats_filename,               "stats",                "Statistics data store hierarchy root");
   add(snapshot_cycles,              "snapshot-cycles",      "Take statistical snapshot and reset every <snapshot> cycles");
   add(snapshot_now,                 "snapshot-now",         "Take statistical snapshot immediately, using specified name");
+  add(profile_interval,             "profile",              "Time the simulator itself stage by stage in 1 of every <profile> cycles (0 = off)");
 #ifndef PTLSIM_HYPERVISOR
   // Userspace only
   section("Start Point");
@@ -217,16 +242,42 @@ void ConfigurationParser<PTLsimConfig>::setup() {
 
   section("Out of Order Core (ooocore)");
   add(perfect_cache,                "perfect-cache",        "Perfect cache performance: all loads and stores hit in L1");
+  add(no_skip_idle_cycles,          "no-skip-idle",         "Simulate every cycle, even while only waiting for cache misses or long latency uops");
+  add(host_simd,                    "host-simd",            "Use at most these host vector instructions for associative searches: sse2, avx2 or avx512 (default: widest available)");
+
+  section("Sequential Core (seqcore)");
+  add(seq_jit,                      "seq-jit",              "Compile hot basic blocks into host code (x86-64 hosts only)");
 
   section("Miscellaneous");
   add(dumpcode_filename,            "dumpcode",             "Save page of user code at final rip to file <dumpcode>");
   add(dump_at_end,                  "dump-at-end",          "Set breakpoint and dump core before first instruction executed on return to native mode");
   add(overshoot_and_dump,           "overshoot-and-dump",   "Set breakpoint and dump core after first instruction executed on return to native mode");
   add(bbcache_dump_filename,        "bbdump",               "Basic block cache dump filename");
+  add(bbcache_filename,             "bbcache-file",         "Load translated basic blocks from this file and append new ones to it");
+  add(bbcache_budget,               "bbcache-budget",       "Evict least recently used basic blocks to keep at most this many bytes of them (0 = unlimited)");
+  add(sse128_uops,                  "sse128",               "Decode SSE operations on both halves of a register into single 128-bit uops instead of uop pairs");
 #ifndef PTLSIM_HYPERVISOR
   // Userspace only
   add(sequential_mode_insns,        "seq",                  "Run in sequential mode for <seq> instructions before switching to out of order");
   add(exit_after_fullsim,           "exitend",              "Kill the thread after full simulation completes rather than going native");
+
+  section("Checkpoints");
+  add(checkpoint_interval,          "checkpoint-every",     "Write an architectural checkpoint every <N> user instructions (sequential core)");
+  add(checkpoint_prefix,            "checkpoint-prefix",    "Checkpoint filename prefix: initial image is <prefix>.base, then <prefix>.<insns>");
+  add(restore_checkpoint,           "restore",              "Restore registers and memory from this checkpoint file before simulating");
+
+  section("Input vectors");
+  add(vectors_filename,             "vectors",              "Run the code once for each input vector (one per line) in this file on the sequential core, checking the expected outputs");
+  add(vector_regs,                  "vector-regs",          "Registers to print after each input vector (comma separated)");
+  add(vector_max_insns,             "vector-insns",         "Stop each input vector after this many instructions");
+
+  section("Interval sampling");
+  add(sample_native_ms,             "sample-native-ms",     "Alternate simulated windows with native runs of this many ms of CPU time and estimate the CPI of the whole run (0 = off)");
+  add(sample_warmup_insns,          "sample-warmup",        "Warm up the core for this many instructions at the start of each window");
+  add(sample_window_insns,          "sample-window",        "Measure the CPI over this many instructions in each window");
+
+  section("Benchmarks");
+  add(decode_bench_iterations,      "decode-bench",         "Translate the code at rip <N> times without simulating it and report the decoder throughput");
 #endif
 };
 
@@ -301,6 +352,7 @@ void print_usage(int argc, char** argv) {
 stringbuf current_stats_filename;
 stringbuf current_log_filename;
 stringbuf current_bbcache_dump_filename;
+stringbuf current_bbcache_filename;
 
 void backup_and_reopen_logfile() {
   if (config.log_filename) {
@@ -404,12 +456,22 @@ bool handle_config_change(PTLsimConfig& config, int argc, char** argv) {
     current_bbcache_dump_filename = config.bbcache_dump_filename;
   }
 
+  if (config.bbcache_filename.set() && (config.bbcache_filename != current_bbcache_filename)) {
+    open_bbcache_file(config.bbcache_filename);
+    current_bbcache_filename = config.bbcache_filename;
+  }
+
+  if (!select_host_simd(config.host_simd)) {
+    cerr << "Warning: unknown -host-simd ", config.host_simd, "; using ", host_simd_names[host_simd_level], endl;
+  }
+
   if (config.log_trigger_virt_addr_start && (!config.log_trigger_virt_addr_end)) {
     config.log_trigger_virt_addr_end = config.log_trigger_virt_addr_start;
   }
 
   ptl_mm_set_logging(config.mm_logfile.set() ? (char*)(config.mm_logfile) : null, config.mm_log_buffer_size, config.enable_inline_mm_logging);
   ptl_mm_set_validate(config.enable_mm_validate);
+  ptl_mm_set_huge_pages(config.huge_pages);
 
 #ifdef __x86_64__
   config.start_log_at_rip = signext64(config.start_log_at_rip, 48);
@@ -490,10 +552,20 @@ W64 ticks_per_update;
 
 W64 last_stats_captured_at_cycle = 0;
 
+// Only read the TSC every so often: this is called once per cycle or basic block
+static const int PROGRESS_CHECK_INTERVAL = 64;
+static int progress_check_countdown = 0;
+
 void update_progress() {
-  W64 ticks = rdtsc();
-  W64s delta = (ticks - last_printed_status_at_ticks);
-  if unlikely (delta < 0) delta = 0;
+  W64 ticks = 0;
+  W64s delta = 0;
+  if unlikely (--progress_check_countdown <= 0) {
+    progress_check_countdown = PROGRESS_CHECK_INTERVAL;
+    ticks = rdtsc();
+    delta = (ticks - last_printed_status_at_ticks);
+    if unlikely (delta < 0) delta = 0;
+  }
+
   if unlikely (delta >= ticks_per_update) {
     double seconds = ticks_to_seconds(delta);
     double cycles_per_sec = (sim_cycle - last_printed_status_at_cycle) / seconds;
@@ -571,17 +643,33 @@ bool simulate(const char* machinename) {
   last_printed_status_at_cycle = 0;
 
   W64 tsc_at_start = rdtsc();
+  W64 translate_at_start = translate_timer.cycles();
   current_machine = machine;
   machine->run(config);
   W64 tsc_at_end = rdtsc();
+
+  double seconds = ticks_to_seconds(tsc_at_end - tsc_at_start);
+  double decoder_seconds = ticks_to_seconds(translate_timer.cycles() - translate_at_start);
+  double insns_per_sec = total_user_insns_committed / seconds;
+
+  stats.simulator.performance.rate.cycles_per_sec = sim_cycle / seconds;
+  stats.simulator.performance.rate.user_commits_per_sec = insns_per_sec;
+  stats.simulator.performance.time.decoder += decoder_seconds;
+  stats.simulator.performance.time.execution += seconds - decoder_seconds;
+
   machine->update_stats(stats);
   current_machine = null;
 
-  W64 seconds = W64(ticks_to_seconds(tsc_at_end - tsc_at_start));
-
   stringbuf sb;
   sb << endl, "Stopped after ", sim_cycle, " cycles, ", total_user_insns_committed, " instructions and ",
-    seconds, " seconds of sim time (", W64(double(sim_cycle) / double(seconds)), " Hz sim rate)", endl;
+    floatstring(seconds, 0, 3), " seconds of sim time (", W64(sim_cycle / seconds), " Hz sim rate, ";
+  if (insns_per_sec >= 1000000) sb << floatstring(insns_per_sec / 1000000, 0, 2), " MIPS)", endl;
+  else sb << floatstring(insns_per_sec / 1000, 0, 2), " KIPS)", endl;
+
+  if (config.profile_interval) {
+    sb << "Host time: ", floatstring(decoder_seconds, 0, 4), " seconds (", floatstring(percent(decoder_seconds, seconds), 0, 1), "%) in the decoder, ",
+      floatstring(seconds - decoder_seconds, 0, 4), " seconds in execution", endl;
+  }
 
   logfile << sb, flush;
   cerr << sb, flush;
@@ -91,6 +91,48 @@ int inject_events();
 bool check_for_async_sim_break();
 void update_progress();
 
+//
+// Architectural checkpoints (userspace only)
+//
+// A checkpoint file starts with a CheckpointHeader followed by the
+// saved ContextBase, then a directory of CheckpointPage entries, then
+// the page data. Each of these regions starts on a page boundary, so
+// the file can be mapped directly and pages used in place.
+//
+struct CheckpointHeader {
+  W64 magic;
+  W64 version;
+  W64 insns;
+  W64 cycles;
+  W64 context_offset;
+  W64 context_size;
+  W64 directory_offset;
+  W64 page_count;
+  W64 stored_page_count;
+  // Pages not stored here are found in this image instead:
+  char base_filename[256];
+
+  static const W64 MAGIC = 0x3130706b634c5450ULL; // 'PTLckp01'
+  static const W64 VERSION = 1;
+};
+
+enum {
+  CHECKPOINT_PAGE_IN_BASE = (1 << 0),
+};
+
+struct CheckpointPage {
+  W64 virtaddr;
+  W32 prot;
+  W32 flags;
+  // File offset of the data, in the base image if CHECKPOINT_PAGE_IN_BASE
+  W64 offset;
+};
+
+extern W64 last_stats_captured_at_cycle;
+
+extern W64 next_checkpoint_at_insns;
+void capture_checkpoint();
+
 extern "C" void switch_to_sim();
 
 //
@@ -149,6 +191,7 @@ struct PTLsimConfig {
   W64 mm_log_buffer_size;
   bool enable_inline_mm_logging;
   bool enable_mm_validate;
+  bool huge_pages;
 
   // Event Logging
   bool event_log_enabled;
@@ -165,6 +208,7 @@ struct PTLsimConfig {
   stringbuf stats_filename;
   W64 snapshot_cycles;
   stringbuf snapshot_now;
+  W64 profile_interval;
 
 #ifndef PTLSIM_HYPERVISOR
   // Starting Point
@@ -209,17 +253,43 @@ struct PTLsimConfig {
 
   // Out of order core features
   bool perfect_cache;
+  bool no_skip_idle_cycles;
+  stringbuf host_simd;
+
+  // Sequential core features
+  bool seq_jit;
 
   // Other info
   stringbuf dumpcode_filename;
   bool dump_at_end;
   bool overshoot_and_dump;
   stringbuf bbcache_dump_filename;
+  stringbuf bbcache_filename;
+  W64 bbcache_budget;
+  bool sse128_uops;
 
 #ifndef PTLSIM_HYPERVISOR
   // Simulation Mode
   W64 sequential_mode_insns;
   bool exit_after_fullsim;
+
+  // Checkpoints
+  W64 checkpoint_interval;
+  stringbuf checkpoint_prefix;
+  stringbuf restore_checkpoint;
+
+  // Input vectors
+  stringbuf vectors_filename;
+  stringbuf vector_regs;
+  W64 vector_max_insns;
+
+  // Interval sampling
+  W64 sample_native_ms;
+  W64 sample_warmup_insns;
+  W64 sample_window_insns;
+
+  // Benchmarks
+  W64 decode_bench_iterations;
 #endif
   void reset();
 };
@@ -22,6 +22,7 @@
 #include <ptlhwdef.h>
 #include <config.h>
 #include <stats.h>
+#include <seqcore.h>
 
 Context ctx alignto(4096) insection(".ctx");
 struct PTLsimConfig;
@@ -92,6 +93,46 @@ public:
     return (W8*)*res + lowbits(addr, 12);
   }
 
+  //
+  // Copy on write, for running input vectors (see run_vectors()):
+  // while enabled, the first write to a page replaces it with a
+  // private copy, and discard_private_pages() puts the original
+  // pages back.
+  //
+  bool copy_on_write;
+  Waddr last_private_page;
+  Hashtable<Waddr, W8*> original_pages;
+
+  void make_private(Waddr addr) {
+    Waddr page = floor(addr, PAGE_SIZE);
+    if likely (page == last_private_page) return;
+    last_private_page = page;
+    if (original_pages.get(page)) return;
+
+    W8** mapped = mapped_mem.get(page);
+    if unlikely (!mapped) return;
+
+    W8* copy = new W8[PAGE_SIZE];
+    memcpy(copy, *mapped, PAGE_SIZE);
+    original_pages.add(page, *mapped);
+    *mapped = copy;
+    // Any code on the page is translated again if it changes:
+    setdirty(page >> 12);
+  }
+
+  void discard_private_pages() {
+    Hashtable<Waddr, W8*>::Iterator iter(&original_pages);
+    KeyValuePair<Waddr, W8*>* kvp;
+    while ((kvp = iter.next())) {
+      W8** mapped = mapped_mem.get(kvp->key);
+      delete[] *mapped;
+      *mapped = kvp->value;
+      setdirty(kvp->key >> 12);
+    }
+    original_pages.clear_and_free();
+    last_private_page = INVALIDRIP;
+  }
+
   //
   // Shadow page attribute table
   //
@@ -199,7 +240,16 @@ bool smc_isdirty(Waddr mfn) { return asp.isdirty(mfn); }
 void smc_setdirty(Waddr mfn) { asp.setdirty(mfn); }
 void smc_cleardirty(Waddr mfn) { asp.cleardirty(mfn); }
 
-bool check_for_async_sim_break() { return false; }
+bool check_for_async_sim_break() {
+  if unlikely ((sim_cycle >= config.stop_at_cycle) |
+               (iterations >= config.stop_at_iteration) |
+               (total_user_insns_committed >= config.stop_at_user_insns)) {
+    logfile << "Stopping simulation loop at specified limits (", iterations, " iterations, ", total_user_insns_committed, " commits)", endl;
+    return true;
+  }
+
+  return false;
+}
 
 int inject_events() { return 0; }
 void print_sysinfo(ostream& os) {}
@@ -282,6 +332,7 @@ int Context::copy_to_user(Waddr target, void* source, int bytes, PageFaultErrorC
     return 0;
   }
 
+  if unlikely (asp.copy_on_write) asp.make_private(target);
   byte* targetlo = (byte*)asp.page_virt_to_mapped(target);
   int nlo = min((Waddr)(4096 - lowbits(target, 12)), (Waddr)bytes);
 
@@ -303,6 +354,7 @@ int Context::copy_to_user(Waddr target, void* source, int bytes, PageFaultErrorC
     return nlo;
   }
 
+  if unlikely (asp.copy_on_write) asp.make_private(target + nlo);
   memcpy(asp.page_virt_to_mapped(target + nlo), (byte*)source + nlo, bytes - nlo);
   memcpy(targetlo, source, nlo);
 
@@ -337,6 +389,8 @@ Waddr Context::check_and_translate(Waddr virtaddr, int sizeshift, bool store, bo
     return 0;
   }
 
+  if unlikely (store & asp.copy_on_write) asp.make_private(signext64(virtaddr, 48));
+
   return (Waddr) asp.page_virt_to_mapped(floor(signext64(virtaddr, 48), 8));
 }
 
@@ -492,6 +546,9 @@ void AddressSpace::reset() {
   writemap = allocmap();
   execmap  = allocmap();
   dirtymap = allocmap();
+
+  copy_on_write = 0;
+  last_private_page = INVALIDRIP;
 }
 
 void AddressSpace::setattr(void* start, Waddr length, int prot) {
@@ -553,9 +610,19 @@ W16 saved_es;
 W16 saved_fs;
 W16 saved_gs;
 
+// Set while running input vectors, which end on exceptions instead of aborting:
+static bool running_vectors = 0;
+static int vector_exception = -1;
+
 void Context::propagate_x86_exception(byte exception, W32 errorcode, Waddr virtaddr) {
   Waddr rip = ctx.commitarf[REG_selfrip];
 
+  if (running_vectors) {
+    vector_exception = exception;
+    requested_switch_to_native = 1;
+    return;
+  }
+
   logfile << "Exception ", exception, " (", x86_exception_names[exception], ") code=", errorcode, " addr=", (void*)virtaddr, " @ rip ", (void*)(Waddr)commitarf[REG_rip], " (", total_user_insns_committed, " commits, ", sim_cycle, " cycles)", endl, flush;
   cerr << "Exception ", exception, " (", x86_exception_names[exception], ") code=", errorcode, " addr=", (void*)virtaddr, " @ rip ", (void*)(Waddr)commitarf[REG_rip], " (", total_user_insns_committed, " commits, ", sim_cycle, " cycles)", endl, flush;
 
@@ -693,6 +760,204 @@ W64 get_core_freq_hz() {
   return 0;
 }
 
+//
+// Architectural checkpoints
+//
+// The first checkpoint of a run is the initial image (<prefix>.base),
+// which stores every mapped page. Later checkpoints only store the pages
+// whose contents differ from that image; the directory entries for all
+// other pages point into the base image file, so a worker restoring any
+// checkpoint maps at most two files.
+//
+
+static const byte checkpoint_zero_page[PAGE_SIZE] = {0};
+
+// Initial image, mapped read-only, used for deduplication:
+static const byte* checkpoint_base = null;
+static W64 checkpoint_base_size = 0;
+static stringbuf checkpoint_base_filename;
+static Hashtable<Waddr, W64> checkpoint_base_pages;
+
+static const CheckpointHeader* map_checkpoint(const char* filename, W64& size) {
+  idstream is(filename);
+  if (!is) {
+    cerr << "Error: cannot open checkpoint file '", filename, "'", endl;
+    return null;
+  }
+
+  size = is.size();
+  const CheckpointHeader* header = (size >= PAGE_SIZE) ? (const CheckpointHeader*)is.mmap(size) : null;
+
+  if unlikely (!header) {
+    cerr << "Error: cannot map checkpoint file '", filename, "'", endl;
+    return null;
+  }
+
+  if unlikely ((header->magic != CheckpointHeader::MAGIC) | (header->version != CheckpointHeader::VERSION) |
+               (header->context_size != sizeof(ContextBase)) |
+               ((header->directory_offset + header->page_count * sizeof(CheckpointPage)) > size)) {
+    cerr << "Error: '", filename, "' is not a compatible checkpoint file", endl;
+    sys_munmap((void*)header, size);
+    return null;
+  }
+
+  return header;
+}
+
+static bool write_checkpoint(const char* filename) {
+  dynarray<Waddr> pagelist;
+  Hashtable<Waddr, W8*>::Iterator iter(&asp.mapped_mem);
+  KeyValuePair<Waddr, W8*>* kvp;
+  while ((kvp = iter.next())) pagelist.push(kvp->key);
+  sort(pagelist.data, pagelist.length, DefaultComparator<Waddr>());
+
+  W64 header_bytes = ceil(sizeof(CheckpointHeader) + sizeof(ContextBase), PAGE_SIZE);
+  W64 directory_bytes = ceil(pagelist.length * sizeof(CheckpointPage), PAGE_SIZE);
+  W64 data_offset = header_bytes + directory_bytes;
+
+  CheckpointPage* directory = new CheckpointPage[pagelist.length];
+  W64 stored = 0;
+
+  foreach (i, pagelist.length) {
+    Waddr virtaddr = pagelist[i];
+    CheckpointPage& page = directory[i];
+    page.virtaddr = virtaddr;
+    page.prot = asp.getattr((void*)virtaddr);
+    page.flags = 0;
+
+    W64* baseoffset = (checkpoint_base) ? checkpoint_base_pages.get(virtaddr) : null;
+    if (baseoffset && (!memcmp(asp.page_virt_to_mapped(virtaddr), checkpoint_base + *baseoffset, PAGE_SIZE))) {
+      page.flags = CHECKPOINT_PAGE_IN_BASE;
+      page.offset = *baseoffset;
+    } else {
+      page.offset = data_offset + (stored * PAGE_SIZE);
+      stored++;
+    }
+  }
+
+  CheckpointHeader header;
+  setzero(header);
+  header.magic = CheckpointHeader::MAGIC;
+  header.version = CheckpointHeader::VERSION;
+  header.insns = total_user_insns_committed;
+  header.cycles = sim_cycle;
+  header.context_offset = sizeof(CheckpointHeader);
+  header.context_size = sizeof(ContextBase);
+  header.directory_offset = header_bytes;
+  header.page_count = pagelist.length;
+  header.stored_page_count = stored;
+  if (checkpoint_base) strncpy(header.base_filename, checkpoint_base_filename, sizeof(header.base_filename)-1);
+
+  odstream os(filename);
+  if (!os) {
+    cerr << "Error: cannot create checkpoint file '", filename, "'", endl;
+    delete[] directory;
+    return false;
+  }
+
+  os.write(&header, sizeof(header));
+  os.write((const ContextBase*)&ctx, sizeof(ContextBase));
+  os.write(checkpoint_zero_page, header_bytes - (sizeof(CheckpointHeader) + sizeof(ContextBase)));
+  os.write(directory, pagelist.length * sizeof(CheckpointPage));
+  os.write(checkpoint_zero_page, directory_bytes - (pagelist.length * sizeof(CheckpointPage)));
+
+  foreach (i, pagelist.length) {
+    if (directory[i].flags & CHECKPOINT_PAGE_IN_BASE) continue;
+    os.write(asp.page_virt_to_mapped(directory[i].virtaddr), PAGE_SIZE);
+  }
+
+  os.close();
+  delete[] directory;
+
+  logfile << "Checkpoint ", filename, " at ", total_user_insns_committed, " commits, ", sim_cycle, " cycles: ",
+    pagelist.length, " pages (", stored, " stored, ", (pagelist.length - stored), " shared with base image)", endl, flush;
+
+  return true;
+}
+
+//
+// Write the base image and schedule the first interval checkpoint
+//
+static bool start_checkpoints() {
+  checkpoint_base_filename.reset();
+  checkpoint_base_filename << config.checkpoint_prefix, ".base";
+
+  if (!write_checkpoint(checkpoint_base_filename)) return false;
+
+  const CheckpointHeader* base = map_checkpoint(checkpoint_base_filename, checkpoint_base_size);
+  if (!base) return false;
+
+  checkpoint_base = (const byte*)base;
+  const CheckpointPage* directory = (const CheckpointPage*)(checkpoint_base + base->directory_offset);
+  foreach (i, base->page_count) checkpoint_base_pages.add(directory[i].virtaddr, directory[i].offset);
+
+  W64 interval = config.checkpoint_interval;
+  next_checkpoint_at_insns = (total_user_insns_committed - (total_user_insns_committed % interval)) + interval;
+  return true;
+}
+
+void capture_checkpoint() {
+  stringbuf filename;
+  filename << config.checkpoint_prefix, ".", total_user_insns_committed;
+  if (!write_checkpoint(filename)) {
+    next_checkpoint_at_insns = infinity;
+    return;
+  }
+
+  next_checkpoint_at_insns += config.checkpoint_interval;
+}
+
+static bool restore_checkpoint(const char* filename) {
+  W64 size;
+  const CheckpointHeader* header = map_checkpoint(filename, size);
+  if (!header) return false;
+
+  const byte* image = (const byte*)header;
+  const byte* base = null;
+  W64 base_size = 0;
+
+  if (header->base_filename[0]) {
+    base = (const byte*)map_checkpoint(header->base_filename, base_size);
+    if (!base) {
+      sys_munmap((void*)header, size);
+      return false;
+    }
+  }
+
+  const CheckpointPage* directory = (const CheckpointPage*)(image + header->directory_offset);
+
+  foreach (i, header->page_count) {
+    const CheckpointPage& page = directory[i];
+    const byte* source = (page.flags & CHECKPOINT_PAGE_IN_BASE) ? base : image;
+    W64 source_size = (page.flags & CHECKPOINT_PAGE_IN_BASE) ? base_size : size;
+
+    if unlikely ((!source) | ((page.offset + PAGE_SIZE) > source_size)) {
+      cerr << "Error: checkpoint '", filename, "' page ", (void*)page.virtaddr, " is out of bounds", endl;
+      if (base) sys_munmap((void*)base, base_size);
+      sys_munmap((void*)header, size);
+      return false;
+    }
+
+    asp.map(page.virtaddr, PAGE_SIZE, page.prot);
+    memcpy(asp.page_virt_to_mapped(page.virtaddr), source + page.offset, PAGE_SIZE);
+  }
+
+  memcpy((ContextBase*)&ctx, image + header->context_offset, sizeof(ContextBase));
+  // Internal pointers refer to this process:
+  ctx.commitarf[REG_ctx] = (Waddr)&ctx;
+  ctx.commitarf[REG_fpstack] = (Waddr)&ctx.fpstack;
+
+  total_user_insns_committed = header->insns;
+
+  logfile << "Restored checkpoint ", filename, " at ", header->insns, " commits: ", header->page_count, " pages (",
+    header->stored_page_count, " stored, ", (header->page_count - header->stored_page_count), " from base image ", header->base_filename, ")", endl, flush;
+
+  if (base) sys_munmap((void*)base, base_size);
+  sys_munmap((void*)header, size);
+
+  return true;
+}
+
 //
 // Main simulation driver function
 //
@@ -700,6 +965,13 @@ void switch_to_sim() {
   static const bool DEBUG = 0;
 }
 
+static int find_arch_reg(const char* name) {
+  foreach (j, sizeof(arch_reg_names) / sizeof(arch_reg_names[0])) {
+    if (!strcmp(name, arch_reg_names[j])) return j;
+  }
+  return -1;
+}
+
 bool handle_config_arg(char* line, dynarray<Waddr>* dump_pages) {
   if (*line == '\0') return false;
   dynarray<char*> toks;
@@ -780,12 +1052,7 @@ bool handle_config_arg(char* line, dynarray<Waddr>* dump_pages) {
       cerr << "Error: option ", line, " has wrong number of arguments", endl;
       return true;
     }
-    int reg = -1;
-    foreach (j, sizeof(arch_reg_names) / sizeof(arch_reg_names[0])) {
-      if (!strcmp(toks[0], arch_reg_names[j])) {
-        reg = j; break;
-      }
-    }
+    int reg = find_arch_reg(toks[0]);
     if (reg < 0) {
       cerr << "Error: invalid register ", toks[0], endl;
       return true;
@@ -802,6 +1069,208 @@ bool handle_config_arg(char* line, dynarray<Waddr>* dump_pages) {
   return false;
 }
 
+//
+// Input vectors
+//
+// Each line of the vector file is one run of the code from the
+// initial state: commands to apply first (registers and W commands,
+// as on the command line), separated by ';', then optionally '='
+// and the expected outputs in the same form, e.g.
+//
+//   rdi 0x5; W300000 0102 = rax 0x8; W300010 ff
+//
+// All runs share one translation of the code (the basic block cache
+// and its links stay warm), and each one gets the initial registers
+// and private copies of the pages it writes. Running stops at the
+// first output that differs from the expected one.
+//
+
+// Trim leading and trailing spaces in place
+static char* trim(char* s) {
+  while (*s == ' ') s++;
+  char* end = s + strlen(s);
+  while ((end > s) && (end[-1] == ' ')) *--end = 0;
+  return s;
+}
+
+static bool apply_vector_input(char* item) {
+  if ((item[0] == 'M') | (item[0] == 'D')) {
+    cerr << "Error: ", item, ": input vectors cannot map or dump pages", endl;
+    return true;
+  }
+
+  if (item[0] == 'W') {
+    Waddr addr = strtoull(item + 1, null, 16);
+    asp.make_private(addr);
+  }
+
+  return handle_config_arg(item, null);
+}
+
+// Returns true (and describes it in <sb>) if the output differs
+static bool check_vector_output(char* item, stringbuf& sb) {
+  dynarray<char*> toks;
+  toks.tokenize(item, " ");
+  if (toks.size() != 2) {
+    sb << " bad output '", item, "'";
+    return true;
+  }
+
+  if (toks[0][0] == 'W') {
+    Waddr addr = strtoull(toks[0] + 1, null, 16);
+    const byte* mapped = (const byte*)asp.page_virt_to_mapped(addr);
+    int n = strlen(toks[1]) / 2;
+    if ((!mapped) | (n > (PAGE_SIZE - lowbits(addr, 12)))) {
+      sb << " bad output '", toks[0], "'";
+      return true;
+    }
+    foreach (i, n) {
+      char hex_byte[3] = {toks[1][i*2], toks[1][i*2+1], 0};
+      byte expected = strtoul(hex_byte, null, 16);
+      if (mapped[i] != expected) {
+        sb << " mismatch at ", (void*)(addr + i), ": expected ", hexstring(expected, 8), ", got ", hexstring(mapped[i], 8);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int reg = find_arch_reg(toks[0]);
+  if (reg < 0) {
+    sb << " bad output '", toks[0], "'";
+    return true;
+  }
+
+  W64 expected = strtoull(toks[1], null, 0);
+  if (ctx.commitarf[reg] != expected) {
+    sb << " mismatch in ", toks[0], ": expected 0x", hexstring(expected, 64), ", got 0x", hexstring(ctx.commitarf[reg], 64);
+    return true;
+  }
+
+  return false;
+}
+
+static bool run_vectors(const char* filename) {
+  istream is(filename);
+  if (!is) {
+    cerr << "Error: cannot open vector file '", filename, "'", endl;
+    return false;
+  }
+
+  dynarray<char*> lines;
+  stringbuf line;
+  for (;;) {
+    line.reset();
+    is >> line;
+    if (!is) break;
+    char* p = strchr(line, '#');
+    if (p) *p = 0;
+    if (*trim(line)) lines.push(strdup(trim(line)));
+  }
+
+  dynarray<int> outregs;
+  {
+    stringbuf regs;
+    regs << config.vector_regs;
+    dynarray<char*> names;
+    names.tokenize(regs, ",");
+    foreach (i, names.length) {
+      int reg = find_arch_reg(trim(names[i]));
+      if (reg < 0) {
+        cerr << "Error: invalid register '", names[i], "' in -vector-regs", endl;
+        return false;
+      }
+      outregs.push(reg);
+    }
+  }
+
+  ContextBase initial = ctx;
+  asp.copy_on_write = 1;
+  running_vectors = 1;
+
+  W64 insns = 0;
+  int vectors = 0;
+  bool mismatch = 0;
+
+  CycleTimer timer;
+  timer.start();
+
+  foreach (n, lines.length) {
+    char* inputs = lines[n];
+    char* outputs = strchr(inputs, '=');
+    if (outputs) *outputs++ = 0;
+
+    memcpy((ContextBase*)&ctx, &initial, sizeof(ContextBase));
+
+    bool err = 0;
+    dynarray<char*> items;
+    items.tokenize(inputs, ";");
+    foreach (i, items.length) {
+      if (*trim(items[i])) err |= apply_vector_input(trim(items[i]));
+    }
+
+    if (err) {
+      cerr << "Error: could not parse input vector ", n, endl;
+      mismatch = 1;
+      break;
+    }
+
+    vector_exception = -1;
+    W64 vector_insns = run_sequential(ctx, config.vector_max_insns);
+    insns += vector_insns;
+    vectors++;
+
+    stringbuf sb;
+    sb << "Vector ", n, ":";
+    foreach (i, outregs.length) sb << " ", arch_reg_names[outregs[i]], " 0x", hexstring(ctx.commitarf[outregs[i]], 64);
+    sb << " (", vector_insns, " insns)";
+
+    bool bad = 0;
+    if (vector_exception >= 0) {
+      sb << " exception ", x86_exception_names[vector_exception], " at rip ", (void*)(Waddr)ctx.commitarf[REG_selfrip];
+      bad = 1;
+    } else if (!requested_switch_to_native) {
+      sb << " stopped after ", config.vector_max_insns, " insns";
+      bad = 1;
+    }
+
+    if (outputs) {
+      items.clear();
+      items.tokenize(outputs, ";");
+      foreach (i, items.length) {
+        if (*trim(items[i])) bad |= check_vector_output(trim(items[i]), sb);
+        if (bad) break;
+      }
+    }
+
+    cerr << sb, endl;
+    asp.discard_private_pages();
+
+    if (bad && outputs) {
+      mismatch = 1;
+      break;
+    }
+  }
+
+  timer.stop();
+
+  running_vectors = 0;
+  asp.copy_on_write = 0;
+  memcpy((ContextBase*)&ctx, &initial, sizeof(ContextBase));
+
+  double seconds = timer.seconds();
+  stringbuf sb;
+  sb << "Ran ", vectors, " of ", lines.length, " vectors (", insns, " instructions) in ", floatstring(seconds, 0, 3), " seconds: ",
+    floatstring((double)vectors / seconds, 0, 1), " vectors/sec";
+  if (mismatch) sb << "; stopped at the first mismatch";
+  cerr << sb, endl, flush;
+  logfile << sb, endl, flush;
+
+  foreach (i, lines.length) free(lines[i]);
+
+  return (!mismatch);
+}
+
 //
 // PTLsim main: called after ptlsim_preinit() brings up boot subsystems
 //
@@ -850,6 +1319,12 @@ int main(int argc, char** argv) {
 
   dynarray<Waddr> dump_pages;
 
+  // Restored state comes first so explicit arguments can override it:
+  if (config.restore_checkpoint.set() && (!restore_checkpoint(config.restore_checkpoint))) {
+    cerr << "Error: could not restore checkpoint", endl, flush;
+    sys_exit(1);
+  }
+
   // TODO(AE): set seccomp filter before parsing arguments
   bool parse_err = false;
   for (unsigned i = ptlsim_arg_count; i < argc; i++) {
@@ -880,6 +1355,11 @@ int main(int argc, char** argv) {
     sys_exit(1);
   }
 
+  if (config.decode_bench_iterations) {
+    decode_benchmark(ctx, ctx.commitarf[REG_rip], config.decode_bench_iterations);
+    sys_exit(0);
+  }
+
   // asp.map(0x100000, 0x1000, PROT_READ|PROT_WRITE|PROT_EXEC);
   // W64 endless_loop = 0x80cdc031c031;
   // // endless_loop = 0xfeeb;
@@ -903,6 +1383,19 @@ int main(int argc, char** argv) {
   //
   x86_set_mxcsr(ctx.mxcsr | MXCSR_EXCEPTION_DISABLE_MASK);
 
+  if (config.vectors_filename.set()) {
+    bool ok = run_vectors(config.vectors_filename);
+    capture_stats_snapshot("final");
+    flush_stats();
+    logfile.flush();
+    sys_exit((ok) ? 0 : 1);
+  }
+
+  if (config.checkpoint_interval && (!start_checkpoints())) {
+    cerr << "Error: could not write initial checkpoint image", endl, flush;
+    sys_exit(1);
+  }
+
   simulate(config.core_name);
   capture_stats_snapshot("final");
   flush_stats();
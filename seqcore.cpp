@@ -531,14 +531,64 @@ ostream& SequentialCoreEventLog::print(ostream& os, bool only_to_tail, W64 bbcou
 
 static SequentialCoreEventLog eventlog;
 
+//
+// Host code for hot basic blocks (seq-jit option)
+//
+// Each hot block is compiled into a call-threaded x86-64 function: ALU
+// uops call their uop implementation directly and commit the result
+// inline; branches, loads and stores go through the same code as the
+// interpreter's fast path. The function returns the index of the first
+// uop it did not execute, and the interpreter continues from there.
+//
+#ifdef __x86_64__
+#define ENABLE_SEQUENTIAL_JIT
+#endif
+
+#ifdef ENABLE_SEQUENTIAL_JIT
+struct SequentialCore;
+
+typedef int (*seqjit_func_t)(W64* arf, W16* arflags, SequentialCore* core);
+
+struct SequentialJitBlock {
+  seqjit_func_t code;
+  // Number of x86 instructions completed before each uop
+  byte insns_before[MAX_BB_UOPS*2 + 1];
+};
+
+static const int SEQUENTIAL_JIT_THRESHOLD = 16;
+static const int SEQUENTIAL_JIT_CACHE_SIZE = 4*1024*1024;
+
+struct SequentialJitCache {
+  byte* base;
+  int used;
+  // Bumped on every flush, which drops all compiled blocks at once:
+  W64 generation;
+
+  SequentialJitCache() { base = null; used = 0; generation = 1; }
+
+  SequentialJitBlock* get(SequentialCore& core, BasicBlock& bb) {
+    if likely ((bb.jitcode) && (bb.jit_generation == generation)) return (SequentialJitBlock*)bb.jitcode;
+    return compile(core, bb);
+  }
+
+  SequentialJitBlock* compile(SequentialCore& core, BasicBlock& bb);
+  void flush();
+};
+
+static SequentialJitCache seqjit;
+#endif
+
 struct SequentialCore {
   Context& ctx;
   CommitRecord* cmtrec;
 
-  SequentialCore(): ctx(contextof(0)), cmtrec(null) { }
-  SequentialCore(Context& ctx_, CommitRecord* cmtrec_ = null): ctx(ctx_), cmtrec(cmtrec_) { }
+  SequentialCore(): ctx(contextof(0)), cmtrec(null), chained_from(null) { }
+  SequentialCore(Context& ctx_, CommitRecord* cmtrec_ = null): ctx(ctx_), cmtrec(cmtrec_), chained_from(null) { }
 
   BasicBlock* current_basic_block;
+  // Last block that fell through normally, and the bbcache generation it was valid in:
+  BasicBlock* chained_from;
+  W64 chained_generation;
   int bytes_in_current_insn;
   int current_uop_in_macro_op;
   W64 current_uuid;
@@ -593,6 +643,7 @@ struct SequentialCore {
   void reset_fetch(W64 realrip) {
     arf[REG_rip] = realrip;
     current_basic_block = null;
+    chained_from = null;
   }
 
   enum {
@@ -822,7 +873,7 @@ struct SequentialCore {
       if unlikely (cmtrec) {
         data = transactmem.load(state.physaddr << 3);
       } else {
-        logfile << "[cycle ", sim_cycle, "] load from physaddr ", (void*)physaddr, " for virtaddr ", (void*)origaddr, endl;
+        if (logable(6)) logfile << "[cycle ", sim_cycle, "] load from physaddr ", (void*)physaddr, " for virtaddr ", (void*)origaddr, endl;
         data = loadphys(physaddr);
       }
     }
@@ -907,23 +958,21 @@ struct SequentialCore {
     return ISSUE_COMPLETED;
   }
 
+  //
+  // These run around every assist, so they copy and clear the
+  // register file in bulk rather than one register at a time:
+  //
   void external_to_core_state(const Context& ctx) {
-    foreach (i, ARCHREG_COUNT) {
-      arf[i] = ctx.commitarf[i];
-      arflags[i] = 0;
-    }
-    for (int i = ARCHREG_COUNT; i < TRANSREG_COUNT; i++) {
-      arf[i] = 0;
-      arflags[i] = 0;
-    }
+    chained_from = null;
+    memcpy(arf, ctx.commitarf, ARCHREG_COUNT * sizeof(W64));
+    memset(arf + ARCHREG_COUNT, 0, (TRANSREG_COUNT - ARCHREG_COUNT) * sizeof(W64));
+    memset(arflags, 0, sizeof(arflags));
 
     arflags[REG_flags] = ctx.commitarf[REG_flags];
   }
 
   void core_to_external_state(Context& ctx) {
-    foreach (i, ARCHREG_COUNT) {
-      ctx.commitarf[i] = arf[i];
-    }
+    memcpy(ctx.commitarf, arf, ARCHREG_COUNT * sizeof(W64));
   }
 
   bool handle_barrier() {
@@ -940,7 +989,7 @@ struct SequentialCore {
 
     if (logable(6)) logfile << "Calling assist function at ", (void*)assist, "...", endl, flush; 
 
-    update_assist_stats(assist);
+    update_assist_stats(assistid);
     if (logable(6)) {
       logfile << "Before assist:", endl, ctx, endl;
 #ifdef PTLSIM_HYPERVISOR
@@ -1070,6 +1119,197 @@ struct SequentialCore {
     return current_basic_block;
   }
 
+  //
+  // Pre-decode the block for the fast path in execute(). Anything
+  // the fast path does not handle itself becomes SEQUOP_SLOW and
+  // is left to the generic code.
+  //
+  void predecode_basic_block(BasicBlock& bb) {
+    if unlikely (!bb.synthops) synth_uops_for_bb(bb);
+    bb.seqops = new SequentialUop[bb.count];
+
+    foreach (i, bb.count) {
+      TransOp uop;
+      bb.getuop(i, uop);
+      SequentialUop& su = bb.seqops[i];
+      setzero(su);
+
+      su.synthop = bb.synthops[i];
+      su.ra = archreg_remap_table[uop.ra];
+      su.rb = archreg_remap_table[uop.rb];
+      su.rc = archreg_remap_table[uop.rc];
+      su.rd = uop.rd;
+      su.rbimm = uop.rbimm;
+      su.rcimm = uop.rcimm;
+      su.rbimm_valid = (uop.rb == REG_imm);
+      su.rcimm_valid = (uop.rc == REG_imm);
+      su.userflags = (!uop.nouserflags);
+      su.flagmask = setflags_to_x86_flags[uop.setflags];
+      su.som = uop.som;
+      su.eom = uop.eom;
+      su.bytes = uop.bytes;
+      su.is_sse = uop.is_sse;
+      su.is_x87 = uop.is_x87;
+      su.barrier = isclass(uop.opcode, OPCLASS_BARRIER);
+
+      if unlikely (uop.unaligned) {
+        su.type = SEQUOP_SLOW;
+      } else if unlikely (uop.vec128) {
+        su.type = SEQUOP_VEC128;
+      } else if (isload(uop.opcode)) {
+        su.type = SEQUOP_LOAD;
+      } else if (isstore(uop.opcode)) {
+        su.type = (uop.opcode == OP_st) ? SEQUOP_STORE : SEQUOP_SLOW;
+      } else if (isbranch(uop.opcode)) {
+        su.type = SEQUOP_BRANCH;
+      } else {
+        su.type = SEQUOP_ALU;
+      }
+    }
+  }
+
+  //
+  // Check for self modifying code (SMC) by checking if any previous
+  // instruction has dirtied the code page(s) of the current block.
+  //
+  bool check_for_smc(Waddr mfnlo, Waddr mfnhi) {
+    if likely (!(smc_isdirty(mfnlo) | ((mfnhi != mfnlo) && smc_isdirty(mfnhi)))) return false;
+
+    logfile << "Self-modifying code at rip ", (void*)(Waddr)arf[REG_rip], " detected: mfn was dirty (invalidate and retry)", endl;
+    bbcache.invalidate_page(mfnlo, INVALIDATE_REASON_SMC);
+    if (mfnlo != mfnhi) bbcache.invalidate_page(mfnhi, INVALIDATE_REASON_SMC);
+    return true;
+  }
+
+  //
+  // Commit the result of a uop on the fast path
+  //
+  void commit_fast_result(const SequentialUop& su, const IssueState& state) {
+    if likely (su.rd != REG_zero) {
+      arf[su.rd] = state.reg.rddata;
+      arflags[su.rd] = state.reg.rdflags;
+
+      if (su.userflags) {
+        arf[REG_flags] = (arf[REG_flags] & ~su.flagmask) | (state.reg.rdflags & su.flagmask);
+        arflags[REG_flags] = arf[REG_flags];
+      }
+    }
+
+    if likely (su.eom) {
+      arf[REG_rip] = (su.rd == REG_rip) ? state.reg.rddata : (arf[REG_rip] + bytes_in_current_insn);
+    }
+  }
+
+  //
+  // Issue and commit a branch, load, store or vec128 uop on the fast
+  // path. Returns false without side effects if the generic code has
+  // to handle this uop instead.
+  //
+  bool execute_fast_uop(BasicBlock& bb, int uopindex, Waddr mfnlo, Waddr mfnhi, bool& check_smc) {
+    const SequentialUop& su = bb.seqops[uopindex];
+    TransOp uop;
+    bb.getuop(uopindex, uop);
+
+    IssueState state;
+    state.reg.rdflags = 0;
+
+    W64 radata = arf[su.ra];
+    W64 rbdata = (su.rbimm_valid) ? su.rbimm : arf[su.rb];
+    W64 rcdata = (su.rcimm_valid) ? su.rcimm : arf[su.rc];
+
+    if (su.type == SEQUOP_VEC128) {
+      int rahi = vec128_hi(su.ra);
+      int rbhi = vec128_hi(su.rb);
+      W64 rahidata = arf[rahi];
+      W64 rbhidata = (su.rbimm_valid) ? su.rbimm : arf[rbhi];
+
+      IssueState hi;
+      hi.reg.rdflags = 0;
+      su.synthop(state, radata, rbdata, rcdata, arflags[su.ra], arflags[su.rb], arflags[su.rc]);
+      su.synthop(hi, rahidata, rbhidata, rcdata, arflags[rahi], arflags[rbhi], arflags[su.rc]);
+      if unlikely ((state.reg.rdflags | hi.reg.rdflags) & FLAG_INV) return false;
+
+      arf[su.rd + 1] = hi.reg.rddata;
+      arflags[su.rd + 1] = hi.reg.rdflags;
+      commit_fast_result(su, state);
+      return true;
+    }
+
+    if (su.type == SEQUOP_BRANCH) {
+      state.brreg.riptaken = uop.riptaken;
+      state.brreg.ripseq = uop.ripseq;
+      su.synthop(state, radata, rbdata, rcdata, arflags[su.ra], arflags[su.rb], arflags[su.rc]);
+
+      bb.predcount += (uop.opcode == OP_jmp) ? (state.reg.rddata == bb.lasttarget) : (state.reg.rddata == uop.riptaken);
+      bb.lasttarget = state.reg.rddata;
+
+      commit_fast_result(su, state);
+      return true;
+    }
+
+    SFR sfr;
+    PTEUpdate pteupdate = 0;
+    Waddr origvirt = 0;
+
+    int status = (su.type == SEQUOP_LOAD) ?
+      issueload(uop, sfr, origvirt, radata, rbdata, rcdata, pteupdate) :
+      issuestore(uop, sfr, origvirt, radata, rbdata, rcdata, pteupdate);
+    if unlikely ((status != ISSUE_COMPLETED) | (pteupdate != 0)) return false;
+
+    state.reg.rddata = sfr.data;
+
+    if (su.type == SEQUOP_STORE) {
+      if (sfr.bytemask) {
+        storemask(sfr.physaddr << 3, sfr.data, sfr.bytemask);
+        Waddr mfn = (sfr.physaddr << 3) >> 12;
+        smc_setdirty(mfn);
+        check_smc |= ((mfn == mfnlo) | (mfn == mfnhi));
+      }
+      if likely (su.eom) arf[REG_rip] = (su.rd == REG_rip) ? state.reg.rddata : (arf[REG_rip] + bytes_in_current_insn);
+    } else {
+      commit_fast_result(su, state);
+    }
+
+    return true;
+  }
+
+#ifdef ENABLE_SEQUENTIAL_JIT
+  // Flags at the start of the current x86 insn, saved by host code:
+  W64 jit_saved_flags;
+
+  //
+  // Account for the first <uopindex> uops of <bb>, just committed by
+  // its host code, as if the fast path loop had run them.
+  //
+  void seqjit_committed(const BasicBlock& bb, const SequentialJitBlock* jit, int uopindex, W64& saved_flags,
+                        int& current_uop_in_macro_op, int& user_insns, bool& barrier) {
+    int insns = jit->insns_before[uopindex];
+    int first_uop_in_insn = uopindex;
+    while ((first_uop_in_insn > 0) && (first_uop_in_insn < bb.count) && (!bb.seqops[first_uop_in_insn].som)) first_uop_in_insn--;
+
+    fetch_user_insns_fetched += insns + (first_uop_in_insn != uopindex);
+    fetch_uops_fetched += uopindex;
+    total_uops_committed += uopindex;
+    seq_total_uops_committed += uopindex;
+    seq_total_user_insns_committed += insns;
+    if (!suppress_total_user_insn_count_updates_in_seqcore) total_user_insns_committed += insns;
+    user_insns += insns;
+    stats.summary.insns += insns;
+    stats.summary.uops += uopindex;
+    current_uuid += uopindex;
+
+    current_uop_in_macro_op = uopindex - first_uop_in_insn;
+    if (uopindex) {
+      barrier = bb.seqops[uopindex-1].barrier;
+      saved_flags = jit_saved_flags;
+    }
+
+    stats.seqjit.blocks_executed++;
+    stats.seqjit.uops += uopindex;
+    stats.seqjit.early_exits += (uopindex < bb.count);
+  }
+#endif
+
   //
   // Execute one basic block sequentially
   //
@@ -1107,13 +1347,104 @@ struct SequentialCore {
     seq_total_basic_blocks++;
     total_basic_blocks_committed++;
 
-    RIPVirtPhys rvp(arf[REG_rip]);
-
     assert(bb->rip.rip == arf[REG_rip]);
 
+    //
+    // The code page(s) of this block can only become dirty before we
+    // enter it or through one of its own stores, so they are checked
+    // on entry and then again only after such a store:
+    //
+    Waddr mfnlo = bb->rip.mfnlo;
+    Waddr mfnhi = (((lowbits(bb->rip, 12) + (bb->bytes-1)) >> 12) ? (Waddr)bb->rip.mfnhi : mfnlo);
+    bool check_smc = 1;
+
     // See comment below about idempotent updates
     W64 saved_flags = 0;
 
+    //
+    // Fast path: run the pre-decoded uops of the block as long as
+    // nothing needs logging, splitting or exception handling. On the
+    // first uop that does, we stop before issuing it and fall through
+    // to the generic loop below, which picks up at that same uop.
+    //
+    bool fast = (!config.event_log_enabled) & (!cmtrec) & (!logable(6)) & (insnlimit >= bb->user_insn_count) &
+      (!inrange(config.stop_at_rip, (W64)bb->rip, (W64)bb->rip + (bb->bytes-1))) &
+      (!inrange(config.start_log_at_rip, (W64)bb->rip, (W64)bb->rip + (bb->bytes-1)));
+
+    if likely (fast) {
+      if unlikely (!bb->seqops) predecode_basic_block(*bb);
+      const SequentialUop* seqops = bb->seqops;
+      ctx.exception = 0;
+
+#ifdef ENABLE_SEQUENTIAL_JIT
+      //
+      // Hot blocks run as host code up to the first uop it cannot
+      // handle; the loop below then continues from there.
+      //
+      if unlikely (config.seq_jit && (bb->hitcount >= SEQUENTIAL_JIT_THRESHOLD)) {
+        if unlikely (check_for_smc(mfnlo, mfnhi)) return SEQEXEC_SMC;
+        check_smc = 0;
+
+        SequentialJitBlock* jit = seqjit.get(*this, *bb);
+        if likely (jit) {
+          uopindex = jit->code(arf, arflags, this);
+          seqjit_committed(*bb, jit, uopindex, saved_flags, current_uop_in_macro_op, user_insns, barrier);
+          // The host code stops early after stores to our own code pages:
+          check_smc = (uopindex < bb->count);
+        }
+      }
+#endif
+
+      while (uopindex < bb->count) {
+        const SequentialUop& su = seqops[uopindex];
+        if unlikely ((su.type == SEQUOP_SLOW) | (su.is_sse & ctx.no_sse) | (su.is_x87 & ctx.no_x87)) break;
+
+        if likely (su.som) {
+          current_uop_in_macro_op = 0;
+          bytes_in_current_insn = su.bytes;
+          fetch_user_insns_fetched++;
+          saved_flags = arf[REG_flags];
+
+          if unlikely (check_smc) {
+            check_smc = 0;
+            if unlikely (check_for_smc(mfnlo, mfnhi)) return SEQEXEC_SMC;
+          }
+        }
+
+        if likely (su.type == SEQUOP_ALU) {
+          IssueState state;
+          state.reg.rdflags = 0;
+
+          W64 radata = arf[su.ra];
+          W64 rbdata = (su.rbimm_valid) ? su.rbimm : arf[su.rb];
+          W64 rcdata = (su.rcimm_valid) ? su.rcimm : arf[su.rc];
+
+          su.synthop(state, radata, rbdata, rcdata, arflags[su.ra], arflags[su.rb], arflags[su.rc]);
+          if unlikely (state.reg.rdflags & FLAG_INV) break;
+
+          commit_fast_result(su, state);
+        } else {
+          if unlikely (!execute_fast_uop(*bb, uopindex, mfnlo, mfnhi, check_smc)) break;
+        }
+
+        fetch_uops_fetched++;
+        total_uops_committed++;
+        seq_total_uops_committed++;
+
+        barrier = su.barrier;
+
+        seq_total_user_insns_committed += su.eom;
+        total_user_insns_committed += su.eom && (!suppress_total_user_insn_count_updates_in_seqcore);
+        user_insns += su.eom;
+        stats.summary.insns += su.eom;
+        stats.summary.uops++;
+
+        current_uuid++;
+        uopindex++;
+        current_uop_in_macro_op++;
+      }
+    }
+
     while ((uopindex < bb->count) & (user_insns < insnlimit)) {
       TransOp uop;
       uopimpl_func_t synthop = null;
@@ -1128,7 +1459,7 @@ struct SequentialCore {
       }
 
       if likely (!unaligned_ldst_buf.get(uop, synthop)) {
-        uop = bb->transops[uopindex];
+        bb->getuop(uopindex, uop);
         synthop = bb->synthops[uopindex];
       }
 
@@ -1144,8 +1475,6 @@ struct SequentialCore {
         current_uop_in_macro_op = 0;
         bytes_in_current_insn = uop.bytes;
         fetch_user_insns_fetched++;
-        // Update the span of bytes to watch for SMC:
-        rvp.update(ctx, uop.bytes);
         //
         // Save the flags at the start of this x86 insn in
         // case an ALU uop inside the macro-op updates the
@@ -1161,13 +1490,12 @@ struct SequentialCore {
       // instruction has dirtied the page(s) on which the current instruction
       // resides. The SMC check is done first since it's perfectly legal for a
       // store to overwrite its own instruction bytes, but this update only
-      // becomes visible after the store has committed.
+      // becomes visible after the store has committed. It is only done at
+      // instruction boundaries so we never restart half an instruction.
       //
-      if unlikely (smc_isdirty(rvp.mfnlo) | (smc_isdirty(rvp.mfnhi))) {
-        logfile << "Self-modifying code at rip ", rvp, " detected: mfn was dirty (invalidate and retry)", endl;
-        bbcache.invalidate_page(rvp.mfnlo, INVALIDATE_REASON_SMC);
-        if (rvp.mfnlo != rvp.mfnhi) bbcache.invalidate_page(rvp.mfnhi, INVALIDATE_REASON_SMC);
-        return SEQEXEC_SMC;
+      if unlikely (check_smc & uop.som) {
+        check_smc = 0;
+        if unlikely (check_for_smc(mfnlo, mfnhi)) return SEQEXEC_SMC;
       }
 
       fetch_uops_fetched++;
@@ -1179,6 +1507,10 @@ struct SequentialCore {
       state.reg.rdflags = 0;
       ctx.exception = 0;
 
+      // High half of a vec128 uop:
+      IssueState histate;
+      histate.reg.rdflags = 0;
+
       IssueInput input;
       W64 radata = arf[archreg_remap_table[uop.ra]];
       W64 rbdata = (uop.rb == REG_imm) ? uop.rbimm : arf[archreg_remap_table[uop.rb]];
@@ -1250,7 +1582,8 @@ struct SequentialCore {
             SequentialCoreEvent* event = eventlog.add(EVENT_ALIGNMENT_FIXUP, ctx.vcpuid, uop, rip, current_uop_in_macro_op, current_uuid, total_user_insns_committed);
             event->alignfixup.uopindex = uopindex;
           }
-          bb->transops[uopindex].unaligned = 1;
+          bb->uops[uopindex].unaligned = 1;
+          if (bb->seqops) bb->seqops[uopindex].type = SEQUOP_SLOW;
           continue;
         }
       } else if unlikely (br) {
@@ -1269,6 +1602,13 @@ struct SequentialCore {
       } else {
         assert((void*)synthop);
         synthop(state, radata, rbdata, rcdata, raflags, rbflags, rcflags);
+        if unlikely (uop.vec128) {
+          int rahi = archreg_remap_table[vec128_hi(uop.ra)];
+          int rbhi = archreg_remap_table[vec128_hi(uop.rb)];
+          W64 rbhidata = (uop.rb == REG_imm) ? uop.rbimm : arf[rbhi];
+          synthop(histate, arf[rahi], rbhidata, rcdata, arflags[rahi], arflags[rbhi], rcflags);
+          if unlikely ((histate.reg.rdflags & FLAG_INV) && !(state.reg.rdflags & FLAG_INV)) state.reg = histate.reg;
+        }
         if unlikely (state.reg.rdflags & FLAG_INV) ctx.exception = LO32(state.reg.rddata);
 
         if unlikely (config.event_log_enabled) {
@@ -1317,10 +1657,16 @@ struct SequentialCore {
 
           Waddr mfn = (sfr.physaddr << 3) >> 12;
           smc_setdirty(mfn); // why is this being passed zero?
+          check_smc |= ((mfn == mfnlo) | (mfn == mfnhi));
         }
       } else if likely (uop.rd != REG_zero) {
         arf[uop.rd] = state.reg.rddata;
         arflags[uop.rd] = state.reg.rdflags;
+
+        if unlikely (uop.vec128) {
+          arf[uop.rd + 1] = histate.reg.rddata;
+          arflags[uop.rd + 1] = histate.reg.rdflags;
+        }
         
         if (!uop.nouserflags) {
           W64 flagmask = setflags_to_x86_flags[uop.setflags];
@@ -1403,12 +1749,34 @@ struct SequentialCore {
 
   int execute() {
     Waddr rip = arf[REG_rip];
-    
-    current_basic_block = fetch_or_translate_basic_block(rip);
+
+    //
+    // Follow the direct link from the previous block if we have one,
+    // otherwise look up (or translate) the block and link to it. Any
+    // invalidation in between bumps the bbcache generation and
+    // breaks all links, including the one held in chained_from.
+    //
+    BasicBlock* bb = null;
+    if likely (chained_from && (chained_generation == bbcache.generation)) bb = bbcache.successor(chained_from, rip);
+
+    if likely (bb) {
+      stats.decoder.bbcache.links_followed++;
+      bb->use(sim_cycle);
+      current_basic_block = bb;
+    } else {
+      W64 generation = bbcache.generation;
+      bb = fetch_or_translate_basic_block(rip);
+      if (chained_from && (chained_generation == generation) && (bbcache.generation == generation)) bbcache.link(chained_from, bb);
+    }
 
     bool exiting = 0;
 
-    int result = execute(current_basic_block, (config.stop_at_user_insns - total_user_insns_committed));
+    // Stop exactly on the next checkpoint boundary, if any comes first:
+    W64 insnlimit = min(config.stop_at_user_insns, next_checkpoint_at_insns) - total_user_insns_committed;
+    int result = execute(bb, insnlimit);
+
+    chained_from = (result == SEQEXEC_OK) ? bb : null;
+    chained_generation = bbcache.generation;
     
     switch (result) {
     case SEQEXEC_OK:
@@ -1417,7 +1785,7 @@ struct SequentialCore {
       // no action required
       break;
     case SEQEXEC_EARLY_EXIT:
-      exiting = 1;
+      exiting = (total_user_insns_committed >= config.stop_at_user_insns) | (arf[REG_rip] == config.stop_at_rip);
       break;
     case SEQEXEC_EXCEPTION:
     case SEQEXEC_INVALIDRIP:
@@ -1473,11 +1841,12 @@ struct SequentialCore {
       if likely (trans.ptehi.p) smc_cleardirty(trans.ptehi.mfn);
       
       W64 user_insns_at_start = seq_total_user_insns_committed;
-      result = execute(&trans.bb, insncount);
+      BasicBlock* bb = trans.bb.clone();
+      result = execute(bb, insncount);
       W64 delta_insns = seq_total_user_insns_committed - user_insns_at_start;
       insncount -= delta_insns;
       
-      if (trans.bb.synthops) delete[] trans.bb.synthops;
+      bb->free();
       
       if unlikely (config.event_log_enabled) {
         if unlikely (config.flush_event_log_every_cycle) {
@@ -1531,6 +1900,212 @@ struct SequentialCore {
 #endif
 };
 
+#ifdef ENABLE_SEQUENTIAL_JIT
+//
+// Minimal x86-64 instruction encoder for the sequential core JIT.
+// All memory operands use a base register plus a 32-bit displacement.
+//
+enum { HOST_RAX, HOST_RCX, HOST_RDX, HOST_RBX, HOST_RSP, HOST_RBP, HOST_RSI, HOST_RDI,
+       HOST_R8, HOST_R9, HOST_R10, HOST_R11, HOST_R12, HOST_R13, HOST_R14, HOST_R15 };
+
+enum { HOST_CC_Z = 0x4, HOST_CC_NZ = 0x5 };
+
+struct SequentialJitEmitter {
+  byte* p;
+
+  SequentialJitEmitter(byte* p_): p(p_) { }
+
+  void b(byte x) { *p++ = x; }
+  void d(W32 x) { *(W32*)p = x; p += 4; }
+  void q(W64 x) { *(W64*)p = x; p += 8; }
+
+  void rex(bool w, int reg, int base) {
+    byte r = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((base & 8) >> 3);
+    if (r != 0x40) b(r);
+  }
+
+  void mem(int reg, int base, int disp) {
+    b(0x80 | ((reg & 7) << 3) | (base & 7));
+    if ((base & 7) == HOST_RSP) b(0x24);
+    d(disp);
+  }
+
+  void regreg(int reg, int rm) { b(0xc0 | ((reg & 7) << 3) | (rm & 7)); }
+
+  void load64(int reg, int base, int disp) { rex(1, reg, base); b(0x8b); mem(reg, base, disp); }
+  void store64(int base, int disp, int reg) { rex(1, reg, base); b(0x89); mem(reg, base, disp); }
+  void load16zx(int reg, int base, int disp) { rex(0, reg, base); b(0x0f); b(0xb7); mem(reg, base, disp); }
+  void store16(int base, int disp, int reg) { b(0x66); rex(0, reg, base); b(0x89); mem(reg, base, disp); }
+  void store16imm(int base, int disp, W16 imm) { b(0x66); rex(0, 0, base); b(0xc7); mem(0, base, disp); b(lowbits(imm, 8)); b(imm >> 8); }
+  void store32imm(int base, int disp, W32 imm) { rex(0, 0, base); b(0xc7); mem(0, base, disp); d(imm); }
+  void add64imm(int base, int disp, W32 imm) { rex(1, 0, base); b(0x81); mem(0, base, disp); d(imm); }
+  void lea(int reg, int base, int disp) { rex(1, reg, base); b(0x8d); mem(reg, base, disp); }
+
+  void movimm64(int reg, W64 imm) { rex(1, 0, reg); b(0xb8 + (reg & 7)); q(imm); }
+  void movimm32(int reg, W32 imm) { rex(0, 0, reg); b(0xb8 + (reg & 7)); d(imm); }
+  void mov64(int dst, int src) { rex(1, src, dst); b(0x89); regreg(src, dst); }
+  void mov32(int dst, int src) { rex(0, src, dst); b(0x89); regreg(src, dst); }
+  void or64(int dst, int src) { rex(1, src, dst); b(0x09); regreg(src, dst); }
+  void and64imm(int reg, W32 imm) { rex(1, 0, reg); b(0x81); regreg(4, reg); d(imm); }
+  void and32imm(int reg, W32 imm) { rex(0, 0, reg); b(0x81); regreg(4, reg); d(imm); }
+  void test32imm(int reg, W32 imm) { rex(0, 0, reg); b(0xf7); regreg(0, reg); d(imm); }
+  void cmp32imm(int reg, W32 imm) { rex(0, 0, reg); b(0x81); regreg(7, reg); d(imm); }
+
+  void push(int reg) { rex(0, 0, reg); b(0x50 + (reg & 7)); }
+  void pop(int reg) { rex(0, 0, reg); b(0x58 + (reg & 7)); }
+  void call(const void* target) { movimm64(HOST_RAX, (W64)target); b(0xff); regreg(2, HOST_RAX); }
+  void jmp(const byte* target) { b(0xe9); d(target - (p + 4)); }
+  void jcc(int cc, const byte* target) { b(0x0f); b(0x80 | cc); d(target - (p + 4)); }
+
+  // Forward conditional branch, to be resolved with patch():
+  byte* jcc_forward(int cc) { b(0x0f); b(0x80 | cc); d(0); return p - 4; }
+  void patch(byte* rel) { *(W32*)rel = p - (rel + 4); }
+};
+
+//
+// Called from host code for branches, loads and stores: returns -1 to
+// continue, or the index of the uop the interpreter should resume at.
+//
+static int seqjit_execute_uop(SequentialCore* core, BasicBlock* bb, int uopindex) {
+  Waddr mfnlo = bb->rip.mfnlo;
+  Waddr mfnhi = (((lowbits(bb->rip, 12) + (bb->bytes-1)) >> 12) ? (Waddr)bb->rip.mfnhi : mfnlo);
+  bool check_smc = 0;
+
+  if unlikely (!core->execute_fast_uop(*bb, uopindex, mfnlo, mfnhi, check_smc)) return uopindex;
+  return (check_smc) ? (uopindex + 1) : -1;
+}
+
+void SequentialJitCache::flush() {
+  generation++;
+  used = 0;
+  stats.seqjit.flushes++;
+}
+
+//
+// Stack frame of the host code: the 7th argument to uop
+// implementations (rcflags) goes at [rsp], the IssueState
+// at [rsp+16]. Callee-saved rbx, r12 and r13 hold arf,
+// arflags and the core throughout.
+//
+static const int SEQJIT_FRAME_SIZE = 48;
+static const int SEQJIT_STATE = 16;
+static const int SEQJIT_STATE_RDDATA = SEQJIT_STATE + 0;
+static const int SEQJIT_STATE_RDFLAGS = SEQJIT_STATE + 14;
+// An ALU uop that starts and ends an x86 instruction, has two
+// immediates and updates the user flags takes about 210 bytes:
+static const int SEQJIT_MAX_BYTES_PER_UOP = 256;
+
+SequentialJitBlock* SequentialJitCache::compile(SequentialCore& core, BasicBlock& bb) {
+  int maxbytes = sizeof(SequentialJitBlock) + 64 + (bb.count * SEQJIT_MAX_BYTES_PER_UOP);
+
+  if unlikely (!base) base = (byte*)ptl_mm_alloc_private_pages(SEQUENTIAL_JIT_CACHE_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC);
+  if unlikely ((used + maxbytes) > SEQUENTIAL_JIT_CACHE_SIZE) flush();
+
+  SequentialJitBlock* jit = (SequentialJitBlock*)(base + used);
+  byte* start = (byte*)(jit + 1);
+  SequentialJitEmitter as(start);
+
+  int saved_flags_offset = (byte*)&core.jit_saved_flags - (byte*)&core;
+  int bytes_offset = (byte*)&core.bytes_in_current_insn - (byte*)&core;
+
+  // Common exit with the resume uop index in eax:
+  byte* epilogue = as.p;
+  as.b(0x48); as.b(0x83); as.b(0xc4); as.b(SEQJIT_FRAME_SIZE); // add rsp, frame
+  as.pop(HOST_R13);
+  as.pop(HOST_R12);
+  as.pop(HOST_RBX);
+  as.b(0xc3);
+
+  jit->code = (seqjit_func_t)as.p;
+  as.push(HOST_RBX);
+  as.push(HOST_R12);
+  as.push(HOST_R13);
+  as.b(0x48); as.b(0x83); as.b(0xec); as.b(SEQJIT_FRAME_SIZE); // sub rsp, frame
+  as.mov64(HOST_RBX, HOST_RDI);
+  as.mov64(HOST_R12, HOST_RSI);
+  as.mov64(HOST_R13, HOST_RDX);
+
+  int insns = 0;
+  int n = 0;
+
+  for (n = 0; n < bb.count; n++) {
+    const SequentialUop& su = bb.seqops[n];
+    jit->insns_before[n] = insns;
+
+    if unlikely ((su.type == SEQUOP_SLOW) | (su.is_sse & core.ctx.no_sse) | (su.is_x87 & core.ctx.no_x87)) break;
+
+    if (su.som) {
+      as.load64(HOST_RAX, HOST_RBX, REG_flags*8);
+      as.store64(HOST_R13, saved_flags_offset, HOST_RAX);
+      as.store32imm(HOST_R13, bytes_offset, su.bytes);
+    }
+
+    if (su.type == SEQUOP_ALU) {
+      as.load64(HOST_RSI, HOST_RBX, su.ra*8);
+      if (su.rbimm_valid) as.movimm64(HOST_RDX, su.rbimm); else as.load64(HOST_RDX, HOST_RBX, su.rb*8);
+      if (su.rcimm_valid) as.movimm64(HOST_RCX, su.rcimm); else as.load64(HOST_RCX, HOST_RBX, su.rc*8);
+      as.load16zx(HOST_R8, HOST_R12, su.ra*2);
+      as.load16zx(HOST_R9, HOST_R12, su.rb*2);
+      as.load16zx(HOST_RAX, HOST_R12, su.rc*2);
+      as.store64(HOST_RSP, 0, HOST_RAX);
+      as.store16imm(HOST_RSP, SEQJIT_STATE_RDFLAGS, 0);
+      as.lea(HOST_RDI, HOST_RSP, SEQJIT_STATE);
+      as.call((const void*)su.synthop);
+
+      // Exceptions are left to the interpreter:
+      as.load16zx(HOST_RCX, HOST_RSP, SEQJIT_STATE_RDFLAGS);
+      as.test32imm(HOST_RCX, FLAG_INV);
+      byte* ok = as.jcc_forward(HOST_CC_Z);
+      as.movimm32(HOST_RAX, n);
+      as.jmp(epilogue);
+      as.patch(ok);
+
+      if (su.rd != REG_zero) {
+        as.load64(HOST_RAX, HOST_RSP, SEQJIT_STATE_RDDATA);
+        as.store64(HOST_RBX, su.rd*8, HOST_RAX);
+        as.store16(HOST_R12, su.rd*2, HOST_RCX);
+
+        if (su.userflags) {
+          as.load64(HOST_RDX, HOST_RBX, REG_flags*8);
+          as.and64imm(HOST_RDX, ~(W32)su.flagmask);
+          as.mov32(HOST_RSI, HOST_RCX);
+          as.and32imm(HOST_RSI, su.flagmask);
+          as.or64(HOST_RDX, HOST_RSI);
+          as.store64(HOST_RBX, REG_flags*8, HOST_RDX);
+          as.store16(HOST_R12, REG_flags*2, HOST_RDX);
+        }
+      }
+
+      if (su.eom && (su.rd != REG_rip)) as.add64imm(HOST_RBX, REG_rip*8, su.bytes);
+    } else {
+      as.mov64(HOST_RDI, HOST_R13);
+      as.movimm64(HOST_RSI, (W64)&bb);
+      as.movimm32(HOST_RDX, n);
+      as.call((const void*)&seqjit_execute_uop);
+      as.cmp32imm(HOST_RAX, (W32)-1);
+      as.jcc(HOST_CC_NZ, epilogue);
+    }
+
+    insns += su.eom;
+  }
+
+  jit->insns_before[n] = insns;
+  as.movimm32(HOST_RAX, n);
+  as.jmp(epilogue);
+
+  assert((as.p - (byte*)jit) <= maxbytes);
+  used += ceil(as.p - (byte*)jit, 16);
+
+  bb.jitcode = jit;
+  bb.jit_generation = generation;
+
+  stats.seqjit.blocks_compiled++;
+  stats.seqjit.code_bytes += (as.p - start);
+
+  return jit;
+}
+#endif
+
 struct SequentialMachine: public PTLsimMachine {
   SequentialCore* cores[MAX_CONTEXTS];
   bool init_done;
@@ -1620,6 +2195,11 @@ struct SequentialMachine: public PTLsimMachine {
         exiting |= core.execute();
       }
 
+      if unlikely (total_user_insns_committed >= next_checkpoint_at_insns) {
+        foreach (i, contextcount) cores[i]->core_to_external_state(contextof(i));
+        capture_checkpoint();
+      }
+
       exiting |= check_for_async_sim_break();
 
       if unlikely (config.event_log_enabled) {
@@ -1683,6 +2263,37 @@ struct SequentialMachine: public PTLsimMachine {
 
 SequentialMachine seqmodel("seq");
 
+#ifndef PTLSIM_HYPERVISOR
+//
+// Run ctx on its own sequential core until it requests a switch to
+// native mode, or for at most <insnlimit> instructions, without any
+// of the per-run setup of simulate(). The core (and its links between
+// basic blocks) is kept for the next call, so this can run the same
+// code on many inputs in turn. Returns the instructions committed.
+//
+W64 run_sequential(Context& ctx, W64 insnlimit) {
+  static SequentialCore* core = null;
+  if unlikely (!core) core = new SequentialCore(ctx);
+  assert(&core->ctx == &ctx);
+
+  W64 insns_at_start = total_user_insns_committed;
+  W64 saved_stop_at_user_insns = config.stop_at_user_insns;
+  config.stop_at_user_insns = min(saved_stop_at_user_insns, insns_at_start + insnlimit);
+
+  requested_switch_to_native = 0;
+  core->external_to_core_state(ctx);
+
+  for (;;) {
+    if unlikely (core->execute() | requested_switch_to_native) break;
+  }
+
+  core->core_to_external_state(ctx);
+  config.stop_at_user_insns = saved_stop_at_user_insns;
+
+  return total_user_insns_committed - insns_at_start;
+}
+#endif
+
 #ifdef PTLSIM_HYPERVISOR
 int execute_sequential(Context& ctx, CommitRecord* cmtrec, W64 bbcount, W64 insncount) {
   if (config.flush_event_log_every_cycle) {
@@ -62,4 +62,8 @@ int execute_sequential(Context& ctx, CommitRecord* cmtrec = null, W64 bbcount =
 
 extern W64 suppress_total_user_insn_count_updates_in_seqcore;
 
+#ifndef PTLSIM_HYPERVISOR
+W64 run_sequential(Context& ctx, W64 insnlimit = limits<W64>::max);
+#endif
+
 #endif // _SEQCORE_H_
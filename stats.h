@@ -99,6 +99,11 @@ struct PTLsimStats { // rootnode:
         double issues_per_sec;
         double user_commits_per_sec;
       } rate;
+      // Host seconds spent translating basic blocks vs. everything else
+      struct time { // node: summable
+        double decoder;
+        double execution;
+      } time;
     } performance;
   } simulator;
 
@@ -111,6 +116,7 @@ struct PTLsimStats { // rootnode:
       W64 x86_insns;
       W64 uops;
       W64 bytes;
+      W64 vec128_uops;
     } throughput;
 
     W64 x86_decode_type[DECODE_TYPE_COUNT]; // label: decode_type_names
@@ -130,6 +136,14 @@ struct PTLsimStats { // rootnode:
     struct bbcache {
       W64 count;
       W64 inserts;
+      W64 links_followed;
+      // Bytes used by cached blocks, and held by the translation arena
+      W64 bytes;
+      W64 arena_bytes;
+      // Blocks evicted to stay within -bbcache-budget or on low memory,
+      // and evicted blocks that had to be translated again
+      W64 evictions;
+      W64 retranslations;
       W64 invalidates[INVALIDATE_REASON_COUNT]; // label: invalidate_reason_names
     } bbcache;
 
@@ -140,9 +154,28 @@ struct PTLsimStats { // rootnode:
       W64 invalidates[INVALIDATE_REASON_COUNT]; // label: invalidate_reason_names
     } pagecache;
 
+    // Persistent translation cache file
+    struct bbfile {
+      W64 records;
+      W64 hits;
+      W64 appends;
+    } bbfile;
+
     W64 reclaim_rounds;
   } decoder;
 
+  //
+  // Host code for hot basic blocks in the sequential core
+  //
+  struct seqjit {
+    W64 blocks_compiled;
+    W64 code_bytes;
+    W64 flushes;
+    W64 blocks_executed;
+    W64 uops;
+    W64 early_exits;
+  } seqjit;
+
   OutOfOrderCoreStats ooocore;
   DataCacheStats dcache;
 
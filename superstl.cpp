@@ -1359,6 +1359,71 @@ ostream& operator ,(ostream& os, const vec8w& v) {
   return os << v;
 }
 
+const char* host_simd_names[HOST_SIMD_COUNT] = {"sse2", "avx2", "avx512"};
+
+int host_simd_level = HOST_SIMD_SSE2;
+bool host_fast_strings = false;
+
+//
+// Find the widest vector extension both the host CPU and the OS
+// (which must save the wider registers) support.
+//
+int detect_host_simd() {
+  W32 eax, ebx, ecx, edx;
+  cpuid(0, eax, ebx, ecx, edx);
+  if (eax < 7) return HOST_SIMD_SSE2;
+
+  cpuid(1, eax, ebx, ecx, edx);
+  // osxsave and avx:
+  if ((ecx & ((1 << 27) | (1 << 28))) != ((1 << 27) | (1 << 28))) return HOST_SIMD_SSE2;
+
+  W32 xcr0lo, xcr0hi;
+  asm("xgetbv" : "=a" (xcr0lo), "=d" (xcr0hi) : "c" (0));
+
+  asm("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (7), "2" (0));
+
+  // sse and avx state:
+  if ((xcr0lo & 0x06) != 0x06) return HOST_SIMD_SSE2;
+  // avx2:
+  if (!bit(ebx, 5)) return HOST_SIMD_SSE2;
+  // opmask and zmm state, avx512f, avx512bw and avx512vl:
+  if (((xcr0lo & 0xe0) == 0xe0) && bit(ebx, 16) && bit(ebx, 30) && bit(ebx, 31)) return HOST_SIMD_AVX512;
+  return HOST_SIMD_AVX2;
+}
+
+//
+// Enhanced rep movsb and stosb (ERMS): these beat vector loops on
+// blocks of a few KB, like whole pages
+//
+bool detect_host_fast_strings() {
+  W32 eax, ebx, ecx, edx;
+  cpuid(0, eax, ebx, ecx, edx);
+  if (eax < 7) return false;
+  asm("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "0" (7), "2" (0));
+  return bit(ebx, 9);
+}
+
+//
+// Use the widest vectors available, or at most those named
+// (e.g. to compare the variants on the same host)
+//
+bool select_host_simd(const char* name) {
+  int level = detect_host_simd();
+
+  if (name && *name) {
+    int limit = -1;
+    foreach (i, HOST_SIMD_COUNT) {
+      if (strequal(name, host_simd_names[i])) limit = i;
+    }
+    if (limit < 0) return false;
+    level = min(level, limit);
+  }
+
+  host_simd_level = level;
+  host_fast_strings = detect_host_fast_strings();
+  return true;
+}
+
 const byte byte_to_vec16b[256][16] alignto(16) = {
   {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
   {0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01},
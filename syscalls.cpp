@@ -65,6 +65,7 @@ declare_syscall3(__NR_execve, int, sys_execve, const char*, filename, const char
 declare_syscall0(__NR_getpid, pid_t, sys_getpid);
 declare_syscall0(__NR_getppid, pid_t, sys_getppid);
 declare_syscall0(__NR_gettid, pid_t, sys_gettid);
+declare_syscall6(__NR_futex, int, sys_futex, int*, uaddr, int, op, int, val, const struct timespec*, timeout, int*, uaddr2, int, val3);
 declare_syscall1(__NR_uname, int, sys_uname, struct utsname*, buf);
 declare_syscall3(__NR_readlink, int, sys_readlink, const char*, path, char*, buf, size_t, bufsiz);
 
@@ -77,6 +78,7 @@ declare_syscall2(__NR_getrlimit, int, sys_getrlimit, int, resource, struct rlimi
 declare_syscall2(__NR_nanosleep, int, do_nanosleep, const timespec*, req, timespec*, rem);
 
 declare_syscall2(__NR_gettimeofday, int, sys_gettimeofday, struct timeval*, tv, struct timezone*, tz);
+declare_syscall3(__NR_setitimer, int, sys_setitimer, int, which, const struct itimerval*, value, struct itimerval*, ovalue);
 declare_syscall1(__NR_time, time_t, sys_time, time_t*, t);
 
 W64 sys_nanosleep(W64 nsec) {
@@ -36,6 +36,7 @@ extern "C" {
   
   pid_t sys_gettid();
   pid_t sys_getppid();
+  int sys_futex(int* uaddr, int op, int val, const struct timespec* timeout, int* uaddr2, int val3);
   pid_t sys_getpid();
   void sys_exit(int code);
   void* sys_brk(void* newbrk);
@@ -51,6 +52,7 @@ extern "C" {
   int sys_sigaction(int signum, const struct sigaction *act, struct sigaction *oldact);
 
   int sys_gettimeofday(struct timeval* tv, struct timezone* tz);
+  int sys_setitimer(int which, const struct itimerval* value, struct itimerval* ovalue);
   time_t sys_time(time_t* t);
   pid_t sys_wait4(pid_t pid, int *status, int options, struct rusage *rusage);
 
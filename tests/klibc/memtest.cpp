@@ -0,0 +1,240 @@
+//
+// Correctness test and microbenchmarks for the klibc memset, memcpy,
+// memmove and memcmp (klibc-mem.cpp).
+//
+// The Makefile renames them to klibc_memset etc. (tests/klibc/klibc-mem.o),
+// so this program can check them against glibc in each of the ways the
+// simulator can run them: SSE2, AVX2 (where the host has it) and with
+// rep movsb/rep stosb for large blocks (host_fast_strings); without
+// the latter, large blocks use rep movsq/rep stosq where source and
+// destination are aligned alike, and the vector loops otherwise. The cases
+// are every size from 0 to 600 bytes and sizes around 4 KB and up to
+// 8 KB, at all destination alignments within 64 bytes and a set of
+// source alignments, and for memmove overlap in both directions. The
+// 64 bytes on either side of the destination must be left alone.
+//
+// Then prints the ns per call of each mode, of glibc and of what
+// -minline-all-stringops used to compile memcpy, memset and memcmp
+// into (inline rep movsq, rep stosq and repz cmpsb) for a few typical
+// sizes, the best of 5 runs.
+//
+// Usage: memtest [benchmark iterations]
+//
+
+#include <globals.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern "C" {
+  void* klibc_memset(void* s, int c, size_t count);
+  void* klibc_memcpy(void* to, const void* from, size_t n);
+  void* klibc_memmove(void* to, const void* from, size_t n);
+  int klibc_memcmp(const void* a, const void* b, size_t n);
+}
+
+// Normally in superstl.cpp:
+int host_simd_level = HOST_SIMD_SSE2;
+bool host_fast_strings = false;
+byte klibc_byte_to_vec16b[256][16] alignto(16);
+
+//
+// The old inline code, in functions of their own: the call costs a
+// nanosecond or so more than the code did inline.
+//
+#define inline_all_stringops noinline __attribute__((target("inline-all-stringops")))
+
+inline_all_stringops static void* inline_memcpy(void* to, const void* from, size_t n) { return memcpy(to, from, n); }
+inline_all_stringops static void* inline_memset(void* s, int c, size_t n) { return memset(s, c, n); }
+inline_all_stringops static int inline_memcmp(const void* a, const void* b, size_t n) { return memcmp(a, b, n); }
+
+enum { MODE_SSE2, MODE_AVX2, MODE_REP_STRINGS, MODE_COUNT };
+static const char* modenames[MODE_COUNT] = {"sse2", "avx2", "rep"};
+
+static bool select_mode(int mode) {
+  if ((mode == MODE_AVX2) && !__builtin_cpu_supports("avx2")) return false;
+  host_simd_level = (mode == MODE_AVX2) ? HOST_SIMD_AVX2 : HOST_SIMD_SSE2;
+  // rep movsb and rep stosb are correct on every host, fast or not:
+  host_fast_strings = (mode == MODE_REP_STRINGS);
+  return true;
+}
+
+static const int GUARD = 64;
+static const int MAXSIZE = 8192;
+static const int BUFSIZE = 2*MAXSIZE + 4096;
+
+static byte src[BUFSIZE] alignto(4096);
+static byte dst[BUFSIZE] alignto(4096);
+static byte ref[BUFSIZE] alignto(4096);
+
+static W64 lcg = 1;
+
+static inline byte next_byte() {
+  lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+  return lcg >> 56;
+}
+
+static void fill_random(byte* p, size_t n) {
+  foreach (i, n) p[i] = next_byte();
+}
+
+static int failures = 0;
+
+static void fail(const char* func, int mode, size_t n, int dalign, int salign) {
+  if (failures < 10) printf("  %s (%s): size %zu, dst +%d, src +%d: wrong result\n", func, modenames[mode], n, dalign, salign);
+  failures++;
+}
+
+static const int salignments[] = {0, 1, 7, 8, 15, 16, 31, 33};
+
+static void test_sizes(int mode, size_t n, W64& cases) {
+  if (n > MAXSIZE) return;
+
+  foreach (dalign, 64) {
+    byte* d = dst + GUARD + dalign;
+    byte* r = ref + GUARD + dalign;
+    size_t window = n + 2*GUARD;
+
+    // memset
+    fill_random(dst, window + 64);
+    memcpy(ref, dst, window + 64);
+    byte c = next_byte();
+    klibc_memset(d, c, n);
+    memset(r, c, n);
+    if (memcmp(dst, ref, window + 64)) fail("memset", mode, n, dalign, 0);
+    cases++;
+
+    foreach (i, lengthof(salignments)) {
+      int salign = salignments[i];
+      const byte* s = src + GUARD + salign;
+
+      // memcpy
+      fill_random(dst, window + 64);
+      memcpy(ref, dst, window + 64);
+      klibc_memcpy(d, s, n);
+      memcpy(r, s, n);
+      if (memcmp(dst, ref, window + 64)) fail("memcpy", mode, n, dalign, salign);
+
+      // memcmp: equal, then one byte differs in either direction
+      memcpy(d, s, n);
+      if (klibc_memcmp(d, s, n) != 0) fail("memcmp", mode, n, dalign, salign);
+      if (n) {
+        size_t k = (n > 1) ? (lcg % n) : 0;
+        d[k] = s[k] + 1;
+        if ((klibc_memcmp(d, s, n) > 0) != (memcmp(d, s, n) > 0) || !klibc_memcmp(d, s, n)) fail("memcmp", mode, n, dalign, salign);
+        d[k] = s[k] - 1;
+        if ((klibc_memcmp(d, s, n) < 0) != (memcmp(d, s, n) < 0) || !klibc_memcmp(d, s, n)) fail("memcmp", mode, n, dalign, salign);
+      }
+      cases += 4;
+    }
+
+    // memmove within one buffer, with the source before and after the destination
+    static const int deltas[] = {1, 7, 16, 17, 31, 64, 65, 127, 0x3fffffff};
+    foreach (i, lengthof(deltas)) {
+      foreach (dir, 2) {
+        int delta = (deltas[i] == 0x3fffffff) ? (int)(n / 2) + 1 : deltas[i];
+        byte* md = dst + GUARD + dalign + (dir ? 0 : delta);
+        byte* ms = dst + GUARD + dalign + (dir ? delta : 0);
+        size_t span = n + delta + 2*GUARD + 64;
+        fill_random(dst, span);
+        memcpy(ref, dst, span);
+        klibc_memmove(md, ms, n);
+        memmove(ref + (md - dst), ref + (ms - dst), n);
+        if (memcmp(dst, ref, span)) fail("memmove", mode, n, dalign + (dir ? 0 : delta), dalign + (dir ? delta : 0));
+        cases++;
+      }
+    }
+  }
+}
+
+static double nanoseconds() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Each call uses a different page and offset, like the simulator does
+#define BENCH(expr) ({ \
+  double best = 1e30; \
+  foreach (run, 5) { \
+    double t0 = nanoseconds(); \
+    foreach (i, iterations) { \
+      byte* d = dst + (i & 1) * 4096 + (i & 3) * 8 * (n < 4096); (void)d; \
+      byte* s = src + (i & 1) * 4096 + (i & 5); (void)s; \
+      expr; \
+    } \
+    best = min(best, (nanoseconds() - t0) / iterations); \
+  } \
+  best; })
+
+volatile int sink;
+
+struct BenchCase { const char* func; size_t n; };
+
+static void benchmark(int iterations) {
+  static const BenchCase cases[] = {
+    {"memcpy", 13}, {"memcpy", 100}, {"memcpy", 1000}, {"memcpy", 4096},
+    {"memset", 37}, {"memset", 4096}, {"memmove", 1000}, {"memcmp", 4096},
+  };
+
+  printf("\n%-8s %6s", "func", "bytes");
+  foreach (mode, MODE_COUNT) printf(" %8s", modenames[mode]);
+  printf(" %8s %8s\n", "inline", "glibc");
+
+  enum { INLINE = MODE_COUNT, GLIBC };
+
+  foreach (j, lengthof(cases)) {
+    const char* func = cases[j].func;
+    size_t n = cases[j].n;
+    printf("%-8s %6zu", func, n);
+
+    foreach (mode, GLIBC + 1) {
+      if ((mode < MODE_COUNT) && !select_mode(mode)) { printf(" %8s", "-"); continue; }
+      double ns;
+      if (!strcmp(func, "memcpy")) {
+        ns = (mode == GLIBC) ? BENCH(memcpy(d, s, n)) : (mode == INLINE) ? BENCH(inline_memcpy(d, s, n)) : BENCH(klibc_memcpy(d, s, n));
+      } else if (!strcmp(func, "memset")) {
+        ns = (mode == GLIBC) ? BENCH(memset(d, 0, n)) : (mode == INLINE) ? BENCH(inline_memset(d, 0, n)) : BENCH(klibc_memset(d, 0, n));
+      } else if (!strcmp(func, "memmove")) {
+        // -minline-all-stringops never inlined memmove
+        if (mode == INLINE) { printf(" %8s", "-"); continue; }
+        ns = (mode == GLIBC) ? BENCH(memmove(d + 8, d, n)) : BENCH(klibc_memmove(d + 8, d, n));
+      } else {
+        memcpy(dst, src, 3*4096);
+        ns = (mode == GLIBC) ? BENCH(sink = memcmp(dst + (i & 1) * 4096, src + (i & 1) * 4096, n)) :
+          (mode == INLINE) ? BENCH(sink = inline_memcmp(dst + (i & 1) * 4096, src + (i & 1) * 4096, n)) :
+          BENCH(sink = klibc_memcmp(dst + (i & 1) * 4096, src + (i & 1) * 4096, n));
+      }
+      printf(" %8.1f", ns);
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char** argv) {
+  int iterations = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+  foreach (i, 256) foreach (j, 16) klibc_byte_to_vec16b[i][j] = i;
+  fill_random(src, BUFSIZE);
+
+  static const size_t large[] = {1000, 1023, 2047, 2048, 2049, 3000, 4095, 4096, 4097, 4111, 4160, 6000, 8191, 8192};
+
+  printf("%-6s %10s %10s\n", "mode", "cases", "failures");
+  foreach (mode, MODE_COUNT) {
+    if (!select_mode(mode)) {
+      printf("%-6s %10s %10s\n", modenames[mode], "-", "-");
+      continue;
+    }
+    W64 cases = 0;
+    int before = failures;
+    for (size_t n = 0; n <= 600; n++) test_sizes(mode, n, cases);
+    foreach (i, lengthof(large)) test_sizes(mode, large[i], cases);
+    printf("%-6s %10llu %10d\n", modenames[mode], (unsigned long long)cases, failures - before);
+  }
+
+  benchmark(iterations);
+
+  if (failures) printf("\nFAILED: %d wrong results\n", failures);
+  return (failures != 0);
+}
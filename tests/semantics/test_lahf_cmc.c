@@ -0,0 +1,65 @@
+/**
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Tests LAHF, which always sets bit 1 of %ah, and CMC, which
+ * complements the carry flag.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* %ah = SF:ZF:0:AF:0:PF:1:CF after "cmp b, a", without AF */
+uint64_t lahf_after_cmp(uint64_t a, uint64_t b) {
+	uint64_t out;
+	asm (
+		"cmp %2, %1 \n\t"
+		"mov $0, %%eax \n\t"
+		"lahf"
+		:"=&a"(out)
+		:"r"(a), "r"(b)
+		:"cc");
+	return (out >> 8) & 0xc7;
+}
+
+/* CF after the given instructions */
+#define CF_AFTER(name, insns) \
+int name() { \
+	uint8_t out; \
+	asm ( \
+		insns \
+		"setc %0" \
+		:"=r"(out) \
+		: \
+		:"cc"); \
+	return out; \
+}
+
+CF_AFTER(clc_cmc, "clc \n\t cmc \n\t")
+CF_AFTER(stc_cmc, "stc \n\t cmc \n\t")
+CF_AFTER(clc_cmc_cmc, "clc \n\t cmc \n\t cmc \n\t")
+
+int main() {
+	int errors = 0;
+	uint64_t r;
+	int c;
+
+	r = lahf_after_cmp(1, 1); printf("LAHF (1 cmp 1): %lx\n", r); errors += (r != 0x46);
+	r = lahf_after_cmp(1, 2); printf("LAHF (1 cmp 2): %lx\n", r); errors += (r != 0x87);
+	r = lahf_after_cmp(3, 1); printf("LAHF (3 cmp 1): %lx\n", r); errors += (r != 0x02);
+	c = clc_cmc(); printf("CLC; CMC: %i\n", c); errors += (c != 1);
+	c = stc_cmc(); printf("STC; CMC: %i\n", c); errors += (c != 0);
+	c = clc_cmc_cmc(); printf("CLC; CMC; CMC: %i\n", c); errors += (c != 0);
+	return (errors != 0);
+}
@@ -0,0 +1,50 @@
+/**
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Tests 16-bit POP, which must only replace the low word of the
+ * destination register, and 64-bit POP for comparison.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+uint64_t pop16(uint64_t in, uint16_t value) {
+	uint64_t out;
+	asm (
+		"pushw %w2 \n\t"
+		"popw %w0"
+		:"=r"(out)
+		:"0"(in), "r"(value));
+	return out;
+}
+uint64_t pop64(uint64_t in, uint64_t value) {
+	uint64_t out;
+	asm (
+		"push %2 \n\t"
+		"pop %0"
+		:"=r"(out)
+		:"0"(in), "r"(value));
+	return out;
+}
+
+int main() {
+	uint64_t data = 0xDEADBEEFFEEDBACC;
+	int errors = 0;
+	uint64_t r;
+
+	r = pop16(data, 0x1234);             printf("POP16: %lx -> %lx\n", data, r); errors += (r != 0xDEADBEEFFEED1234);
+	r = pop64(data, 0x0123456789ABCDEF); printf("POP64: %lx -> %lx\n", data, r); errors += (r != 0x0123456789ABCDEF);
+	return (errors != 0);
+}
@@ -0,0 +1,60 @@
+/**
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Tests the flags left by variable rotates and shifts: rotates only
+ * change CF and OF, and a count that masks to zero (32 for 32-bit,
+ * 64 for 64-bit operands) leaves all flags alone.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* Flags (CF, PF, ZF, SF, OF) after setting them with "cmp b, a", then running op */
+#define FLAGS_AFTER(name, insn, reg) \
+uint64_t name(uint64_t a, uint64_t b, uint64_t value, uint8_t count) { \
+	uint64_t out; \
+	asm ( \
+		"cmp %3, %2 \n\t" \
+		insn " %%cl, %" reg "1 \n\t" \
+		"pushf \n\t" \
+		"pop %0" \
+		:"=&r"(out), "+r"(value) \
+		:"r"(a), "r"(b), "c"(count) \
+		:"cc"); \
+	return out & 0x8c5; \
+}
+
+FLAGS_AFTER(rol32, "roll", "k")
+FLAGS_AFTER(ror64, "rorq", "q")
+FLAGS_AFTER(rcl32, "rcll", "k")
+FLAGS_AFTER(shl32, "shll", "k")
+FLAGS_AFTER(shr64, "shrq", "q")
+
+int main() {
+	int errors = 0;
+	uint64_t r;
+
+	/* cmp 1, 1: ZF and PF set; a 1-bit rotate of 1 must keep them */
+	r = rol32(1, 1, 1, 1);  printf("ROL32 by 1:  %lx\n", r);  errors += (r != 0x044);
+	r = ror64(1, 1, 2, 1);  printf("ROR64 by 1:  %lx\n", r);  errors += (r != 0x044);
+	r = rcl32(1, 1, 1, 1);  printf("RCL32 by 1:  %lx\n", r);  errors += (r != 0x044);
+	/* cmp 1, 2: CF, SF and PF set; counts that mask to zero keep everything */
+	r = rol32(1, 2, 5, 32); printf("ROL32 by 32: %lx\n", r);  errors += (r != 0x085);
+	r = shl32(1, 2, 5, 32); printf("SHL32 by 32: %lx\n", r);  errors += (r != 0x085);
+	r = shr64(1, 2, 5, 64); printf("SHR64 by 64: %lx\n", r);  errors += (r != 0x085);
+	/* A real shift does set SF, ZF and PF: 1 << 31 */
+	r = shl32(1, 1, 1, 31); printf("SHL32 by 31: %lx\n", r);  errors += ((r & 0xc4) != 0x084);
+	return (errors != 0);
+}
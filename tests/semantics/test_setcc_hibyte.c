@@ -0,0 +1,62 @@
+/**
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * Tests SETcc into the high byte registers %ah, %bh, %ch and %dh,
+ * which must only replace bits 8-15 of the register.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define SETCC_HIBYTE(name, reg, constraint) \
+uint64_t name(uint64_t in) { \
+	uint64_t out; \
+	asm ( \
+		"cmp %%rax, %%rax \n\t" \
+		"sete %%" reg \
+		:"=" constraint(out) \
+		:"0"(in) \
+		:"cc"); \
+	return out; \
+}
+
+SETCC_HIBYTE(sete_ah, "ah", "a")
+SETCC_HIBYTE(sete_bh, "bh", "b")
+SETCC_HIBYTE(sete_ch, "ch", "c")
+SETCC_HIBYTE(sete_dh, "dh", "d")
+
+uint64_t setne_ah(uint64_t in) {
+	uint64_t out;
+	asm (
+		"cmp %%rax, %%rax \n\t"
+		"setne %%ah"
+		:"=a"(out)
+		:"0"(in)
+		:"cc");
+	return out;
+}
+
+int main() {
+	uint64_t data = 0xDEADBEEFFEEDBACC;
+	int errors = 0;
+	uint64_t r;
+
+	r = sete_ah(data);  printf(" SETE %%ah: %lx -> %lx\n", data, r); errors += (r != 0xDEADBEEFFEED01CC);
+	r = sete_bh(data);  printf(" SETE %%bh: %lx -> %lx\n", data, r); errors += (r != 0xDEADBEEFFEED01CC);
+	r = sete_ch(data);  printf(" SETE %%ch: %lx -> %lx\n", data, r); errors += (r != 0xDEADBEEFFEED01CC);
+	r = sete_dh(data);  printf(" SETE %%dh: %lx -> %lx\n", data, r); errors += (r != 0xDEADBEEFFEED01CC);
+	r = setne_ah(data); printf("SETNE %%ah: %lx -> %lx\n", data, r); errors += (r != 0xDEADBEEFFEED00CC);
+	return (errors != 0);
+}
@@ -0,0 +1,177 @@
+//
+// Correctness test and microbenchmark for the associative tag searches
+// in logic.h, with each vector extension the host has (host_simd_level):
+// SSE2, AVX2 and AVX-512.
+//
+// The searches are those of the out-of-order core:
+// - issue queue broadcast: one tag against the 16-bit tags of the 4
+//   operands of 16 entries (FullyAssociativeTags16bit)
+// - the same with 8-bit tags and 32 entries (FullyAssociativeTags8bit)
+// - 32-entry TLB lookup with 40-bit tags (FullyAssociativeTagsNbitOneHot)
+// For random tags, half of them present, each variant must return what
+// a scalar search of the same tags returns. Then prints the ns per
+// search of each variant.
+//
+// Linked against the simulator's own klibc and superstl objects, like
+// tests/threads/stress.
+//
+// Usage: tagsearch [iterations]
+//
+
+#include <globals.h>
+#include <superstl.h>
+#include <logic.h>
+#include <mm.h>
+
+// Normally in raspsim.cpp and ptlsim.cpp:
+ostream logfile;
+bool inside_ptlsim = 1;
+
+extern "C" void assert_fail(const char *__assertion, const char *__file, unsigned int __line, const char *__function) {
+  cerr << "Assert ", __assertion, " failed in ", __file, ":", __line, " (", __function, ")", endl, flush;
+  sys_exit(1);
+  abort();
+}
+
+W64 get_core_freq_hz() { return 1000000000ULL; }
+
+static const int OPERANDS = 4;
+static const int QUERIES = 4096;
+
+typedef FullyAssociativeTags16bit<16, 16> OperandTags16;
+typedef FullyAssociativeTags8bit<32, 32> OperandTags8;
+typedef FullyAssociativeTagsNbitOneHot<32, 40> TLBTags;
+
+static OperandTags16 tags16[OPERANDS];
+static OperandTags8 tags8[OPERANDS];
+static TLBTags tlb;
+
+static W16 queries16[QUERIES];
+static byte queries8[QUERIES];
+static W64 queriestlb[QUERIES];
+
+static W64 seed = 0x12345;
+
+static inline W64 xorshift() {
+  seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+  return seed;
+}
+
+static void fill() {
+  foreach (j, OPERANDS) {
+    foreach (i, 16) tags16[j].insertslot(i, xorshift() % 0x8000);
+    foreach (i, 32) tags8[j].insertslot(i, xorshift() % 0x80);
+  }
+
+  // TLB tags are unique:
+  foreach (i, 32) tlb.update(i, (xorshift() & 0x7fffffff00ULL) | i);
+
+  foreach (q, QUERIES) {
+    bool hit = (xorshift() & 1);
+    queries16[q] = (hit) ? tags16[q % OPERANDS][xorshift() % 16] : (xorshift() % 0x10000);
+    queries8[q] = (hit) ? tags8[q % OPERANDS][xorshift() % 32] : (xorshift() % 0x100);
+    queriestlb[q] = (hit) ? tlb.tagsmirror[xorshift() % 32] : (xorshift() & bitmask(40));
+  }
+}
+
+static int check(int level) {
+  int errors = 0;
+
+  foreach (q, QUERIES) {
+    foreach (j, OPERANDS) {
+      W64 expected = 0;
+      foreach (i, 16) if (tags16[j][i] == queries16[q]) expected |= (1ULL << i);
+      if (tags16[j].match(queries16[q]).integer() != expected) errors++;
+
+      expected = 0;
+      foreach (i, 32) if (tags8[j][i] == queries8[q]) expected |= (1ULL << i);
+      if (tags8[j].match(queries8[q]).integer() != expected) errors++;
+    }
+
+    int expected = -1;
+    foreach (i, 32) if (tlb.tagsmirror[i] == queriestlb[q]) expected = i;
+    if (tlb.match(queriestlb[q]) != expected) errors++;
+  }
+
+  if (errors) cerr << "  ", host_simd_names[level], ": ", errors, " wrong results", endl;
+  return errors;
+}
+
+static W64 sink;
+
+static double nanoseconds() {
+  timeval tv;
+  sys_gettimeofday(&tv, null);
+  return (tv.tv_sec * 1e9) + (tv.tv_usec * 1e3);
+}
+
+enum { KERNEL_BROADCAST16, KERNEL_BROADCAST8, KERNEL_TLB, KERNEL_COUNT };
+static const char* kernelnames[KERNEL_COUNT] = {"broadcast 4 x 16 16-bit tags", "broadcast 4 x 32 8-bit tags", "TLB 32 x 40-bit tags"};
+
+static double benchmark(int kernel, int iterations) {
+  W64 sum = 0;
+  double t0 = nanoseconds();
+
+  for (int n = 0; n < iterations; n += QUERIES) {
+    switch (kernel) {
+    case KERNEL_BROADCAST16:
+      foreach (q, QUERIES) {
+        OperandTags16::vec_t target = OperandTags16::prep(queries16[q]);
+        foreach (j, OPERANDS) sum += tags16[j].match(target).integer();
+      }
+      break;
+    case KERNEL_BROADCAST8:
+      foreach (q, QUERIES) {
+        OperandTags8::vec_t target = OperandTags8::prep(queries8[q]);
+        foreach (j, OPERANDS) sum += tags8[j].match(target).integer();
+      }
+      break;
+    case KERNEL_TLB:
+      foreach (q, QUERIES) sum += tlb.match(queriestlb[q]);
+      break;
+    }
+  }
+
+  sink += sum;
+  return (nanoseconds() - t0) / (ceil(iterations, QUERIES));
+}
+
+int main(int argc, char** argv) {
+  ptl_mm_init();
+  ptl_mm_set_logging(null, 0, false);
+  call_global_constuctors();
+
+  int iterations = (argc > 1) ? strtol(argv[1], null, 10) : 4000000;
+  int maxlevel = detect_host_simd();
+  int errors = 0;
+
+  fill();
+
+  double ns[KERNEL_COUNT][HOST_SIMD_COUNT];
+
+  for (int level = 0; level <= maxlevel; level++) {
+    host_simd_level = level;
+    errors += check(level);
+    foreach (k, KERNEL_COUNT) ns[k][level] = benchmark(k, iterations);
+  }
+
+  cout << "tagsearch: ", QUERIES, " queries with ", host_simd_names[0];
+  for (int level = 1; level <= maxlevel; level++) cout << ", ", host_simd_names[level];
+  cout << ": ", (errors ? "FAILED" : "ok"), endl, endl;
+
+  cout << "  ", padstring("ns per search", -30);
+  foreach (level, HOST_SIMD_COUNT) cout << " ", padstring(host_simd_names[level], 8);
+  cout << endl;
+
+  foreach (k, KERNEL_COUNT) {
+    cout << "  ", padstring(kernelnames[k], -30);
+    foreach (level, HOST_SIMD_COUNT) {
+      if (level <= maxlevel) cout << " ", floatstring(ns[k][level], 8, 1); else cout << " ", padstring("-", 8);
+    }
+    cout << endl;
+  }
+  cout << flush;
+
+  sys_exit(errors != 0);
+  return 0;
+}
@@ -0,0 +1,206 @@
+//
+// Stress test for the klibc threads, Mutex, ConditionVariable,
+// Barrier and thread local storage, and for the per-thread caches
+// of the ptl_mm allocator (mm.cpp).
+//
+// Linked against the simulator's own klibc, mm and syscalls objects
+// (not glibc), with the few symbols raspsim.cpp and ptlsim.cpp would
+// otherwise provide defined below.
+//
+// 8 threads do random malloc/free of 1 to 4096 bytes and check the
+// contents of every block before freeing it, count under a Mutex and
+// meet at a Barrier between rounds. Then a ConditionVariable broadcast
+// wakes 4 waiters, TLS destructors must have run once per thread, 300
+// create/join cycles must reuse the stack slots, and ptl_mm_validate()
+// checks the heap. Finally prints the ns per malloc+free pair with and
+// without threads.
+//
+// Usage: stress [iterations per thread]
+//
+
+#include <globals.h>
+#include <superstl.h>
+#include <mm.h>
+
+// Normally in raspsim.cpp and ptlsim.cpp:
+ostream logfile;
+bool inside_ptlsim = 1;
+
+extern "C" void assert_fail(const char *__assertion, const char *__file, unsigned int __line, const char *__function) {
+  cerr << "Assert ", __assertion, " failed in ", __file, ":", __line, " (", __function, ")", endl, flush;
+  sys_exit(1);
+  abort();
+}
+
+W64 get_core_freq_hz() { return 1000000000ULL; }
+
+static const int THREADS = 8;
+static const int ROUNDS = 4;
+static const int LIVE = 256;
+
+static Mutex lock;
+static ConditionVariable ready_changed;
+static Barrier barrier;
+static W64 counter = 0;
+static int ready = 0;
+static int barrier_leaders = 0;
+static int key;
+static int destroyed = 0;
+
+static void count_destructor(void* value) { xadd(destroyed, 1); }
+
+static inline W64 xorshift(W64& s) {
+  s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+  return s;
+}
+
+struct StressArgs {
+  int id;
+  int iterations;
+  W64 seed;
+  int errors;
+};
+
+static void* stress(void* p) {
+  StressArgs& a = *(StressArgs*)p;
+  byte* live[LIVE];
+  int size[LIVE];
+
+  ptl_thread_set(key, (void*)(Waddr)(a.id + 1));
+  foreach (i, LIVE) live[i] = null;
+
+  foreach (round, ROUNDS) {
+    if (barrier.wait()) xadd(barrier_leaders, 1);
+
+    foreach (it, a.iterations / ROUNDS) {
+      int k = xorshift(a.seed) % LIVE;
+      byte fill = k + a.id;
+      if (live[k]) {
+        foreach (j, size[k]) {
+          if (live[k][j] != fill) { a.errors++; break; }
+        }
+        if (ptl_mm_getsize(live[k]) < (size_t)size[k]) a.errors++;
+        free(live[k]);
+        live[k] = null;
+      } else {
+        // Mostly slab sized objects, with an occasional larger one:
+        size[k] = 1 + (xorshift(a.seed) % ((it & 15) ? 512 : 4096));
+        live[k] = (byte*)malloc(size[k]);
+        memset(live[k], fill, size[k]);
+      }
+
+      if ((it & 1023) == 0) {
+        lock.acquire();
+        counter++;
+        lock.release();
+      }
+    }
+  }
+
+  foreach (i, LIVE) if (live[i]) free(live[i]);
+  if (ptl_thread_get(key) != (void*)(Waddr)(a.id + 1)) a.errors++;
+  return (void*)(Waddr)a.errors;
+}
+
+static void* wait_until_ready(void* p) {
+  lock.acquire();
+  while (!ready) ready_changed.wait(lock);
+  counter += 1000;
+  lock.release();
+  return null;
+}
+
+static int check(bool ok, const char* what) {
+  if (!ok) cerr << "  ", what, ": wrong", endl;
+  return (ok) ? 0 : 1;
+}
+
+static void* alloc_free_loop(void* p) {
+  int iterations = *(int*)p;
+  void* v[64];
+  for (int i = 0; i < iterations; i += 64) {
+    foreach (j, 64) v[j] = malloc(16 + (j & 7) * 16);
+    foreach (j, 64) free(v[j]);
+  }
+  return null;
+}
+
+static void benchmark(const char* label, int threads, int iterations) {
+  timeval tv0, tv1;
+  sys_gettimeofday(&tv0, null);
+
+  if (!threads) {
+    alloc_free_loop(&iterations);
+  } else {
+    PTLThread* t[THREADS];
+    foreach (i, threads) t[i] = ptl_thread_create(alloc_free_loop, &iterations);
+    foreach (i, threads) ptl_thread_join(t[i]);
+  }
+
+  sys_gettimeofday(&tv1, null);
+  double ns = ((tv1.tv_sec - tv0.tv_sec) * 1e9 + (tv1.tv_usec - tv0.tv_usec) * 1e3) / ((double)iterations * max(threads, 1));
+  cout << "  ", padstring(label, -36), " ", intstring(max(threads, 1), 2), " threads: ", floatstring(ns, 6, 1), " ns per malloc+free", endl;
+}
+
+int main(int argc, char** argv) {
+  ptl_mm_init();
+  ptl_mm_set_logging(null, 0, false);
+  call_global_constuctors();
+
+  int iterations = (argc > 1) ? strtol(argv[1], null, 10) : 400000;
+  int errors = 0;
+
+  // Before any thread exists, malloc and free take no locks:
+  benchmark("single threaded (no locks)", 0, 4000000);
+
+  key = ptl_thread_key_create(count_destructor);
+  barrier.reset(THREADS);
+
+  StressArgs args[THREADS];
+  PTLThread* t[THREADS];
+  foreach (i, THREADS) {
+    args[i].id = i;
+    args[i].iterations = iterations;
+    args[i].seed = 0x12345 + i * 7919;
+    args[i].errors = 0;
+    t[i] = ptl_thread_create(stress, &args[i]);
+    errors += check(t[i], "ptl_thread_create");
+  }
+
+  foreach (i, THREADS) {
+    if (t[i]) errors += check(!ptl_thread_join(t[i]), "malloc/free contents");
+  }
+
+  W64 expected = THREADS * ROUNDS * ceil(iterations / ROUNDS, 1024) / 1024;
+  errors += check(counter == expected, "Mutex protected counter");
+  errors += check(barrier_leaders == ROUNDS, "Barrier rounds");
+  errors += check(destroyed == THREADS, "TLS destructor calls");
+
+  counter = 0;
+  foreach (i, 4) t[i] = ptl_thread_create(wait_until_ready, null);
+  lock.acquire();
+  ready = 1;
+  ready_changed.broadcast();
+  lock.release();
+  foreach (i, 4) ptl_thread_join(t[i]);
+  errors += check(counter == 4000, "ConditionVariable broadcast");
+
+  // Many more threads than PTL_THREAD_MAX, one at a time:
+  foreach (i, 300) {
+    PTLThread* thread = ptl_thread_create(wait_until_ready, null);
+    errors += check(thread, "thread stack slot reuse");
+    if (!thread) break;
+    ptl_thread_join(thread);
+  }
+
+  ptl_mm_validate();
+
+  cout << "threads: ", THREADS, " x ", iterations, " random malloc/free, ", (errors ? "FAILED" : "ok"), endl;
+
+  foreach (n, 3) benchmark("per-thread caches", 1 << n, 4000000);
+  benchmark("main thread, after threads", 0, 4000000);
+  cout << flush;
+
+  sys_exit(errors != 0);
+  return 0;
+}
@@ -0,0 +1,206 @@
+//
+// Host x87 vs soft math:: for the transcendental x87 assists
+// (fsin, fcos and fptan/fsincos in decode-x87.cpp).
+//
+// Differential test: runs the host instruction in extended precision
+// and keeps its result only where it must round to the same double
+// as the correctly rounded soft function: no range reduction needed
+// (|x| <= pi/4), a normal double result, and the low 11 bits of the
+// 64-bit significand more than 8 ulps away from the halfway point
+// between two doubles. Every kept result must be bit-identical to
+// math::; the test fails otherwise.
+//
+// f2xm1 (math::f2xm1) does use the host, but only when the guest's
+// control word asks for round to nearest with double or extended
+// precision. With the host control word left at something else, as
+// a guest fldcw leaves it, math::f2xm1 is run under each of several
+// guest control words: where it takes the host path its result must
+// be that of f2xm1 under the guest's precision and round to nearest,
+// anywhere else that of the soft exp2(x) - 1, and the host control
+// word must be unchanged afterwards.
+//
+// Benchmark: ns per call of the host instruction and of math::.
+//
+// This is the fast path considered for those assists and the reason
+// it is not used: it is correct where it applies, but slower than the
+// soft code it would replace (see the note in decode-x87.cpp).
+//
+// Usage: hostmath [iterations per input range]
+//
+
+#include <globals.h>
+#include <mathlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum { OP_SIN, OP_COS, OP_TAN, OP_COUNT };
+static const char* opnames[OP_COUNT] = {"fsin", "fcos", "fptan"};
+
+static inline long double host_op(int op, double x) {
+  long double r;
+  switch (op) {
+  case OP_SIN: asm("fsin" : "=t" (r) : "0" ((long double)x)); break;
+  case OP_COS: asm("fcos" : "=t" (r) : "0" ((long double)x)); break;
+  default: asm("fptan; fstp %%st(0)" : "=t" (r) : "0" ((long double)x)); break;
+  }
+  return r;
+}
+
+static inline double soft_op(int op, double x) {
+  switch (op) {
+  case OP_SIN: return math::sin(x);
+  case OP_COS: return math::cos(x);
+  default: return math::tan(x);
+  }
+}
+
+//
+// Round the host result to double if that is safe, as described above
+//
+static bool host_fast_path(int op, double x, double& result) {
+  if (!(math::fabs(x) <= 0.78539816339744828)) return false;
+
+  long double r = host_op(op, x);
+  union { long double ld; struct { W64 mantissa; W16 signexp; } f; } u;
+  u.ld = r;
+  int exponent = (u.f.signexp & 0x7fff) - 16383;
+  if ((exponent < -1022) | (exponent > 1023)) return false;
+
+  int low = u.f.mantissa & 0x7ff;
+  if (abs(low - 0x400) <= 8) return false;
+
+  result = (double)r;
+  return true;
+}
+
+static W64 lcg = 1;
+
+static inline double next_input(double range) {
+  lcg = lcg * 6364136223846793005ULL + 1442695040888963407ULL;
+  // Uniform in [-range, range)
+  return ((double)(W64s)lcg / 9223372036854775808.0) * range;
+}
+
+static inline W16 cpu_fpcw() {
+  W16 fpcw;
+  asm volatile("fstcw %0" : "=m" (fpcw));
+  return fpcw;
+}
+
+static inline double host_f2xm1(double x, W16 fpcw) {
+  W16 oldfpcw = cpu_fpcw();
+  double r;
+  asm volatile("fldcw %[fpcw]; fldl %[x]; f2xm1; fstpl %[r]" : [r] "=m" (r) : [x] "m" (x), [fpcw] "m" (fpcw));
+  asm volatile("fldcw %0" : : "m" (oldfpcw));
+  return r;
+}
+
+static int test_f2xm1(int iterations) {
+  // Round to nearest with extended, double and single precision, then
+  // extended precision with round down, up and toward zero:
+  static const W16 fpcws[] = {0x037f, 0x027f, 0x007f, 0x077f, 0x0b7f, 0x0f7f};
+  static const bool hostpath[] = {1, 1, 0, 0, 0, 0};
+  static const double ranges[] = {1.0, 1e-3, 1e-150};
+  // Single precision, round toward zero:
+  W16 ambient = 0x0c7f;
+  int failures = 0;
+
+  printf("\n%-6s %8s %8s %6s %10s %10s\n", "insn", "fpcw", "range", "path", "mismatch", "host diff");
+  foreach (k, lengthof(fpcws)) {
+    W16 fpcw = fpcws[k];
+    bool onhost = math::f2xm1_on_host(fpcw);
+    if (onhost != hostpath[k]) {
+      printf("  f2xm1 with fpcw %04x: takes the %s path\n", fpcw, (onhost) ? "host" : "soft");
+      failures++;
+    }
+    foreach (i, lengthof(ranges)) {
+      W64 mismatches = 0, hostdiff = 0;
+      lcg = 1;
+      asm volatile("fldcw %0" : : "m" (ambient));
+      foreach (j, iterations) {
+        double x = next_input(ranges[i]);
+        double r = math::f2xm1(x, fpcw);
+        double expected = (onhost) ? host_f2xm1(x, (fpcw & 0x0300) | 0x007f) : math::exp2(x) - 1;
+        // How often the host under this fpcw rounds unlike round to nearest:
+        hostdiff += (host_f2xm1(x, fpcw) != host_f2xm1(x, 0x037f));
+        if (r != expected) {
+          if (mismatches < 4) printf("  f2xm1(%.17g) with fpcw %04x: %.17g, expected %.17g\n", x, fpcw, r, expected);
+          mismatches++;
+        }
+      }
+      W16 after = cpu_fpcw();
+      W16 defaultfpcw = 0x037f;
+      asm volatile("fldcw %0" : : "m" (defaultfpcw));
+      if (after != ambient) {
+        printf("  f2xm1 with fpcw %04x: host fpcw changed from %04x to %04x\n", fpcw, ambient, after);
+        failures++;
+      }
+      printf("%-6s %8x %8g %6s %10llu %10llu\n", "f2xm1", fpcw, ranges[i], (onhost) ? "host" : "soft",
+             (unsigned long long)mismatches, (unsigned long long)hostdiff);
+      failures += (mismatches != 0);
+    }
+  }
+
+  return failures;
+}
+
+static double nanoseconds() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+  int iterations = (argc > 1) ? atoi(argv[1]) : 1000000;
+  static const double ranges[] = {1.0, 0.78539816339744828, 1e-3, 1e-150, 8.0};
+  int failures = 0;
+
+  // Extended precision, round to nearest, all exceptions masked:
+  W16 fpcw = 0x037f;
+  asm volatile("fldcw %0" : : "m" (fpcw));
+
+  printf("%-6s %8s %10s %10s %10s\n", "insn", "range", "host path", "mismatch", "unfiltered");
+  foreach (op, OP_COUNT) {
+    foreach (i, lengthof(ranges)) {
+      W64 taken = 0, mismatches = 0, unfiltered = 0;
+      lcg = 1;
+      foreach (j, iterations) {
+        double x = next_input(ranges[i]);
+        double soft = soft_op(op, x);
+        double host;
+
+        // How often the plain host result would round differently:
+        unfiltered += ((double)host_op(op, x) != soft);
+
+        if (!host_fast_path(op, x, host)) continue;
+        taken++;
+        if (host != soft) {
+          if (mismatches < 4) printf("  %s(%.17g): host %.17g, soft %.17g\n", opnames[op], x, host, soft);
+          mismatches++;
+        }
+      }
+      printf("%-6s %8g %9.1f%% %10llu %10llu\n", opnames[op], ranges[i],
+             100.0 * taken / iterations, (unsigned long long)mismatches, (unsigned long long)unfiltered);
+      failures += (mismatches != 0);
+    }
+  }
+
+  failures += test_f2xm1(iterations);
+
+  printf("\n%-6s %10s %10s\n", "insn", "host ns", "soft ns");
+  foreach (op, OP_COUNT) {
+    double sum = 0;
+    double t0 = nanoseconds();
+    lcg = 1;
+    foreach (j, iterations) sum += (double)host_op(op, next_input(0.5));
+    double t1 = nanoseconds();
+    lcg = 1;
+    foreach (j, iterations) sum += soft_op(op, next_input(0.5));
+    double t2 = nanoseconds();
+    printf("%-6s %10.1f %10.1f%s\n", opnames[op], (t1 - t0) / iterations, (t2 - t1) / iterations, (sum == 12345.0) ? " " : "");
+  }
+
+  if (failures) printf("\nFAILED: the host path differs from math:: in %d cases\n", failures);
+  return (failures != 0);
+}
@@ -402,8 +402,10 @@ inline void shiftop(IssueState& state, W64 ra, W64 rb, W64 rc, W16 raflags, W16
   func<T, genflags> f;
   T rt = f(ra, rb, rc, raflags, rbflags, rcflags, cf, of);
   state.reg.rddata = x86_merge<T>(ra, rt);
-  int allflags = (of << 11) | cf | x86_genflags<T>(rt);
-  state.reg.rdflags = (rb == 0) ? rcflags : allflags;
+  // Rotates leave SF, ZF and PF alone. Like x86, a count that masks to zero leaves all flags alone:
+  bool isrot = ((ptlopcode == OP_rotl) | (ptlopcode == OP_rotr) | (ptlopcode == OP_rotcl) | (ptlopcode == OP_rotcr));
+  int allflags = (of << 11) | cf | ((isrot) ? (rcflags & FLAG_ZAPS) : x86_genflags<T>(rt));
+  state.reg.rdflags = (lowbits(rb, (sizeof(T) == 8) ? 6 : 5) == 0) ? rcflags : allflags;
   capture_uop_context(state, ra, rb, rc, raflags, rbflags, rcflags, ptlopcode, log2(sizeof(T)));
 }
 
@@ -1369,7 +1371,6 @@ void name(IssueState& state, W64 ra, W64 rb, W64 rc, W16 raflags, W16 rbflags, W
   W64 rd; \
   vec16b va = buildvec(rb, ra); \
   vec16b vb = buildvec(0, 0); \
-  logfile << "va = ", va, ", vb = ", vb, endl; \
   if ((size == 0) & bit(sizemask, 0)) asm(#opcode0 " " extra "%[vb],%[va]; movq %[va],%[rd];" \
      : [rd] "=" W64_CONSTRAINT (rd), [va] "+x" (va), [vb] "+x" (vb)); \
   if ((size == 1) & bit(sizemask, 1)) asm(#opcode1 " " extra "%[vb],%[va]; movq %[va],%[rd];" \
@@ -1791,12 +1792,14 @@ uopimpl_func_t get_synthcode_for_uop(int op, int size, bool setflags, int cond,
 }
 
 void synth_uops_for_bb(BasicBlock& bb) {
-  bb.synthops = new uopimpl_func_t[bb.count];
+  // Space for these was set aside when the block was cloned:
+  uopimpl_func_t* synthops = bb.synthop_area();
   foreach (i, bb.count) {
-    const TransOp& transop = bb.transops[i];
+    const PackedTransOp& transop = bb.uops[i];
     uopimpl_func_t func = get_synthcode_for_uop(transop.opcode, transop.size, transop.setflags, transop.cond, transop.extshift, 0, transop.internal);
-    bb.synthops[i] = func;
+    synthops[i] = func;
   }
+  bb.synthops = synthops;
 }
 
 uopimpl_func_t get_synthcode_for_cond_branch(int opcode, int cond, int size, bool except) {